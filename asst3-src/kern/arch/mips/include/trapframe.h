@@ -104,5 +104,10 @@ __DEAD void mips_usermode(struct trapframe *tf);
 extern vaddr_t cpustacks[];
 extern vaddr_t cputhreads[];
 
+/*
+ * Array of per-cpu page directories for the UTLB refill handler.
+ */
+extern vaddr_t cpupagedirs[];
+
 
 #endif /* _MIPS_TRAPFRAME_H_ */
@@ -127,13 +127,20 @@ paddr_t ram_getfirstfree(void);
  * TLB shootdown bits.
  *
  * We'll take up to 16 invalidations before just flushing the whole TLB.
+ *
+ * Each shootdown covers a range of user pages. The sender waits for
+ * every target to count itself off in ts_done (under ts_lock) before
+ * it touches the frames the old entries pointed at; see
+ * vm_tlbinvalidate.
  */
 
+struct spinlock;
+
 struct tlbshootdown {
-	/*
-	 * Change this to what you need for your VM design.
-	 */
-	int ts_placeholder;
+	vaddr_t ts_start;		/* first page to invalidate */
+	vaddr_t ts_end;			/* end of the range */
+	struct spinlock *ts_lock;	/* protects *ts_done */
+	unsigned *ts_done;		/* cpus that have finished */
 };
 
 #define TLBSHOOTDOWN_MAX 16
@@ -118,6 +118,10 @@ kill_curthread(vaddr_t epc, unsigned code, vaddr_t vaddr)
 	 * Call proc_exit, creating an exit status that reflects the
 	 * signal number we died on. Since we don't implement core
 	 * dumps, we don't ever use _MKWAIT_CORE().
+	 *
+	 * We have no way to stop the other threads of a multithreaded
+	 * process, so only this thread dies; the signal status is what
+	 * the parent sees once the rest have exited.
 	 */
 	proc_exit(_MKWAIT_SIG(sig));
 
@@ -37,6 +37,7 @@
 #include <current.h>
 #include <copyinout.h>
 #include <syscall.h>
+#include <trace.h>
 
 
 /*
@@ -89,6 +90,7 @@ syscall(struct trapframe *tf)
 	KASSERT(curthread->t_iplhigh_count == 0);
 
 	callno = tf->tf_v0;
+	TRACE(TRACE_SYSCALL, callno, 0);
 
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
@@ -126,6 +128,15 @@ syscall(struct trapframe *tf)
 			(userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_spawnv:
+		err = sys_spawnv(
+			(userptr_t)tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			(userptr_t)tf->tf_a2,
+			tf->tf_a3,
+			&retval);
+		break;
+
 	    case SYS__exit:
 		sys__exit(tf->tf_a0);
 		panic("Returning from exit\n");
@@ -142,6 +153,65 @@ syscall(struct trapframe *tf)
 		err = sys_getpid(&retval);
 		break;
 
+	    case SYS___thread_create:
+		err = sys_thread_create((userptr_t)tf->tf_a0,
+					(userptr_t)tf->tf_a1,
+					(userptr_t)tf->tf_a2,
+					&retval);
+		break;
+
+	    case SYS_thread_exit:
+		sys_thread_exit(tf->tf_a0);
+		break;
+
+	    case SYS_thread_join:
+		err = sys_thread_join(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_gettid:
+		err = sys_gettid(&retval);
+		break;
+
+	    case SYS_futex_wait:
+		err = sys_futex_wait((userptr_t)tf->tf_a0, tf->tf_a1);
+		break;
+
+	    case SYS_futex_wake:
+		err = sys_futex_wake((userptr_t)tf->tf_a0, tf->tf_a1,
+				     &retval);
+		break;
+
+
+	    /* memory calls */
+
+	    case SYS_mmap:
+		{
+			/*
+			 * The 64-bit offset would go in a3 and the
+			 * next register, but has to start on an even
+			 * one, so a3 is skipped and it's all on the
+			 * stack.
+			 */
+			off_t offset;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &offset, sizeof(offset));
+			if (err) {
+				break;
+			}
+			err = sys_mmap(tf->tf_a0, tf->tf_a1, tf->tf_a2,
+				       offset, &retval);
+		}
+		break;
+
+	    case SYS_munmap:
+		err = sys_munmap((userptr_t)tf->tf_a0);
+		break;
+
+	    case SYS_msync:
+		err = sys_msync((userptr_t)tf->tf_a0);
+		break;
+
 
 	    /* file calls */
 
@@ -160,6 +230,21 @@ syscall(struct trapframe *tf)
 			&retval);
 		break;
 
+	    case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0);
+		break;
+
+	    case SYS_poll:
+		err = sys_poll(
+			(userptr_t)tf->tf_a0,
+			tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_sysring_enter:
+		err = sys_sysring_enter((userptr_t)tf->tf_a0, &retval);
+		break;
+
 	    case SYS_close:
 		err = sys_close(tf->tf_a0);
 		break;
@@ -178,6 +263,70 @@ syscall(struct trapframe *tf)
 			tf->tf_a2,
 			&retval);
 		break;
+	    case SYS_pread:
+	    case SYS_pwrite:
+		{
+			/*
+			 * The 64-bit position would go in an aligned
+			 * register pair, but a2 is taken by the size,
+			 * so it's on the stack after the four argument
+			 * slots.
+			 */
+			off_t pos;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &pos, sizeof(off_t));
+			if (err) {
+				break;
+			}
+			if (callno == SYS_pread) {
+				err = sys_pread(tf->tf_a0,
+						(userptr_t)tf->tf_a1,
+						tf->tf_a2, pos, &retval);
+			}
+			else {
+				err = sys_pwrite(tf->tf_a0,
+						 (userptr_t)tf->tf_a1,
+						 tf->tf_a2, pos, &retval);
+			}
+		}
+		break;
+	    case SYS_readv:
+		err = sys_readv(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_writev:
+		err = sys_writev(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_copy_file_range:
+		{
+			/* len and flags are on the stack after a0-a3 */
+			struct {
+				size_t len;
+				unsigned flags;
+			} more;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &more, sizeof(more));
+			if (err) {
+				break;
+			}
+			err = sys_copy_file_range(tf->tf_a0,
+						  (userptr_t)tf->tf_a1,
+						  tf->tf_a2,
+						  (userptr_t)tf->tf_a3,
+						  more.len, more.flags,
+						  &retval);
+		}
+		break;
+
 	    case SYS_lseek:
 		{
 			/*
@@ -67,6 +67,14 @@
 vaddr_t cpustacks[MAXCPUS];
 vaddr_t cputhreads[MAXCPUS];
 
+/*
+ * Page directory of the address space active on each cpu, or 0 if
+ * none. Indexed the same way; the UTLB refill handler in
+ * exception-mips1.S walks it to reload the TLB without a full trap.
+ * Maintained by as_activate and as_deactivate.
+ */
+vaddr_t cpupagedirs[MAXCPUS];
+
 /*
  * Do machine-dependent initialization of the cpu structure or things
  * associated with a new cpu. Note that we're not running on the new
@@ -38,6 +38,7 @@
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <vdso.h>
 
 /*
  * Dumb MIPS-only "VM system" that is intended to only be just barely
@@ -63,7 +64,7 @@
 /*
  * Wrap ram_stealmem in a spinlock.
  */
-static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
+static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER("stealmem_lock");
 #endif
 
 
@@ -147,6 +148,33 @@ free_kpages(vaddr_t addr)
 	(void)addr;
 }
 
+void
+ref_kpage(vaddr_t addr)
+{
+	/* nothing - pages are never freed anyway. */
+
+	(void)addr;
+}
+
+vaddr_t
+alloc_zeroed_kpage(void)
+{
+	vaddr_t page;
+
+	page = alloc_kpages(1);
+	if (page != 0) {
+		bzero((void *)page, PAGE_SIZE);
+	}
+	return page;
+}
+
+bool
+vm_idle_zero(void)
+{
+	/* stolen memory is never reused, so there's nothing to zero */
+	return false;
+}
+
 #endif
 
 void
@@ -172,6 +200,10 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
+		/* The vdso pages are the only read-only ones we have */
+		if (VDSO_CONTAINS(faultaddress)) {
+			return EFAULT;
+		}
 		/* We always create pages read-write, so we can't get this */
 		panic("dumbvm: got VM_FAULT_READONLY\n");
 	    case VM_FAULT_READ:
@@ -199,6 +231,10 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 		return EFAULT;-
 	}
 
+	if (VDSO_CONTAINS(faultaddress)) {
+		return vdso_fault(as, faulttype, faultaddress);
+	}
+
 	/* Assert that the address space has been set up properly. */
 	KASSERT(as->as_vbase1 != 0);
 	KASSERT(as->as_pbase1 != 0);
@@ -273,12 +309,18 @@ as_create(void)
 	as->as_npages2 = 0;
 	as->as_stackpbase = 0;
 
+	if (vdso_as_init(as)) {
+		kfree(as);
+		return NULL;
+	}
+
 	return as;
 }
 
 void
 as_destroy(struct addrspace *as)
 {
+	vdso_as_cleanup(as);
 	kfree(as);
 }
 
@@ -400,6 +442,88 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+int
+as_define_thread_stack(struct addrspace *as, vaddr_t *stackptr)
+{
+	/* dumbvm only has room for the one stack */
+	(void)as;
+	(void)stackptr;
+	return ENOSYS;
+}
+
+void
+as_release_thread_stack(struct addrspace *as, vaddr_t stackptr)
+{
+	(void)as;
+	(void)stackptr;
+}
+
+paddr_t
+as_lookup_frame(struct addrspace *as, vaddr_t vaddr)
+{
+	/* Not worth it here; callers fall back to copying. */
+	(void)as;
+	(void)vaddr;
+	return 0;
+}
+
+int
+as_map(struct addrspace *as, size_t len, int prot, int flags,
+       struct vnode *vn, off_t offset, vaddr_t *ret)
+{
+	/* No room for regions that come and go. */
+	(void)as;
+	(void)len;
+	(void)prot;
+	(void)flags;
+	(void)vn;
+	(void)offset;
+	(void)ret;
+	return ENOSYS;
+}
+
+int
+as_unmap(struct addrspace *as, vaddr_t vaddr)
+{
+	(void)as;
+	(void)vaddr;
+	return EINVAL;
+}
+
+int
+as_sync(struct addrspace *as, vaddr_t vaddr)
+{
+	(void)as;
+	(void)vaddr;
+	return EINVAL;
+}
+
+int
+as_adopt_pages(struct addrspace *as, vaddr_t vaddr,
+	       const vaddr_t *kpages, unsigned npages)
+{
+	/* Our memory is allocated in fixed chunks; callers copy instead. */
+	(void)as;
+	(void)vaddr;
+	(void)kpages;
+	(void)npages;
+	return ENOSYS;
+}
+
+void
+as_bootstrap(void)
+{
+	/* Nothing to set up. */
+}
+
+void
+as_set_text(struct addrspace *as, struct vnode *v)
+{
+	/* as_adopt_pages never works, so nothing gets shared */
+	(void)as;
+	(void)v;
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
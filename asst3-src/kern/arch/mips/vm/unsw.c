@@ -32,6 +32,7 @@
 #include <vm.h>
 #include <mainbus.h>
 #include <spinlock.h>
+#include <ticketlock.h>
 
 vaddr_t firstfree;   /* first free virtual address; set by start.S */
 
@@ -43,6 +44,7 @@ static paddr_t lastpaddr;   /* one past end of last free physical page */
 typedef struct ft_entry {
         unsigned allocated:1; /* the corresponding frame is allocated */
         unsigned not_last:1; /* the frame is part of a multiframe allocation */
+        unsigned refcount:16; /* references to a single frame (see ref_kpage) */
 } ft_entry_t;
 
 
@@ -57,9 +59,33 @@ static uint32_t last_frame;
 
 /* frame_table protected by spinlock (interrupt disabling on
  * uniprocessor) as this implementation does not block.
+ *
+ * Every page fault and kmalloc page comes through here, so use a
+ * ticket lock: CPUs queue up in order instead of all hammering the
+ * lock word.
  */ 
 
-static struct spinlock frame_table_spinlock = SPINLOCK_INITIALIZER;
+static struct ticketlock frame_table_spinlock =
+	TICKETLOCK_INITIALIZER("frame_table_spinlock");
+static uint32_t frames_free; /* number of free frames, also under the lock */
+
+/*
+ * Pool of pre-zeroed pages.
+ *
+ * Idle CPUs zero free frames ahead of time (see vm_idle_zero) so that
+ * demand-zero faults don't have to. Pages in the pool are allocated
+ * as far as the frame table is concerned; they're chained through
+ * their first word, which alloc_zeroed_kpage clears again on the way
+ * out. The pool is kept to a small share of memory, isn't refilled
+ * when memory is short, and is given back if alloc_kpages runs out.
+ */
+
+#define ZEROPOOL_MAX 64           /* most pages to keep zeroed */
+
+static struct spinlock zeropool_lock = SPINLOCK_INITIALIZER("zeropool_lock");
+static vaddr_t zeropool_head;     /* first page in the pool, or 0 */
+static unsigned zeropool_count;   /* number of pages in the pool */
+static unsigned zeropool_max;     /* set by ram_bootstrap */
 
 /*
  * Called very early in system boot to figure out how much physical
@@ -141,6 +167,13 @@ ram_bootstrap(void)
         for (i = first_frame; i < (lastpaddr >> PAGE_BITS); i++) {
                 frame_table[i].allocated = FALSE;
         }
+        frames_free = last_frame - first_frame;
+
+        /* zero ahead at most 1/16 of memory */
+        zeropool_max = frames_free / 16;
+        if (zeropool_max > ZEROPOOL_MAX) {
+                zeropool_max = ZEROPOOL_MAX;
+        }
 
         
 }
@@ -207,13 +240,15 @@ static paddr_t alloc_one_frame(unsigned int npages)
         
         KASSERT(npages == 1);
 
-        spinlock_acquire(&frame_table_spinlock);
+        ticketlock_acquire(&frame_table_spinlock);
         for (i =  first_frame; i < last_frame; i++) {
                 if (frame_table[i].allocated == FALSE) {
                         frame_table[i].allocated = TRUE;
                         frame_table[i].not_last = FALSE;
+                        frame_table[i].refcount = 1;
+                        frames_free--;
 
-                        spinlock_release(&frame_table_spinlock);
+                        ticketlock_release(&frame_table_spinlock);
 
                         return (paddr_t) (i << PAGE_BITS);
                 }
@@ -221,7 +256,7 @@ static paddr_t alloc_one_frame(unsigned int npages)
         
         /* Did not find an unallocated frame :-( */
 
-        spinlock_release(&frame_table_spinlock);
+        ticketlock_release(&frame_table_spinlock);
         return (paddr_t) 0;
 }
 
@@ -236,7 +271,7 @@ static paddr_t alloc_multiple_frames(unsigned int npages)
          */
         
 
-        spinlock_acquire(&frame_table_spinlock);
+        ticketlock_acquire(&frame_table_spinlock);
 
         i = first_frame; j = 0;
 
@@ -254,18 +289,21 @@ static paddr_t alloc_multiple_frames(unsigned int npages)
                 for (j = i; j < i + npages - 1; j++) {
                         frame_table[j].allocated = TRUE; /* mark frame allocated */
                         frame_table[j].not_last = TRUE;  /* as a contiguous block */
+                        frame_table[j].refcount = 1;
                 }
                 frame_table[j].allocated = TRUE;
                 frame_table[j].not_last = FALSE;
+                frame_table[j].refcount = 1;
+                frames_free -= npages;
 
-                spinlock_release(&frame_table_spinlock);
+                ticketlock_release(&frame_table_spinlock);
                 
                 return (paddr_t) (i << PAGE_BITS);
         }
         
         /* Did not find an unallocated contiguous range of frames :-( */
 
-        spinlock_release(&frame_table_spinlock);
+        ticketlock_release(&frame_table_spinlock);
         return (paddr_t) 0;
 }
 
@@ -280,21 +318,53 @@ static void free_frames(vaddr_t vaddr)
 
         i = paddr >> PAGE_BITS;
 
-        spinlock_acquire(&frame_table_spinlock);
+        ticketlock_acquire(&frame_table_spinlock);
 
         if (frame_table[i].allocated == FALSE) { /* check for double free error */
                 panic("Double free error!!");
         }
-        
+
+        if (frame_table[i].refcount > 1) { /* still shared, just drop a reference */
+                frame_table[i].refcount--;
+                ticketlock_release(&frame_table_spinlock);
+                return;
+        }
+
         while (frame_table[i].allocated == TRUE) { /* otherwise mark block free */
                 frame_table[i].allocated = FALSE;
+                frames_free++;
                 if (frame_table[i].not_last == TRUE) {
                         i++;
                 }
         }
-        spinlock_release(&frame_table_spinlock);
+        ticketlock_release(&frame_table_spinlock);
 }
         
+/*
+ * Give all the pages in the zeroed pool back to the frame table.
+ * Returns true if there were any.
+ */
+static bool zeropool_drain(void)
+{
+        vaddr_t page, next;
+
+        spinlock_acquire(&zeropool_lock);
+        page = zeropool_head;
+        zeropool_head = 0;
+        zeropool_count = 0;
+        spinlock_release(&zeropool_lock);
+
+        if (page == 0) {
+                return false;
+        }
+        while (page != 0) {
+                next = *(vaddr_t *)page;
+                free_frames(page);
+                page = next;
+        }
+        return true;
+}
+
 /* Allocate/free some kernel-space virtual pages */
 vaddr_t
 alloc_kpages(unsigned npages)
@@ -306,6 +376,11 @@ alloc_kpages(unsigned npages)
         else {
                 paddr = alloc_one_frame(npages);
         }
+
+        /* if we're out, the pre-zeroed pages are fair game */
+        if (paddr == 0 && zeropool_drain()) {
+                return alloc_kpages(npages);
+        }
         
 	if (paddr == 0) {
 		return 0;
@@ -313,9 +388,91 @@ alloc_kpages(unsigned npages)
 	return PADDR_TO_KVADDR(paddr);
 }
 
+/*
+ * Allocate one page filled with zeros, from the pool if we can.
+ */
+vaddr_t
+alloc_zeroed_kpage(void)
+{
+        vaddr_t page;
+
+        spinlock_acquire(&zeropool_lock);
+        page = zeropool_head;
+        if (page != 0) {
+                zeropool_head = *(vaddr_t *)page;
+                zeropool_count--;
+        }
+        spinlock_release(&zeropool_lock);
+
+        if (page != 0) {
+                *(vaddr_t *)page = 0;
+                return page;
+        }
+
+        page = alloc_kpages(1);
+        if (page != 0) {
+                bzero((void *)page, PAGE_SIZE);
+        }
+        return page;
+}
+
+/*
+ * Called by idle CPUs: zero one free page and put it in the pool.
+ * Returns false if there was nothing to do, in which case the caller
+ * should really go idle. Runs with interrupts off, so only does one
+ * page at a time.
+ */
+bool
+vm_idle_zero(void)
+{
+        paddr_t paddr;
+        vaddr_t page;
+
+        /* unlocked peeks; being off by one either way is harmless */
+        if (zeropool_count >= zeropool_max ||
+            frames_free < 4 * zeropool_max) {
+                return false;
+        }
+
+        paddr = alloc_one_frame(1);
+        if (paddr == 0) {
+                return false;
+        }
+        page = PADDR_TO_KVADDR(paddr);
+        bzero((void *)page, PAGE_SIZE);
+
+        spinlock_acquire(&zeropool_lock);
+        if (zeropool_count >= zeropool_max) {
+                /* another CPU filled it meanwhile */
+                spinlock_release(&zeropool_lock);
+                free_frames(page);
+                return false;
+        }
+        *(vaddr_t *)page = zeropool_head;
+        zeropool_head = page;
+        zeropool_count++;
+        spinlock_release(&zeropool_lock);
+        return true;
+}
+
 void
 free_kpages(vaddr_t addr)
 {
         free_frames(addr);
 }
 
+void
+ref_kpage(vaddr_t addr)
+{
+        uint32_t i;
+
+        i = KVADDR_TO_PADDR(addr) >> PAGE_BITS;
+
+        ticketlock_acquire(&frame_table_spinlock);
+        KASSERT(frame_table[i].allocated == TRUE);
+        KASSERT(frame_table[i].not_last == FALSE);
+        KASSERT(frame_table[i].refcount < 0xffff);
+        frame_table[i].refcount++;
+        ticketlock_release(&frame_table_spinlock);
+}
+
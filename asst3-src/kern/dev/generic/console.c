@@ -39,6 +39,11 @@
  * supported, although such support could be added without undue
  * difficulty.
  *
+ * Output, from kprintf and from con_io, is buffered: it goes into a
+ * ring that con_start drains a character per write-done interrupt.
+ * Printing by polling sends whatever is buffered first, so output
+ * stays in order and a panic or halt doesn't leave any behind.
+ *
  * Note that nothing happens until we have a device to write to. A
  * buffer of size DELAYBUFSIZE is used to hold output that is
  * generated before this point. This means that (1) using kprintf for
@@ -51,10 +56,13 @@
 #include <kern/errno.h>
 #include <lib.h>
 #include <uio.h>
+#include <spl.h>
 #include <cpu.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <wchan.h>
+#include <poll.h>
 #include <generic/console.h>
 #include <vfs.h>
 #include <device.h>
@@ -109,15 +117,92 @@ flush_delay_buf(void)
 
 //////////////////////////////////////////////////
 
+/*
+ * Output buffer. It's empty when head == tail, and full when
+ * head+1 == tail, like the input buffer.
+ */
+static
+unsigned
+con_outroom(struct con_softc *cs)
+{
+	return (cs->cs_outbuf_tail + CONSOLE_OUTPUT_BUFFER_SIZE -
+		cs->cs_outbuf_head - 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+}
+
+/*
+ * Get the device going on the next buffered character, unless it's
+ * already busy with one.
+ */
+static
+void
+con_sendnext(struct con_softc *cs)
+{
+	unsigned char ch;
+
+	KASSERT(spinlock_do_i_hold(&cs->cs_outlock));
+
+	if (cs->cs_outbusy || cs->cs_outbuf_head == cs->cs_outbuf_tail) {
+		return;
+	}
+	ch = cs->cs_outbuf[cs->cs_outbuf_tail];
+	cs->cs_outbuf_tail =
+		(cs->cs_outbuf_tail + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+	cs->cs_outbusy = true;
+	cs->cs_send(cs->cs_devdata, ch);
+}
+
+/*
+ * Buffer up to LEN characters from BUF, waiting only if there's no
+ * room at all. Returns how many were taken.
+ */
+static
+size_t
+con_put(struct con_softc *cs, const char *buf, size_t len)
+{
+	size_t i;
+
+	spinlock_acquire(&cs->cs_outlock);
+	while (con_outroom(cs) == 0) {
+		cs->cs_outwaiting = true;
+		wchan_sleep(cs->cs_outwchan, &cs->cs_outlock);
+	}
+	for (i=0; i<len && con_outroom(cs) > 0; i++) {
+		cs->cs_outbuf[cs->cs_outbuf_head] = buf[i];
+		cs->cs_outbuf_head =
+			(cs->cs_outbuf_head + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+	}
+	con_sendnext(cs);
+	spinlock_release(&cs->cs_outlock);
+	return i;
+}
+
+//////////////////////////////////////////////////
+
 /*
  * Print a character, using polling instead of interrupts to wait for
- * I/O completion.
+ * I/O completion. Anything buffered goes out first.
  */
 static
 void
 putch_polled(struct con_softc *cs, int ch)
 {
+	unsigned char bch;
+
+	if (spinlock_do_i_hold(&cs->cs_outlock)) {
+		/* panicking in here; just get the message out */
+		cs->cs_sendpolled(cs->cs_devdata, ch);
+		return;
+	}
+
+	spinlock_acquire(&cs->cs_outlock);
+	while (cs->cs_outbuf_head != cs->cs_outbuf_tail) {
+		bch = cs->cs_outbuf[cs->cs_outbuf_tail];
+		cs->cs_outbuf_tail =
+			(cs->cs_outbuf_tail + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+		cs->cs_sendpolled(cs->cs_devdata, bch);
+	}
 	cs->cs_sendpolled(cs->cs_devdata, ch);
+	spinlock_release(&cs->cs_outlock);
 }
 
 //////////////////////////////////////////////////
@@ -129,8 +214,9 @@ static
 void
 putch_intr(struct con_softc *cs, int ch)
 {
-	P(cs->cs_wsem);
-	cs->cs_send(cs->cs_devdata, ch);
+	char bch = ch;
+
+	con_put(cs, &bch, 1);
 }
 
 /*
@@ -174,17 +260,40 @@ con_input(void *vcs, int ch)
 	cs->cs_gotchars_head = nexthead;
 
 	V(cs->cs_rsem);
+
+	/* a finished line (or a full buffer) is what makes us readable */
+	if (ch == '\r' || ch == '\n' ||
+	    (nexthead + 1) % CONSOLE_INPUT_BUFFER_SIZE == cs->cs_gotchars_tail) {
+		poll_wakeup();
+	}
 }
 
 /*
  * Called from underlying device when a write-done interrupt occurs.
+ * Send the next buffered character, and once the buffer is half
+ * empty let writers (and poll) know there's room again; waking them
+ * for every character would just have them fill one slot at a time.
  */
 void
 con_start(void *vcs)
 {
 	struct con_softc *cs = vcs;
+	bool wake = false;
+
+	spinlock_acquire(&cs->cs_outlock);
+	cs->cs_outbusy = false;
+	con_sendnext(cs);
+	if (cs->cs_outwaiting &&
+	    con_outroom(cs) >= CONSOLE_OUTPUT_BUFFER_SIZE / 2) {
+		cs->cs_outwaiting = false;
+		wchan_wakeall(cs->cs_outwchan, &cs->cs_outlock);
+		wake = true;
+	}
+	spinlock_release(&cs->cs_outlock);
 
-	V(cs->cs_wsem);
+	if (wake) {
+		poll_wakeup();
+	}
 }
 
 //////////////////////////////////////////////////
@@ -240,16 +349,20 @@ con_eachopen(struct device *dev, int openflags)
 	return 0;
 }
 
+/* Bytes of a write copied in at a time. */
+#define CON_WRITE_CHUNK 64
+
 static
 int
 con_io(struct device *dev, struct uio *uio)
 {
+	struct con_softc *cs = dev->d_data;
 	int result;
 	char ch;
+	char inbuf[CON_WRITE_CHUNK], outbuf[2 * CON_WRITE_CHUNK];
+	size_t len, outlen, done, i;
 	struct lock *lk;
 
-	(void)dev;  // unused
-
 	if (uio->uio_rw==UIO_READ) {
 		lk = con_userlock_read;
 	}
@@ -276,15 +389,30 @@ con_io(struct device *dev, struct uio *uio)
 			}
 		}
 		else {
-			result = uiomove(&ch, 1, uio);
+			/*
+			 * Copy in a chunk, add the carriage returns, and
+			 * buffer it for con_start to send.
+			 */
+			len = uio->uio_resid;
+			if (len > sizeof(inbuf)) {
+				len = sizeof(inbuf);
+			}
+			result = uiomove(inbuf, len, uio);
 			if (result) {
 				lock_release(lk);
 				return result;
 			}
-			if (ch=='\n') {
-				putch('\r');
+			outlen = 0;
+			for (i=0; i<len; i++) {
+				if (inbuf[i]=='\n') {
+					outbuf[outlen++] = '\r';
+				}
+				outbuf[outlen++] = inbuf[i];
+			}
+			for (done=0; done<outlen; ) {
+				done += con_put(cs, outbuf + done,
+						outlen - done);
 			}
-			putch(ch);
 		}
 	}
 	lock_release(lk);
@@ -302,10 +430,61 @@ con_ioctl(struct device *dev, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * Reads stop at the end of a line, so we're only readable without
+ * waiting if there's a whole line buffered (or the buffer is full and
+ * nothing more can come in until someone reads). Writing only waits
+ * if the output buffer is full.
+ */
+static
+int
+con_poll(struct device *dev, int events, int *revents)
+{
+	struct con_softc *cs = dev->d_data;
+	unsigned i, head, tail;
+	bool ready;
+	int spl;
+
+	*revents = 0;
+	if (events & POLLOUT) {
+		spinlock_acquire(&cs->cs_outlock);
+		if (con_outroom(cs) > 0) {
+			*revents |= POLLOUT;
+		}
+		else {
+			/* have con_start call poll_wakeup */
+			cs->cs_outwaiting = true;
+		}
+		spinlock_release(&cs->cs_outlock);
+	}
+	if ((events & POLLIN) == 0) {
+		return 0;
+	}
+
+	/* keep con_input from moving things while we look */
+	spl = splhigh();
+	head = cs->cs_gotchars_head;
+	tail = cs->cs_gotchars_tail;
+	ready = (head + 1) % CONSOLE_INPUT_BUFFER_SIZE == tail;
+	for (i = tail; i != head && !ready;
+	     i = (i + 1) % CONSOLE_INPUT_BUFFER_SIZE) {
+		if (cs->cs_gotchars[i] == '\r' || cs->cs_gotchars[i] == '\n') {
+			ready = true;
+		}
+	}
+	splx(spl);
+
+	if (ready) {
+		*revents |= POLLIN;
+	}
+	return 0;
+}
+
 static const struct device_ops console_devops = {
 	.devop_eachopen = con_eachopen,
 	.devop_io = con_io,
 	.devop_ioctl = con_ioctl,
+	.devop_poll = con_poll,
 };
 
 static
@@ -343,7 +522,8 @@ attach_console_to_vfs(struct con_softc *cs)
 int
 config_con(struct con_softc *cs, int unit)
 {
-	struct semaphore *rsem, *wsem;
+	struct semaphore *rsem;
+	struct wchan *wc;
 	struct lock *rlk, *wlk;
 
 	/*
@@ -363,30 +543,36 @@ config_con(struct con_softc *cs, int unit)
 	if (rsem == NULL) {
 		return ENOMEM;
 	}
-	wsem = sem_create("console write", 1);
-	if (wsem == NULL) {
+	wc = wchan_create("console write");
+	if (wc == NULL) {
 		sem_destroy(rsem);
 		return ENOMEM;
 	}
 	rlk = lock_create("console-lock-read");
 	if (rlk == NULL) {
 		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(wc);
 		return ENOMEM;
 	}
 	wlk = lock_create("console-lock-write");
 	if (wlk == NULL) {
 		lock_destroy(rlk);
 		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(wc);
 		return ENOMEM;
 	}
 
 	cs->cs_rsem = rsem;
-	cs->cs_wsem = wsem;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
 
+	spinlock_init(&cs->cs_outlock);
+	cs->cs_outwchan = wc;
+	cs->cs_outbuf_head = 0;
+	cs->cs_outbuf_tail = 0;
+	cs->cs_outbusy = false;
+	cs->cs_outwaiting = false;
+
 	the_console = cs;
 	con_userlock_read = rlk;
 	con_userlock_write = wlk;
@@ -33,6 +33,7 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <uio.h>
 #include <membar.h>
@@ -165,6 +166,19 @@ lhd_ioctl(struct device *d, int op, userptr_t data)
 	return EIOCTL;
 }
 
+/*
+ * Function for poll. Disk I/O waits, but never indefinitely, so
+ * we're always ready.
+ */
+static
+int
+lhd_poll(struct device *d, int events, int *revents)
+{
+	(void)d;
+	*revents = events & (POLLIN | POLLOUT);
+	return 0;
+}
+
 #if 0
 /*
  * Reset the device.
@@ -268,6 +282,7 @@ static const struct device_ops lhd_devops = {
 	.devop_eachopen = lhd_eachopen,
 	.devop_io = lhd_io,
 	.devop_ioctl = lhd_ioctl,
+	.devop_poll = lhd_poll,
 };
 
 /*
@@ -38,6 +38,7 @@
 #include <current.h>
 #include <vfs.h>
 #include <vnode.h>
+#include <poll.h>
 
 #include "semfs.h"
 
@@ -151,6 +152,7 @@ semfs_wakeup(struct semfs_sem *sem, unsigned newcount)
 	else {
 		cv_broadcast(sem->sems_cv, sem->sems_lock);
 	}
+	poll_wakeup();
 }
 
 /*
@@ -180,6 +182,30 @@ semfs_semstat(struct vnode *vn, struct stat *buf)
 	return 0;
 }
 
+/*
+ * poll() for semaphore vnodes. P (reading) can go ahead without
+ * waiting if the count is nonzero; V (writing) never waits.
+ */
+static
+int
+semfs_poll(struct vnode *vn, int events, int *revents)
+{
+	struct semfs_vnode *semv = vn->vn_data;
+	struct semfs_sem *sem;
+
+	sem = semfs_getsem(semv);
+
+	*revents = events & POLLOUT;
+
+	lock_acquire(sem->sems_lock);
+	if (sem->sems_count > 0) {
+		*revents |= events & POLLIN;
+	}
+	lock_release(sem->sems_lock);
+
+	return 0;
+}
+
 /*
  * Read. This is P(); decrease the count by the amount read.
  * Don't actually bother to transfer any data.
@@ -662,6 +688,7 @@ static const struct vnode_ops semfs_dirops = {
 	.vop_stat = semfs_dirstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
+	.vop_poll = vnode_poll_ready,
 	.vop_fsync = semfs_fsync,
 	.vop_mmap = vopfail_mmap_isdir,
 	.vop_truncate = vopfail_truncate_isdir,
@@ -695,6 +722,7 @@ static const struct vnode_ops semfs_semops = {
 	.vop_stat = semfs_semstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
+	.vop_poll = semfs_poll,
 	.vop_fsync = semfs_fsync,
 	.vop_mmap = vopfail_mmap_perm,
 	.vop_truncate = semfs_truncate,
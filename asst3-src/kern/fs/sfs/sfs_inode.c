@@ -36,9 +36,36 @@
 #include <kern/errno.h>
 #include <lib.h>
 #include <vfs.h>
+#include <kmem.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
+/*
+ * Cache for struct sfs_vnode. These are just over 512 bytes, because
+ * of the inode copy, so kmalloc would round them up to 1024.
+ */
+static struct kmem_cache *sfs_vnodecache;
+
+/*
+ * Create the vnode cache if it doesn't exist yet. Called at mount
+ * time, under the vfs big lock.
+ */
+int
+sfs_vnodecache_init(void)
+{
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (sfs_vnodecache == NULL) {
+		sfs_vnodecache = kmem_cache_create("sfs_vnode",
+						   sizeof(struct sfs_vnode),
+						   NULL, NULL);
+		if (sfs_vnodecache == NULL) {
+			return ENOMEM;
+		}
+	}
+	return 0;
+}
+
 
 /*
  * Write an on-disk inode structure back out to disk.
@@ -136,7 +163,7 @@ sfs_reclaim(struct vnode *v)
 	vfs_biglock_release();
 
 	/* Release the storage for the vnode structure itself. */
-	kfree(sv);
+	kmem_cache_free(sfs_vnodecache, sv);
 
 	/* Done */
 	return 0;
@@ -184,7 +211,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 
 	/* Didn't have it loaded; load it */
 
-	sv = kmalloc(sizeof(struct sfs_vnode));
+	sv = kmem_cache_alloc(sfs_vnodecache);
 	if (sv==NULL) {
 		return ENOMEM;
 	}
@@ -198,7 +225,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Read the block the inode is in */
 	result = sfs_readblock(sfs, ino, &sv->sv_i, sizeof(sv->sv_i));
 	if (result) {
-		kfree(sv);
+		kmem_cache_free(sfs_vnodecache, sv);
 		return result;
 	}
 
@@ -235,7 +262,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Call the common vnode initializer */
 	result = vnode_init(&sv->sv_absvn, ops, &sfs->sfs_absfs, sv);
 	if (result) {
-		kfree(sv);
+		kmem_cache_free(sfs_vnodecache, sv);
 		return result;
 	}
 
@@ -246,7 +273,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	result = vnodearray_add(sfs->sfs_vnodes, &sv->sv_absvn, NULL);
 	if (result) {
 		vnode_cleanup(&sv->sv_absvn);
-		kfree(sv);
+		kmem_cache_free(sfs_vnodecache, sv);
 		return result;
 	}
 
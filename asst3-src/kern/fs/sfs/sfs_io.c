@@ -38,6 +38,7 @@
 #include <uio.h>
 #include <vfs.h>
 #include <device.h>
+#include <trace.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
@@ -64,9 +65,9 @@ sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 
 	KASSERT(vfs_biglock_do_i_hold());
 
-	DEBUG(DB_SFS, "sfs: %s %llu\n",
-	      uio->uio_rw == UIO_READ ? "read" : "write",
-	      uio->uio_offset / SFS_BLOCKSIZE);
+	/* not DEBUG(DB_SFS, ...): printing here changes the timing too much */
+	TRACE(uio->uio_rw == UIO_READ ? TRACE_SFSREAD : TRACE_SFSWRITE,
+	      uio->uio_offset / SFS_BLOCKSIZE, 0);
 
  retry:
 	result = DEVOP_IO(sfs->sfs_device, uio);
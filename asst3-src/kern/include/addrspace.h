@@ -39,6 +39,14 @@
 #include "opt-dumbvm.h"
 
 struct vnode;
+struct lock;
+
+/*
+ * User thread stacks (see as_define_thread_stack) are carved out below
+ * the main stack in fixed slots, each USRSTACKSIZE with an unmapped
+ * guard page underneath.
+ */
+#define THREADSTACKS_MAX 32
 
 
 /*
@@ -55,7 +63,9 @@ struct region{
     int writeable;
     int executable;
     int oldwriteable;           // to record its original writeable bit before changing
-    struct region *next;        // regions is a linked list
+    int mapflags;               // MAP_SHARED or MAP_PRIVATE if it came from mmap, else 0
+    struct vnode *mapvn;        // the file an mmap region maps, or NULL for anonymous memory
+    off_t mapoffset;            // file offset that base maps
 };
 
 struct addrspace {
@@ -69,15 +79,27 @@ struct addrspace {
         paddr_t as_stackpbase;
 #else
         /* Put stuff here for your VM system */
-        struct region *regions;
-        paddr_t **pt;     // a two level page table
-        // something else here
+        struct region **as_regions;      // sorted by base, never overlapping
+        unsigned as_nregions;
+        unsigned as_maxregions;          // size of the as_regions array
+        struct region *as_lastregion;    // last region as_find_region hit
+        paddr_t **pt;     // a two level page table; NULL until something is mapped
+        uint16_t *as_ptcount;            // entries in use in each level 2 table
+        uint32_t as_ptmap[PTE_NUMBER / 32];  // which level 2 tables exist (bitmap)
+        struct lock *as_lock;       // protects regions and pt between our threads
+        uint32_t as_stacksinuse;    // thread stack slots in use (bitmap)
+        uint32_t as_stacksdefined;  // thread stack slots with a region (bitmap)
+        struct vnode *as_text;      // program whose page cache we share pages from, or NULL
 #endif
+        paddr_t as_vdso;            // vdso process page (see vdso.h)
 };
 
 /*
  * Functions in addrspace.c:
  *
+ *    as_bootstrap - set up global state (the region cache). Called
+ *                once from vm_bootstrap.
+ *
  *    as_create - create a new empty address space. You need to make
  *                sure this gets called in all the right places. You
  *                may find you want to change the argument list. May
@@ -96,11 +118,12 @@ struct addrspace {
  *                avoid potentially "seeing" it while it's being
  *                destroyed.
  *
- *    as_destroy - dispose of an address space. You may need to change
- *                the way this works if implementing user-level threads.
+ *    as_destroy - dispose of an address space. Only happens once the
+ *                last thread using it has exited.
  *
  *    as_define_region - set up a region of memory within the address
- *                space.
+ *                space. A region that touches an existing one with the
+ *                same permissions is merged into it.
  *
  *    as_prepare_load - this is called before actually loading from an
  *                executable into the address space.
@@ -112,10 +135,56 @@ struct addrspace {
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
  *
+ *    as_define_thread_stack - pick a free user stack slot for a new
+ *                thread, setting up its region the first time the slot
+ *                is used. Hands back the initial stack pointer.
+ *
+ *    as_release_thread_stack - give a thread stack slot back when its
+ *                thread exits. The pages stay mapped for the next
+ *                thread to use the slot, so nothing has to be removed
+ *                from other CPUs' TLBs.
+ *
+ *    as_find_region - return the region containing VADDR, or NULL.
+ *                Binary search over the sorted region array, after
+ *                trying the region the last lookup found. The caller
+ *                must hold as_lock (or otherwise own the address
+ *                space). Not used with dumbvm.
+ *
+ *    as_map    - add an mmap region of LEN bytes somewhere below the
+ *                vdso, mapping VN from OFFSET (or anonymous memory if
+ *                VN is NULL). Nothing is read until it's touched.
+ *
+ *    as_unmap  - remove the mmap region starting at VADDR, then write
+ *                a shared file mapping's modified pages back. The
+ *                region is gone even if writing them fails.
+ *
+ *    as_sync   - write a shared file mapping's modified pages back
+ *                to the file.
+ *
+ *    as_ptalloc - make sure the page directory and the level 2 table
+ *                for VADDR exist. Call with as_lock held. Whoever then
+ *                fills in an entry bumps as_ptcount for its table, so
+ *                tables can be freed again when they empty out.
+ *
+ *    as_lookup_frame - return the physical frame behind a user page,
+ *                or 0 if it hasn't been faulted in. Doesn't fault
+ *                anything in itself. The caller gets a reference to
+ *                the frame and must drop it with free_kpages.
+ *
+ *    as_adopt_pages - map kernel pages into the address space as
+ *                user pages, which then belong to the address space.
+ *                Used by exec to put the argv on the new stack
+ *                without copying it.
+ *
+ *    as_set_text - note that the address space maps pages from the
+ *                page cache of program V, and keep V (and so its
+ *                cache) around until the address space goes away.
+ *
  * Note that when using dumbvm, addrspace.c is not used and these
  * functions are found in dumbvm.c.
  */
 
+void              as_bootstrap(void);
 struct addrspace *as_create(void);
 int               as_copy(struct addrspace *src, struct addrspace **ret);
 void              as_activate(void);
@@ -130,6 +199,21 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_define_thread_stack(struct addrspace *as,
+                                         vaddr_t *initstackptr);
+void              as_release_thread_stack(struct addrspace *as,
+                                          vaddr_t stackptr);
+struct region    *as_find_region(struct addrspace *as, vaddr_t vaddr);
+int               as_ptalloc(struct addrspace *as, vaddr_t vaddr);
+int               as_map(struct addrspace *as, size_t len, int prot,
+                         int flags, struct vnode *vn, off_t offset,
+                         vaddr_t *ret);
+int               as_unmap(struct addrspace *as, vaddr_t vaddr);
+int               as_sync(struct addrspace *as, vaddr_t vaddr);
+paddr_t           as_lookup_frame(struct addrspace *as, vaddr_t vaddr);
+int               as_adopt_pages(struct addrspace *as, vaddr_t vaddr,
+                                 const vaddr_t *kpages, unsigned npages);
+void              as_set_text(struct addrspace *as, struct vnode *v);
 
 
 /*
@@ -35,6 +35,7 @@
 #define _FILETABLE_H_
 
 #include <limits.h> /* for OPEN_MAX */
+#include <spinlock.h>
 
 
 /*
@@ -48,14 +49,15 @@
  * or even to make it dynamic with the limit being user-settable. (See
  * setrlimit(2) on a Unix machine.)
  *
- * Because we only have single-threaded processes, the file table is
- * never shared and so it doesn't require synchronization. On fork,
- * the table is copied. Another exercise: what would you need to do to
- * make this code safe for multithreaded processes? What happens if
- * one thread calls close() while another one is in the middle of e.g.
- * read() using the same file handle?
+ * The threads of a multithreaded process share the file table, so
+ * the slots are protected by ft_lock. On fork, the table is copied.
+ * So that one thread can close() a file handle while another is in
+ * the middle of e.g. read() on it, get takes a reference to the
+ * openfile and put drops it again; the openfile goes away when the
+ * last of these is done with it.
  */
 struct filetable {
+	struct spinlock ft_lock;
 	struct openfile *ft_openfiles[OPEN_MAX];
 };
 
@@ -109,12 +109,12 @@
 #define SYS_close        49
 #define SYS_read         50
 #define SYS_pread        51
-//#define SYS_readv      52
+#define SYS_readv        52
 //#define SYS_preadv     53
 #define SYS_getdirentry  54
 #define SYS_write        55
 #define SYS_pwrite       56
-//#define SYS_writev     57
+#define SYS_writev       57
 //#define SYS_pwritev    58
 #define SYS_lseek        59
 #define SYS_flock        60
@@ -197,6 +197,18 @@
 #define SYS_reboot       119
 //#define SYS___sysctl   120
 
+//                              -- OS/161 extensions --
+#define SYS_futex_wait   121
+#define SYS_futex_wake   122
+#define SYS___thread_create 123
+#define SYS_thread_exit  124
+#define SYS_thread_join  125
+#define SYS_gettid       126
+#define SYS_copy_file_range 127
+#define SYS_spawnv       128
+#define SYS_sysring_enter 129
+#define SYS_msync        130
+
 /*CALLEND*/
 
 
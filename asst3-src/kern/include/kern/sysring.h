@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _KERN_SYSRING_H_
+#define _KERN_SYSRING_H_
+
+/*
+ * Batched system calls.
+ *
+ * A sysring is a ring of system call requests in the process's own
+ * memory. User code fills in entries at sr_tail and advances it; one
+ * sysring_enter() call then runs everything from sr_head up to
+ * sr_tail, in order, writing each result back into its entry and
+ * advancing sr_head past it. An entry can be reused once sr_head has
+ * gone past it.
+ *
+ * Only calls that make sense without the trapframe can be batched:
+ * open, read, write, close, fstat, and dup2. Anything else completes
+ * with ENOSYS.
+ */
+
+struct sysring_entry {
+	int sre_callno;		/* SYS_open, SYS_read, ... */
+	int sre_flags;		/* SYSRING_* */
+	int sre_args[3];	/* arguments, as for the call itself */
+	int sre_retval;		/* result, if sre_errno is 0 */
+	int sre_errno;		/* error code, or 0 on success */
+};
+
+/*
+ * Use the file handle from the last open or dup2 in the same batch as
+ * sre_args[0], so open/read/close can be queued together.
+ */
+#define SYSRING_LASTFD		0x1
+
+struct sysring {
+	unsigned sr_head;	/* next entry to run; advanced by the kernel */
+	unsigned sr_tail;	/* next entry to fill; advanced by user code */
+	unsigned sr_size;	/* number of entries; must be a power of 2 */
+	unsigned sr_pad;
+	/* followed by sr_size struct sysring_entry */
+};
+
+/* Entry I of ring R. */
+#define SYSRING_ENTRY(r, i) \
+	(&((struct sysring_entry *)((struct sysring *)(r) + 1)) \
+		[(i) & ((r)->sr_size - 1)])
+
+/* Largest ring allowed. */
+#define SYSRING_MAXSIZE		1024
+
+
+#endif /* _KERN_SYSRING_H_ */
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _KERN_TRACE_H_
+#define _KERN_TRACE_H_
+
+/*
+ * Kernel event trace records.
+ *
+ * With "options trace" the kernel logs events into a small ring per
+ * cpu. Reading the trace: device (or the "trace file" menu command)
+ * drains the rings as a stream of these records, in the kernel's
+ * byte order; tracedump decodes them.
+ *
+ * Records come out grouped by cpu, oldest first within each cpu, so
+ * sort by time to see them interleaved.
+ */
+
+struct trace_record {
+	uint32_t tr_sec;	/* when (gettime) */
+	uint32_t tr_nsec;
+	uint16_t tr_event;	/* TRACE_* */
+	uint8_t tr_cpu;		/* cpu number */
+	uint8_t tr_pad;
+	uint32_t tr_thread;	/* kernel address of the thread */
+	uint32_t tr_args[2];	/* depends on tr_event */
+};
+
+/*
+ * Events, and what goes in tr_args. tracedump knows these names, so
+ * keep it in step.
+ */
+#define TRACE_LOST	0	/* cpu's ring was full: records dropped */
+#define TRACE_SWITCH	1	/* thread switch: next thread, old thread's new state */
+#define TRACE_SYSCALL	2	/* system call: call number */
+#define TRACE_VMFAULT	3	/* vm_fault: fault type, address */
+#define TRACE_SFSREAD	4	/* sfs block read: block number */
+#define TRACE_SFSWRITE	5	/* sfs block write: block number */
+#define TRACE_NEVENTS	6
+
+
+#endif /* _KERN_TRACE_H_ */
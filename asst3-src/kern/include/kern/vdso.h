@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _KERN_VDSO_H_
+#define _KERN_VDSO_H_
+
+/*
+ * The vdso: two read-only pages the kernel maps into every user
+ * address space at a fixed address, so that getpid() and time()
+ * don't have to trap. (__time itself still traps, for the
+ * nanoseconds and so it can check its pointers.)
+ *
+ * The time page is the same physical page everywhere; CPU 0 updates
+ * it on every hardclock, so the time read from it only has clock
+ * tick resolution. The kernel bumps vt_seq before and after each
+ * update, so it's odd while an update is in progress; readers take
+ * a copy and retry if vt_seq was odd or changed underneath them.
+ *
+ * The process page belongs to the address space and holds things
+ * that only change at fork and exec.
+ */
+
+#define VDSO_BASE	0x7fc00000
+#define VDSO_TIME	VDSO_BASE		/* struct vdso_time */
+#define VDSO_PROC	(VDSO_BASE + 4096)	/* struct vdso_proc */
+#define VDSO_SIZE	(2 * 4096)
+
+struct vdso_time {
+	volatile unsigned vt_seq;	/* update count; odd while updating */
+	unsigned vt_pad;
+	volatile __time_t vt_sec;	/* time of the last clock tick */
+	volatile unsigned long vt_nsec;
+};
+
+struct vdso_proc {
+	__pid_t vp_pid;			/* our process id */
+};
+
+
+#endif /* _KERN_VDSO_H_ */
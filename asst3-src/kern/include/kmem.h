@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _KMEM_H_
+#define _KMEM_H_
+
+/*
+ * Object caches (slab allocator).
+ *
+ * A kmem_cache hands out objects of one fixed size, carved out of
+ * whole pages, so they don't get rounded up to the next kmalloc
+ * size. If the cache has a constructor, each object is constructed
+ * once when its page is set up and destructed only when the page is
+ * given back; in between, objects go back into the cache still in
+ * their constructed state, so things like locks and CVs embedded in
+ * or hung off them are reused rather than made again every time.
+ * Code that frees an object to its cache must therefore leave it in
+ * the state the constructor produced (locks unheld, arrays empty,
+ * and so on).
+ *
+ * Functions:
+ *    kmem_cache_create  - make a cache of SIZE-byte objects. CTOR, if
+ *                         not NULL, returns 0 or an error code; DTOR,
+ *                         if not NULL, undoes CTOR. Objects must fit
+ *                         several to a page. Returns NULL if out of
+ *                         memory.
+ *    kmem_cache_destroy - destroy a cache that has no objects out.
+ *    kmem_cache_alloc   - get an object, or NULL if out of memory.
+ *    kmem_cache_free    - give an object back.
+ *    kmem_cache_printstats - print space usage of all caches (for kh).
+ */
+
+struct kmem_cache;	/* Opaque. */
+
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+				     int (*ctor)(void *obj),
+				     void (*dtor)(void *obj));
+void kmem_cache_destroy(struct kmem_cache *kc);
+void *kmem_cache_alloc(struct kmem_cache *kc);
+void kmem_cache_free(struct kmem_cache *kc, void *obj);
+void kmem_cache_printstats(void);
+
+
+#endif /* _KMEM_H_ */
@@ -123,11 +123,15 @@ uint32_t random(void);
  * Kernel heap memory allocation. Like malloc/free.
  * If out of memory, kmalloc returns NULL.
  *
+ * kheap_bootstrap checks the size tables, sizes the heap page table
+ * from ram_getsize(), and turns on the per-cpu magazines once curcpu
+ * works.
  * kheap_nextgeneration, dump, and dumpall do nothing unless heap
  * labeling (for leak detection) in kmalloc.c (q.v.) is enabled.
  */
 void *kmalloc(size_t size);
 void kfree(void *ptr);
+void kheap_bootstrap(void);
 void kheap_printstats(void);
 void kheap_nextgeneration(void);
 void kheap_dump(void);
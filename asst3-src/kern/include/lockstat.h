@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics. Enable with "options lockstat" in the
+ * kernel config, then turn collection on from the kernel menu.
+ *
+ * Each spinlock, ticket lock, sleep lock, and wait channel carries a
+ * struct lockstat. While collection is on, every acquisition is
+ * counted, and contended acquisitions also record how many times the
+ * acquirer went around its wait loop (spins for spinlocks, sleeps for
+ * sleep locks) and how long it waited. The time from acquire to
+ * release is tracked to find the longest hold. Times come from
+ * gettime(), which is why collection can't be on during early boot.
+ *
+ * A lock registers itself in a global list the first time it's
+ * counted, and leaves it when cleaned up, so the menu can find the
+ * worst offenders.
+ *
+ * When the option is off all of this compiles away to nothing; when
+ * it is on but collection is off, each lock operation costs one test
+ * of lockstat_enabled.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+#include <kern/time.h>	/* for struct timespec */
+
+struct lockstat {
+	const char *ls_name;		/* Lock name (not a copy). */
+	unsigned ls_acquires;		/* Times acquired. */
+	unsigned ls_contended;		/* Times acquired after waiting. */
+	uint64_t ls_spins;		/* Wait loop iterations. */
+	uint64_t ls_waitnsecs;		/* Total time spent waiting. */
+	uint32_t ls_maxholdnsecs;	/* Longest hold. */
+	struct timespec ls_holdstart;	/* When the current hold began. */
+	bool ls_registered;		/* On the global list? */
+	struct lockstat *ls_next;	/* Global list (lockstat.c). */
+	struct lockstat *ls_prev;
+};
+
+/* Per-acquire scratch space for the acquiring CPU or thread. */
+struct lockstat_waiter {
+	unsigned w_spins;
+	struct timespec w_start;
+};
+
+extern volatile bool lockstat_enabled;
+
+void lockstat_init(struct lockstat *ls, const char *name);
+void lockstat_cleanup(struct lockstat *ls);
+void lockstat_wait(struct lockstat *ls, struct lockstat_waiter *w);
+void lockstat_acquired(struct lockstat *ls, struct lockstat_waiter *w);
+void lockstat_released(struct lockstat *ls);
+
+/* Menu support. */
+void lockstat_enable(bool on);
+void lockstat_print(unsigned num);
+void lockstat_reset(void);
+
+#define LOCKSTAT(sym)		struct lockstat sym
+#define LOCKSTAT_WAITER(sym)	struct lockstat_waiter sym = { 0, { 0, 0 } }
+
+/* Note the trailing comma; this goes in the middle of other initializers. */
+#define LOCKSTAT_INITIALIZER(n)	{ .ls_name = n },
+
+#define LOCKSTAT_INIT(ls, n)	lockstat_init(ls, n)
+#define LOCKSTAT_CLEANUP(ls)	lockstat_cleanup(ls)
+
+#define LOCKSTAT_WAIT(ls, w) \
+	(lockstat_enabled ? lockstat_wait(ls, w) : (void)0)
+#define LOCKSTAT_ACQUIRED(ls, w) \
+	(lockstat_enabled ? lockstat_acquired(ls, w) : (void)0)
+#define LOCKSTAT_RELEASED(ls) \
+	(lockstat_enabled ? lockstat_released(ls) : (void)0)
+
+#else
+
+#define LOCKSTAT(sym)
+#define LOCKSTAT_WAITER(sym)
+
+#define LOCKSTAT_INITIALIZER(n)
+
+#define LOCKSTAT_INIT(ls, n)
+#define LOCKSTAT_CLEANUP(ls)
+
+#define LOCKSTAT_WAIT(ls, w)
+#define LOCKSTAT_ACQUIRED(ls, w)
+#define LOCKSTAT_RELEASED(ls)
+
+#endif
+
+#endif /* _LOCKSTAT_H_ */
@@ -59,6 +59,12 @@ struct openfile {
 	int of_refcount;
 };
 
+/* set up the openfile object cache; call once during boot */
+void openfile_bootstrap(void);
+
+/* wrap a vnode we already have a reference to, e.g. from pipe_create */
+struct openfile *openfile_create(struct vnode *vn, int accmode);
+
 /* open a file (args must be kernel pointers; destroys filename) */
 int openfile_open(char *filename, int openflags, mode_t mode,
 		  struct openfile **ret);
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _PAGECACHE_H_
+#define _PAGECACHE_H_
+
+/*
+ * Per-vnode cache of read-only file pages.
+ *
+ * This lets every process running the same program map the same
+ * frames for its text instead of loading a private copy. A cached
+ * page is identified by the file offset it starts at and how many
+ * bytes of file data it holds (the rest is zeros), so pages at the
+ * end of a segment match only other loads of the same segment.
+ *
+ * The cache holds one reference (see ref_kpage) to each of its
+ * pages; every mapping of a page holds another. Whenever the file is
+ * opened for writing, the cache is emptied, and nothing is cached
+ * again until the last such open is closed, so nobody picks up stale
+ * contents. Processes that already have the old pages keep them.
+ *
+ * Functions:
+ *    pagecache_init     - set up the cache in a new vnode.
+ *    pagecache_cleanup  - drop all the cache's pages when the vnode
+ *                         is reclaimed.
+ *    pagecache_get      - get a page with the file contents at OFFSET
+ *                         for LEN bytes, from the cache if it's there
+ *                         and otherwise by reading it in (and caching
+ *                         it if we can). Hands back a page the caller
+ *                         owns one reference to.
+ *    pagecache_startwrite - note a new open for writing.
+ *    pagecache_endwrite - note that one has been closed.
+ */
+
+#include <spinlock.h>
+
+struct vnode;
+struct pcpage;		/* private to pagecache.c */
+
+struct pagecache {
+	struct spinlock pc_lock;	/* lock for the fields below */
+	struct pcpage *pc_pages;	/* cached pages */
+	unsigned pc_writers;		/* opens for writing */
+	unsigned pc_generation;		/* bumped when writing starts */
+};
+
+void pagecache_init(struct pagecache *pc);
+void pagecache_cleanup(struct pagecache *pc);
+int pagecache_get(struct vnode *vn, off_t offset, size_t len, vaddr_t *ret);
+void pagecache_startwrite(struct vnode *vn);
+void pagecache_endwrite(struct vnode *vn);
+
+
+#endif /* _PAGECACHE_H_ */
@@ -48,6 +48,11 @@ void pid_bootstrap(void);
  */
 int pid_alloc(pid_t *retval);
 
+/*
+ * Get an id for a new user thread in the current process.
+ */
+int pid_alloc_thread(pid_t *retval);
+
 /*
  * Undo pid_alloc (may blow up if the target has ever run)
  */
@@ -59,10 +64,10 @@ void pid_unalloc(pid_t targetpid);
 void pid_disown(pid_t targetpid);
 
 /*
- * Set the exit status of the current thread to status.  Wakes up any threads
- * waiting to read this status, and decrefs the current thread's pid.
+ * Set the exit status of process or thread PID to status.  Wakes up any
+ * threads waiting to read this status, and decrefs the pid.
  */
-void pid_setexitstatus(int status);
+void pid_setexitstatus(pid_t pid, int status);
 
 /*
  * Causes the current thread to wait for the thread with pid PID to
@@ -70,5 +75,11 @@ void pid_setexitstatus(int status);
  */
 int pid_wait(pid_t targetpid, int *status, int flags, pid_t *retpid);
 
+/*
+ * Causes the current thread to wait for another thread in the same
+ * process to exit, returning its exit status.
+ */
+int pid_join(pid_t tid, int *status);
+
 
 #endif /* _PID_H_ */
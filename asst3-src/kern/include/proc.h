@@ -45,8 +45,8 @@ struct vnode;
 /*
  * Process structure.
  *
- * Note that unless you implement multithreaded processes, p_threads
- * will only contain one thread for all processes other than kproc.
+ * User processes can have more than one thread (see thread_create);
+ * the process goes away when the last of them exits.
  *
  * Note: you can't protect p_threads with a spinlock because it needs
  * to be able to call kmalloc.
@@ -57,6 +57,7 @@ struct proc {
 	struct threadarray p_threads;	/* Threads in this process */
 	struct spinlock p_lock;		/* Lock for rest of this structure */
 	pid_t p_pid;			/* Process ID */
+	int p_exitstatus;		/* Status from the last _exit */
 
 	/* VM */
 	struct addrspace *p_addrspace;	/* virtual address space */
@@ -80,7 +81,10 @@ int proc_create_runprogram(const char *name, struct proc **ret);
 /* Create a fresh process for use by fork() */
 int proc_fork(struct proc **ret);
 
-/* Undo proc_fork if nothing's run in the new process yet. */
+/* Same, but with no address space, for use by spawn() */
+int proc_spawn(struct proc **ret);
+
+/* Undo proc_fork or proc_spawn if nothing's run in the new process yet. */
 void proc_unfork(struct proc *proc);
 
 /* Destroy a process. */
@@ -88,18 +92,26 @@ void proc_destroy(struct proc *proc);
 
 /*
  * Cause the current process to exit. The current thread switches
- * itself into the kernel process.
+ * itself into the kernel process. If the process has other threads
+ * they keep running, and the process actually exits (with this
+ * status, unless another _exit comes along) when the last one does.
  *
  * The status code should be prepared with one of the _MKWAIT macros
  * defined in <kern/wait.h>.
  */
 void proc_exit(int status);
 
+/*
+ * Cause the current thread to leave its process, with STATUS as its
+ * exit status for pid_join. Does not change the process's exit status.
+ */
+void proc_thread_exit(int status);
+
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
 
-/* Detach a thread from its process. */
-void proc_remthread(struct thread *t);
+/* Detach a thread from its process. Returns the number of threads left. */
+unsigned proc_remthread(struct thread *t);
 
 /* Fetch the address space of the current process. */
 struct addrspace *proc_getas(void);
@@ -37,6 +37,7 @@
 
 #include <cdefs.h>
 #include <hangman.h>
+#include <lockstat.h>
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -58,23 +59,31 @@
 struct spinlock {
 	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
 	struct cpu *splk_holder;	    /* CPU holding this lock. */
+	LOCKSTAT(splk_stat);		    /* Contention statistics. */
 	HANGMAN_LOCKABLE(splk_hangman);     /* Deadlock detector hook. */
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
+ * NAME is a string that lockstat reports the lock under.
  */
 #ifdef OPT_HANGMAN
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, \
+#define SPINLOCK_INITIALIZER(name) \
+				{ SPINLOCK_DATA_INITIALIZER, NULL, \
+				  LOCKSTAT_INITIALIZER(name) \
 				  HANGMAN_LOCKABLE_INITIALIZER }
 #else
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#define SPINLOCK_INITIALIZER(name) \
+				{ SPINLOCK_DATA_INITIALIZER, NULL, \
+				  LOCKSTAT_INITIALIZER(name) }
 #endif
 
 /*
  * Spinlock functions.
  *
- * init		Initialize the contents of a spinlock.
+ * init		Initialize the contents of a spinlock. This is a macro
+ *		that names the lock for lockstat after the expression
+ *		passed in; use init_named to give a name directly.
  * cleanup	Opposite of init. Lock must be unlocked.
  *
  * acquire	Get the lock, spinning as necessary. Also disables interrupts.
@@ -83,7 +92,8 @@ struct spinlock {
  * do_i_hold	Check if the current CPU holds the lock.
  */
 
-void spinlock_init(struct spinlock *lk);
+void spinlock_init_named(struct spinlock *lk, const char *name);
+#define spinlock_init(lk) spinlock_init_named(lk, #lk)
 void spinlock_cleanup(struct spinlock *lk);
 
 void spinlock_acquire(struct spinlock *lk);
@@ -51,8 +51,8 @@ void enter_forked_process(struct trapframe *tf);
 __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 		       vaddr_t stackptr, vaddr_t entrypoint);
 
-/* Setup function for exec. */
-void exec_bootstrap(void);
+/* Setup function for futexes. */
+void futex_bootstrap(void);
 
 
 /*
@@ -67,15 +67,38 @@ int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
 
 int sys_fork(struct trapframe *tf, pid_t *retval);
 int sys_execv(userptr_t prog, userptr_t args);
+int sys_spawnv(userptr_t prog, userptr_t args, userptr_t acts, int nacts,
+	       pid_t *retval);
 __DEAD void sys__exit(int code);
 int sys_waitpid(pid_t pid, userptr_t returncode, int flags, pid_t *retval);
 int sys_getpid(pid_t *retval);
+int sys_thread_create(userptr_t entry, userptr_t arg0, userptr_t arg1,
+		      pid_t *retval);
+__DEAD void sys_thread_exit(int code);
+int sys_thread_join(pid_t tid, userptr_t retstatus);
+int sys_gettid(pid_t *retval);
+
+int sys_futex_wait(userptr_t addr, int val);
+int sys_futex_wake(userptr_t addr, int n, int *retval);
+
+int sys_mmap(size_t len, int prot, int fd, off_t offset, int *retval);
+int sys_munmap(userptr_t addr);
+int sys_msync(userptr_t addr);
 
 int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval);
 int sys_dup2(int oldfd, int newfd, int *retval);
+int sys_pipe(userptr_t fds);
+int sys_poll(userptr_t fds, unsigned nfds, int timeout, int *retval);
+int sys_sysring_enter(userptr_t ringptr, int *retval);
 int sys_close(int fd);
 int sys_read(int fd, userptr_t buf, size_t size, int *retval);
 int sys_write(int fd, userptr_t buf, size_t size, int *retval);
+int sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_copy_file_range(int infd, userptr_t inposp, int outfd, userptr_t outposp,
+			size_t len, unsigned flags, int *retval);
 int sys_lseek(int fd, off_t offset, int code, off_t *retval);
 
 int sys_chdir(const_userptr_t path);
@@ -106,6 +106,15 @@ struct thread {
 	 * Public fields
 	 */
 
+	/*
+	 * User thread fields. The first thread in a process has no id
+	 * of its own (it goes by the process's pid) and runs on the
+	 * stack from as_define_stack; threads made with thread_create
+	 * have both.
+	 */
+	pid_t t_tid;			/* Thread id, or INVALID_PID */
+	vaddr_t t_ustack;		/* User stack slot, or 0 */
+
 	/* add more here as needed */
 };
 
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _TICKETLOCK_H_
+#define _TICKETLOCK_H_
+
+/*
+ * Ticket spinlocks.
+ *
+ * A ticket lock behaves like a spinlock (it is held by a CPU, it
+ * disables interrupts, and it must not be held across anything that
+ * sleeps) but waiters are served in the order they arrived. Each
+ * acquirer takes a ticket with an atomic fetch-and-add on tkl_next
+ * and then waits until tkl_owner reaches its ticket. Because the
+ * waiters only ever *read* tkl_owner while spinning, and the holder
+ * writes it exactly once per release, the cache line is not bounced
+ * around by test-and-set attempts the way it is with a plain
+ * spinlock under contention.
+ *
+ * Use these for locks that many CPUs hammer at once and where no
+ * one should starve. Ordinary spinlocks are still cheaper when the
+ * lock is rarely contended, and wchans still want a struct spinlock.
+ */
+
+#include <cdefs.h>
+#include <hangman.h>
+#include <spinlock.h>	/* for spinlock_data_t and its operations */
+
+struct ticketlock {
+	volatile spinlock_data_t tkl_next;  /* Next ticket to hand out. */
+	volatile spinlock_data_t tkl_owner; /* Ticket now being served. */
+	struct cpu *tkl_holder;		    /* CPU holding this lock. */
+	LOCKSTAT(tkl_stat);		    /* Contention statistics. */
+	HANGMAN_LOCKABLE(tkl_hangman);	    /* Deadlock detector hook. */
+};
+
+/*
+ * Initializer for cases where a ticket lock needs to be static or
+ * global.
+ */
+#ifdef OPT_HANGMAN
+#define TICKETLOCK_INITIALIZER(name) \
+				{ SPINLOCK_DATA_INITIALIZER, \
+				  SPINLOCK_DATA_INITIALIZER, NULL, \
+				  LOCKSTAT_INITIALIZER(name) \
+				  HANGMAN_LOCKABLE_INITIALIZER }
+#else
+#define TICKETLOCK_INITIALIZER(name) \
+				{ SPINLOCK_DATA_INITIALIZER, \
+				  SPINLOCK_DATA_INITIALIZER, NULL, \
+				  LOCKSTAT_INITIALIZER(name) }
+#endif
+
+/*
+ * Ticket lock functions. These are the same as the spinlock ones.
+ *
+ * init		Initialize the contents of a ticket lock.
+ * cleanup	Opposite of init. Lock must be unlocked.
+ *
+ * acquire	Get the lock, spinning in FIFO order. Disables interrupts.
+ * release	Release the lock. May re-enable interrupts.
+ *
+ * do_i_hold	Check if the current CPU holds the lock.
+ */
+
+void ticketlock_init_named(struct ticketlock *tkl, const char *name);
+#define ticketlock_init(tkl) ticketlock_init_named(tkl, #tkl)
+void ticketlock_cleanup(struct ticketlock *tkl);
+
+void ticketlock_acquire(struct ticketlock *tkl);
+void ticketlock_release(struct ticketlock *tkl);
+
+bool ticketlock_do_i_hold(struct ticketlock *tkl);
+
+
+#endif /* _TICKETLOCK_H_ */
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/*
+ * Kernel event tracing. Enable with "options trace" in the kernel
+ * config, then turn it on from the kernel menu.
+ *
+ * Each cpu logs into its own ring of struct trace_record (see
+ * <kern/trace.h>) with interrupts off, so logging never takes a
+ * lock, never sleeps, and never waits for the console. If the ring
+ * is full the record is dropped and counted instead; the next drain
+ * reports how many went missing with a TRACE_LOST record.
+ *
+ * Draining (reading trace: or the menu's "trace file") can happen on
+ * any cpu while the rings are being written; each ring has a single
+ * writer and drains are serialized, so head and tail plus memory
+ * barriers are enough.
+ *
+ * When the option is off TRACE() compiles away to nothing; when it is
+ * on but tracing is off, each TRACE() costs one test of trace_enabled.
+ */
+
+#include "opt-trace.h"
+
+#if OPT_TRACE
+
+#include <kern/trace.h>
+
+extern volatile bool trace_enabled;
+
+void trace_bootstrap(void);
+void trace_cpuinit(unsigned cpunum);
+void trace_log(unsigned event, uint32_t arg0, uint32_t arg1);
+
+/* Menu support. */
+void trace_enable(bool on);
+void trace_print(void);
+int trace_dump(char *path);
+
+#define TRACE(ev, a0, a1) \
+	(trace_enabled ? trace_log(ev, a0, a1) : (void)0)
+#define TRACE_CPUINIT(num)	trace_cpuinit(num)
+
+#else
+
+#define trace_bootstrap()
+#define TRACE(ev, a0, a1)
+#define TRACE_CPUINIT(num)
+
+#endif
+
+#endif /* _TRACE_H_ */
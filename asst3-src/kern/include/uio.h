@@ -144,5 +144,12 @@ void uio_kinit(struct iovec *, struct uio *,
 void uio_uinit(struct iovec *, struct uio *,
 	       userptr_t ubuf, size_t len, off_t pos, enum uio_rw rw);
 
+/*
+ * The same, for an array of IOVCNT iovecs (already in the kernel) that
+ * point to user buffers, as in readv/writev. LEN is their total length.
+ */
+void uio_uinitv(struct iovec *, unsigned iovcnt, struct uio *,
+		size_t len, off_t pos, enum uio_rw rw);
+
 
 #endif /* _UIO_H_ */
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _VDSO_H_
+#define _VDSO_H_
+
+/*
+ * Kernel side of the vdso pages; see <kern/vdso.h> for the layout.
+ *
+ *    vdso_bootstrap - allocate the shared time page. Call once the VM
+ *                     system is up.
+ *
+ *    vdso_tick      - update the time page; called from hardclock.
+ *
+ *    vdso_as_init   - set up the process page for a new address space.
+ *    vdso_as_cleanup - release it again.
+ *
+ *    vdso_setpid    - record the pid of the process that owns an
+ *                     address space. Called at fork and exec.
+ *
+ *    vdso_fault     - handle a TLB miss on the vdso pages by loading
+ *                     a read-only mapping.
+ */
+
+#include <kern/vdso.h>
+
+struct addrspace;
+
+void vdso_bootstrap(void);
+void vdso_tick(void);
+int vdso_as_init(struct addrspace *as);
+void vdso_as_cleanup(struct addrspace *as);
+void vdso_setpid(struct addrspace *as, pid_t pid);
+int vdso_fault(struct addrspace *as, int faulttype, vaddr_t faultaddress);
+
+/* True if VADDR is in one of the vdso pages. */
+#define VDSO_CONTAINS(vaddr) \
+	((vaddr) >= VDSO_BASE && (vaddr) < VDSO_BASE + VDSO_SIZE)
+
+
+#endif /* _VDSO_H_ */
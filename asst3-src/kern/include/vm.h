@@ -55,8 +55,31 @@ int vm_fault(int faulttype, vaddr_t faultaddress);
 vaddr_t alloc_kpages(unsigned npages);
 void free_kpages(vaddr_t addr);
 
+/*
+ * Allocate a single zero-filled page. Idle CPUs keep a pool of these
+ * topped up by calling vm_idle_zero, which zeroes one page and
+ * returns true, or returns false if the pool doesn't need any more.
+ */
+vaddr_t alloc_zeroed_kpage(void);
+bool vm_idle_zero(void);
+
+/*
+ * Take another reference to a single page from alloc_kpages(1), so it
+ * can be shared. Each free_kpages drops one reference; the page is
+ * freed when the last one goes.
+ */
+void ref_kpage(vaddr_t addr);
+
 /* TLB shootdown handling called from interprocessor_interrupt */
 void vm_tlbshootdown(const struct tlbshootdown *);
 
+/*
+ * Drop the TLB entries for user pages START up to END on every cpu,
+ * and wait until they're gone. Call after changing or removing page
+ * table entries and before reusing the frames they pointed at, with
+ * no spinlocks held.
+ */
+void vm_tlbinvalidate(vaddr_t start, vaddr_t end);
+
 
 #endif /* _VM_H_ */
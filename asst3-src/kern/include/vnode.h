@@ -31,6 +31,7 @@
 #define _VNODE_H_
 
 #include <spinlock.h>
+#include <pagecache.h>
 struct uio;
 struct stat;
 
@@ -57,6 +58,8 @@ struct vnode {
 	void *vn_data;                  /* Filesystem-specific data */
 
 	const struct vnode_ops *vn_ops; /* Functions on this vnode */
+
+	struct pagecache vn_pagecache;  /* Shared read-only pages */
 };
 
 /*
@@ -117,12 +120,22 @@ struct vnode {
  *                      and directories are seekable, but some devices are
  *                      not.
  *
+ *    vop_poll        - Check which of EVENTS (POLLIN, POLLOUT, etc. from
+ *                      kern/poll.h) could be done right now without
+ *                      blocking, and hand back that set plus any of
+ *                      POLLERR or POLLHUP that apply. Must not sleep
+ *                      waiting for anything. Objects that can change from
+ *                      not ready to ready must call poll_wakeup() when
+ *                      they do.
+ *
  *    vop_fsync       - Force any dirty buffers associated with this file
  *                      to stable storage.
  *
- *    vop_mmap        - Map file into memory. If you implement this
- *                      feature, you're responsible for choosing the
- *                      arguments for this operation.
+ *    vop_mmap        - Check that the file can be mapped into memory.
+ *                      The VM system reads the mapped pages in and
+ *                      writes them back with vop_read and vop_write,
+ *                      so a file system that can do those for regular
+ *                      files just returns 0.
  *
  *    vop_truncate    - Forcibly set size of file to the length passed
  *                      in, discarding any excess blocks.
@@ -192,6 +205,7 @@ struct vnode_ops {
 	int (*vop_stat)(struct vnode *object, struct stat *statbuf);
 	int (*vop_gettype)(struct vnode *object, mode_t *result);
 	bool (*vop_isseekable)(struct vnode *object);
+	int (*vop_poll)(struct vnode *object, int events, int *revents);
 	int (*vop_fsync)(struct vnode *object);
 	int (*vop_mmap)(struct vnode *file /* add stuff */);
 	int (*vop_truncate)(struct vnode *file, off_t len);
@@ -236,6 +250,7 @@ struct vnode_ops {
 #define VOP_STAT(vn, ptr) 	        (__VOP(vn, stat)(vn, ptr))
 #define VOP_GETTYPE(vn, result)         (__VOP(vn, gettype)(vn, result))
 #define VOP_ISSEEKABLE(vn)              (__VOP(vn, isseekable)(vn))
+#define VOP_POLL(vn, events, res)       (__VOP(vn, poll)(vn, events, res))
 #define VOP_FSYNC(vn)                   (__VOP(vn, fsync)(vn))
 #define VOP_MMAP(vn /*add stuff */)     (__VOP(vn, mmap)(vn /*add stuff */))
 #define VOP_TRUNCATE(vn, pos)           (__VOP(vn, truncate)(vn, pos))
@@ -279,6 +294,12 @@ int vnode_init(struct vnode *, const struct vnode_ops *ops,
  */
 void vnode_cleanup(struct vnode *);
 
+/*
+ * VOP_POLL for objects whose I/O never has to wait, such as regular
+ * files and directories: always ready for whatever was asked.
+ */
+int vnode_poll_ready(struct vnode *vn, int events, int *revents);
+
 /*
  * Common stubs for vnode functions that just fail, in various ways.
  */
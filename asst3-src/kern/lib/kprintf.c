@@ -36,6 +36,7 @@
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <ticketlock.h>
 #include <mainbus.h>
 #include <vfs.h>          // for vfs_sync()
 #include <lamebus/ltrace.h> // for ltrace_stop()
@@ -47,8 +48,8 @@ uint32_t dbflags = 0;
 /* Lock for non-polled kprintfs */
 static struct lock *kprintf_lock;
 
-/* Lock for polled kprintfs */
-static struct spinlock kprintf_spinlock;
+/* Lock for polled kprintfs (FIFO, so no CPU's output starves) */
+static struct ticketlock kprintf_spinlock;
 
 
 /*
@@ -70,7 +71,7 @@ kprintf_bootstrap(void)
 	if (kprintf_lock == NULL) {
 		panic("Could not create kprintf_lock\n");
 	}
-	spinlock_init(&kprintf_spinlock);
+	ticketlock_init(&kprintf_spinlock);
 }
 
 /*
@@ -108,7 +109,7 @@ kprintf(const char *fmt, ...)
 		lock_acquire(kprintf_lock);
 	}
 	else {
-		spinlock_acquire(&kprintf_spinlock);
+		ticketlock_acquire(&kprintf_spinlock);
 	}
 
 	va_start(ap, fmt);
@@ -119,7 +120,7 @@ kprintf(const char *fmt, ...)
 		lock_release(kprintf_lock);
 	}
 	else {
-		spinlock_release(&kprintf_spinlock);
+		ticketlock_release(&kprintf_spinlock);
 	}
 
 	return chars;
@@ -47,9 +47,13 @@
 #include <vfs.h>
 #include <device.h>
 #include <pid.h>
+#include <poll.h>
+#include <openfile.h>
+#include <vdso.h>
 #include <syscall.h>
 #include <test.h>
 #include <version.h>
+#include <trace.h>
 #include "autoconf.h"  // for pseudoconfig
 
 
@@ -111,9 +115,13 @@ boot(void)
 	ram_bootstrap();
 	proc_bootstrap();
 	thread_bootstrap();
+	kheap_bootstrap();
 	pid_bootstrap();
 	hardclock_bootstrap();
+	poll_bootstrap();
+	openfile_bootstrap();
 	vfs_bootstrap();
+	trace_bootstrap();
 	kheap_nextgeneration();
 
 	/* Probe and initialize devices. Interrupts should come on. */
@@ -128,8 +136,9 @@ boot(void)
 
 	/* Late phase of initialization. */
 	vm_bootstrap();
+	vdso_bootstrap();
 	kprintf_bootstrap();
-	exec_bootstrap();
+	futex_bootstrap();
 	thread_start_cpus();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
@@ -43,10 +43,20 @@
 #include <vfs.h>
 #include <sfs.h>
 #include <pid.h>
+#include <kmem.h>
 #include <syscall.h>
 #include <test.h>
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-lockstat.h"
+#include "opt-trace.h"
+
+#if OPT_LOCKSTAT
+#include <lockstat.h>
+#endif
+#if OPT_TRACE
+#include <trace.h>
+#endif
 
 /*
  * In-kernel menu and command dispatcher.
@@ -467,6 +477,7 @@ cmd_kheapstats(int nargs, char **args)
 	(void)args;
 
 	kheap_printstats();
+	kmem_cache_printstats();
 
 	return 0;
 }
@@ -500,6 +511,89 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+#if OPT_LOCKSTAT
+
+/* Default number of locks to show. */
+#define LOCKSTAT_TOPN  10
+
+/*
+ * Command for lock contention statistics. With no argument (or a
+ * count) show the most contended locks; "on" and "off" start and
+ * stop collection; "reset" zeroes the counters.
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	int num;
+
+	if (nargs == 1) {
+		lockstat_print(LOCKSTAT_TOPN);
+		return 0;
+	}
+	if (nargs == 2) {
+		if (!strcmp(args[1], "on")) {
+			lockstat_enable(true);
+			return 0;
+		}
+		if (!strcmp(args[1], "off")) {
+			lockstat_enable(false);
+			return 0;
+		}
+		if (!strcmp(args[1], "reset")) {
+			lockstat_reset();
+			return 0;
+		}
+		num = atoi(args[1]);
+		if (num > 0) {
+			lockstat_print(num);
+			return 0;
+		}
+	}
+	kprintf("Usage: lockstat [on | off | reset | count]\n");
+	return EINVAL;
+}
+
+#endif /* OPT_LOCKSTAT */
+
+#if OPT_TRACE
+
+/*
+ * Command for the trace rings. With no argument show how full they
+ * are; "on" and "off" start and stop tracing; anything else is a file
+ * to drain the rings into (for tracedump).
+ */
+static
+int
+cmd_trace(int nargs, char **args)
+{
+	int result;
+
+	if (nargs == 1) {
+		trace_print();
+		return 0;
+	}
+	if (nargs == 2) {
+		if (!strcmp(args[1], "on")) {
+			trace_enable(true);
+			return 0;
+		}
+		if (!strcmp(args[1], "off")) {
+			trace_enable(false);
+			return 0;
+		}
+		result = trace_dump(args[1]);
+		if (result) {
+			kprintf("trace: %s: %s\n", args[1], strerror(result));
+		}
+		return result;
+	}
+	kprintf("Usage: trace [on | off | file]\n");
+	return EINVAL;
+}
+
+#endif /* OPT_TRACE */
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -566,6 +660,7 @@ static const char *testmenu[] = {
 	"[km2] kmalloc stress test           ",
 	"[km3] Large kmalloc test            ",
 	"[km4] Multipage kmalloc test        ",
+	"[km5] Multi-cpu kmalloc benchmark   ",
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
@@ -576,6 +671,7 @@ static const char *testmenu[] = {
 	"[sy2] Lock test                     ",
 	"[sy3] CV test                       ",
 	"[sy4] CV test #2                    ",
+	"[spb] Spinlock contention benchmark ",
 	"[semu1-22] Semaphore unit tests     ",
 	"[wt]  waitpid test                  ",
 	"[fs1] Filesystem test               ",
@@ -606,6 +702,12 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+#if OPT_LOCKSTAT
+	"[lockstat] Lock contention stats    ",
+#endif
+#if OPT_TRACE
+	"[trace] Kernel event trace          ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -657,6 +759,12 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+#if OPT_LOCKSTAT
+	{ "lockstat",   cmd_lockstat },
+#endif
+#if OPT_TRACE
+	{ "trace",      cmd_trace },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -667,6 +775,7 @@ static struct {
 	{ "km2",	kmallocstress },
 	{ "km3",	kmalloctest3 },
 	{ "km4",	kmalloctest4 },
+	{ "km5",	kmalloctest5 },
 #if OPT_NET
 	{ "net",	nettest },
 #endif
@@ -679,6 +788,7 @@ static struct {
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "spb",	spinbench },
 
 	/* semaphore unit tests */
 	{ "semu1",	semu1 },
@@ -37,11 +37,13 @@
 #include <limits.h>
 #include <lib.h>
 #include <array.h>
+#include <bitmap.h>
 #include <clock.h>
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
+#include <kmem.h>
 #include <pid.h>
 
 /*
@@ -50,10 +52,18 @@
  * If pi_ppid is INVALID_PID, the parent has gone away and will not be
  * waiting. If pi_ppid is INVALID_PID and pi_exited is true, the
  * structure can be freed.
+ *
+ * User threads other than the first one in a process get their ids
+ * from the same table, so that ids are unique system-wide. For these
+ * pi_isthread is set and pi_ppid is the pid of the process the thread
+ * belongs to; they can be joined by other threads in that process but
+ * not waited for with waitpid.
  */
 struct pidinfo {
 	pid_t pi_pid;			// process id of this thread
 	pid_t pi_ppid;			// process id of parent thread
+	bool pi_isthread;		// true if this is a thread id
+	bool pi_waiting;		// true if someone's waiting on us
 	volatile bool pi_exited;	// true if thread has exited
 	int pi_exitstatus;		// status (only valid if exited)
 	struct cv *pi_cv;		// use to wait for thread exit
@@ -63,17 +73,84 @@ struct pidinfo {
 /*
  * Global pid and exit data.
  *
- * The process table is an el-cheapo hash table. It's indexed by
- * (pid % PROCS_MAX), and only allows one process per slot. If a
- * new pid allocation would cause a hash collision, we just don't
- * use that pid.
+ * The process table is indexed by (pid % PROCS_MAX), and only allows
+ * one process per slot. Rather than trying successive pids until one
+ * lands in a free slot, we take a free slot from the pidslots bitmap
+ * and hand out the next pid that maps to it: each slot counts up
+ * through slot, slot+PROCS_MAX, slot+2*PROCS_MAX, ... and wraps
+ * around at PID_MAX. So allocation never loops over collisions, and a
+ * pid isn't reused until its slot has come around again.
+ *
+ * The locking is split. pidalloc_lock covers only the bitmap, the
+ * per-slot next pids, and nprocs, and is held just long enough to
+ * pick a slot. The slots themselves, and the pidinfo in them, are
+ * protected by one of PIDLOCKS sleep locks chosen by slot number,
+ * so fork, wait and exit on different processes mostly don't
+ * contend. (getpid doesn't look at the table at all.)
  */
-static struct lock *pidlock;		// lock for global exit data
-static struct pidinfo *pidinfo[PROCS_MAX]; // actual pid info
-static pid_t nextpid;			// next candidate pid
+#define PIDLOCKS 16
+
+static struct spinlock pidalloc_lock;	// lock for allocation data
+static struct bitmap *pidslots;		// which slots are in use
+static pid_t slotnextpid[PROCS_MAX];	// next pid to hand out per slot
 static int nprocs;			// number of allocated pids
 
+static struct lock *pidlocks[PIDLOCKS];	// locks for the slots
+static struct pidinfo *pidinfo[PROCS_MAX]; // actual pid info
+
+static struct kmem_cache *pidinfo_cache; // pidinfos, with pi_cv made
+
+/*
+ * Get the lock that covers PID's slot.
+ */
+static
+struct lock *
+pidlock_for(pid_t pid)
+{
+	return pidlocks[(pid % PROCS_MAX) % PIDLOCKS];
+}
+
+/*
+ * Get the first pid that maps to a slot.
+ */
+static
+pid_t
+slot_firstpid(unsigned slot)
+{
+	pid_t pid = slot;
+
+	while (pid < PID_MIN) {
+		pid += PROCS_MAX;
+	}
+	return pid;
+}
+
+
+/*
+ * Object cache constructor and destructor for pidinfo: the cv stays
+ * allocated while the pidinfo is in the cache.
+ */
+static
+int
+pidinfo_ctor(void *obj)
+{
+	struct pidinfo *pi = obj;
+
+	pi->pi_cv = cv_create("pidinfo cv");
+	if (pi->pi_cv == NULL) {
+		return ENOMEM;
+	}
+	return 0;
+}
 
+static
+void
+pidinfo_dtor(void *obj)
+{
+	struct pidinfo *pi = obj;
+
+	cv_destroy(pi->pi_cv);
+}
 
 /*
  * Create a pidinfo structure for the specified pid.
@@ -86,19 +163,15 @@ pidinfo_create(pid_t pid, pid_t ppid)
 
 	KASSERT(pid != INVALID_PID);
 
-	pi = kmalloc(sizeof(struct pidinfo));
+	pi = kmem_cache_alloc(pidinfo_cache);
 	if (pi==NULL) {
 		return NULL;
 	}
 
-	pi->pi_cv = cv_create("pidinfo cv");
-	if (pi->pi_cv == NULL) {
-		kfree(pi);
-		return NULL;
-	}
-
 	pi->pi_pid = pid;
 	pi->pi_ppid = ppid;
+	pi->pi_isthread = false;
+	pi->pi_waiting = false;
 	pi->pi_exited = false;
 	pi->pi_exitstatus = 0xbeef;  /* Recognizably invalid value */
 
@@ -114,8 +187,7 @@ pidinfo_destroy(struct pidinfo *pi)
 {
 	KASSERT(pi->pi_exited == true);
 	KASSERT(pi->pi_ppid == INVALID_PID);
-	cv_destroy(pi->pi_cv);
-	kfree(pi);
+	kmem_cache_free(pidinfo_cache, pi);
 }
 
 ////////////////////////////////////////////////////////////
@@ -126,24 +198,39 @@ pidinfo_destroy(struct pidinfo *pi)
 void
 pid_bootstrap(void)
 {
-	int i;
+	unsigned i;
 
-	pidlock = lock_create("pidlock");
-	if (pidlock == NULL) {
-		panic("Out of memory creating pid lock\n");
+	spinlock_init(&pidalloc_lock);
+
+	pidinfo_cache = kmem_cache_create("pidinfo", sizeof(struct pidinfo),
+					  pidinfo_ctor, pidinfo_dtor);
+	if (pidinfo_cache == NULL) {
+		panic("Out of memory creating pidinfo cache\n");
+	}
+
+	for (i=0; i<PIDLOCKS; i++) {
+		pidlocks[i] = lock_create("pidlock");
+		if (pidlocks[i] == NULL) {
+			panic("Out of memory creating pid locks\n");
+		}
+	}
+
+	pidslots = bitmap_create(PROCS_MAX);
+	if (pidslots == NULL) {
+		panic("Out of memory creating pid bitmap\n");
 	}
 
 	/* not really necessary - should start zeroed */
 	for (i=0; i<PROCS_MAX; i++) {
 		pidinfo[i] = NULL;
+		slotnextpid[i] = slot_firstpid(i);
 	}
 
 	pidinfo[KERNEL_PID] = pidinfo_create(KERNEL_PID, INVALID_PID);
 	if (pidinfo[KERNEL_PID]==NULL) {
 		panic("Out of memory creating kernel pid data\n");
 	}
-
-	nextpid = PID_MIN;
+	bitmap_mark(pidslots, KERNEL_PID);
 	nprocs = 1;
 }
 
@@ -158,7 +245,7 @@ pi_get(pid_t pid)
 
 	KASSERT(pid>=0);
 	KASSERT(pid != INVALID_PID);
-	KASSERT(lock_do_i_hold(pidlock));
+	KASSERT(lock_do_i_hold(pidlock_for(pid)));
 
 	pi = pidinfo[pid % PROCS_MAX];
 	if (pi==NULL) {
@@ -172,19 +259,32 @@ pi_get(pid_t pid)
 
 /*
  * pi_put: insert a new pidinfo in the process table. The right slot
- * must be empty.
+ * must be empty (and already reserved in pidslots).
  */
 static
 void
 pi_put(pid_t pid, struct pidinfo *pi)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	KASSERT(lock_do_i_hold(pidlock_for(pid)));
 
 	KASSERT(pid != INVALID_PID);
 
 	KASSERT(pidinfo[pid % PROCS_MAX] == NULL);
 	pidinfo[pid % PROCS_MAX] = pi;
-	nprocs++;
+}
+
+/*
+ * slot_release: give a slot back for reuse.
+ */
+static
+void
+slot_release(pid_t pid)
+{
+	spinlock_acquire(&pidalloc_lock);
+	KASSERT(bitmap_isset(pidslots, pid % PROCS_MAX));
+	bitmap_unmark(pidslots, pid % PROCS_MAX);
+	nprocs--;
+	spinlock_release(&pidalloc_lock);
 }
 
 /*
@@ -198,7 +298,7 @@ pi_drop(pid_t pid)
 {
 	struct pidinfo *pi;
 
-	KASSERT(lock_do_i_hold(pidlock));
+	KASSERT(lock_do_i_hold(pidlock_for(pid)));
 
 	pi = pidinfo[pid % PROCS_MAX];
 	KASSERT(pi != NULL);
@@ -206,79 +306,82 @@ pi_drop(pid_t pid)
 
 	pidinfo_destroy(pi);
 	pidinfo[pid % PROCS_MAX] = NULL;
-	nprocs--;
+	slot_release(pid);
 }
 
 ////////////////////////////////////////////////////////////
 
 /*
- * Helper function for pid_alloc.
+ * Common code for pid_alloc and pid_alloc_thread.
  */
 static
-void
-inc_nextpid(void)
-{
-	KASSERT(lock_do_i_hold(pidlock));
-
-	nextpid++;
-	if (nextpid > PID_MAX) {
-		nextpid = PID_MIN;
-	}
-}
-
-/*
- * pid_alloc: allocate a process id.
- */
 int
-pid_alloc(pid_t *retval)
+pid_doalloc(bool isthread, pid_t *retval)
 {
 	struct pidinfo *pi;
+	unsigned slot;
 	pid_t pid;
-	int count;
+	int result;
 
 	KASSERT(curproc->p_pid != INVALID_PID);
 
-	/* lock the table */
-	lock_acquire(pidlock);
+	/* pick a slot and the pid that goes with it */
+	spinlock_acquire(&pidalloc_lock);
 
 	if (nprocs == PROCS_MAX) {
-		lock_release(pidlock);
+		spinlock_release(&pidalloc_lock);
 		return EAGAIN;
 	}
 
-	/*
-	 * The above test guarantees that this loop terminates, unless
-	 * our nprocs count is off. Even so, assert we aren't looping
-	 * forever.
-	 */
-	count = 0;
-	while (pidinfo[nextpid % PROCS_MAX] != NULL) {
-
-		/* avoid various boundary cases by allowing extra loops */
-		KASSERT(count < PROCS_MAX*2+5);
-		count++;
+	/* The above test guarantees there's a free slot. */
+	result = bitmap_alloc(pidslots, &slot);
+	KASSERT(result == 0);
 
-		inc_nextpid();
+	pid = slotnextpid[slot];
+	if (pid + PROCS_MAX <= PID_MAX) {
+		slotnextpid[slot] = pid + PROCS_MAX;
+	}
+	else {
+		slotnextpid[slot] = slot_firstpid(slot);
 	}
+	nprocs++;
 
-	pid = nextpid;
+	spinlock_release(&pidalloc_lock);
 
 	pi = pidinfo_create(pid, curproc->p_pid);
 	if (pi==NULL) {
-		lock_release(pidlock);
+		slot_release(pid);
 		return ENOMEM;
 	}
+	pi->pi_isthread = isthread;
 
+	lock_acquire(pidlock_for(pid));
 	pi_put(pid, pi);
-
-	inc_nextpid();
-
-	lock_release(pidlock);
+	lock_release(pidlock_for(pid));
 
 	*retval = pid;
 	return 0;
 }
 
+/*
+ * pid_alloc: allocate a process id.
+ */
+int
+pid_alloc(pid_t *retval)
+{
+	return pid_doalloc(false, retval);
+}
+
+/*
+ * pid_alloc_thread: allocate an id for a new thread in the current
+ * process.
+ */
+int
+pid_alloc_thread(pid_t *retval)
+{
+	return pid_doalloc(true, retval);
+}
+
 /*
  * pid_unalloc - unallocate a process id (allocated with pid_alloc) that
  * hasn't run yet.
@@ -290,7 +393,7 @@ pid_unalloc(pid_t theirpid)
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	lock_acquire(pidlock_for(theirpid));
 
 	them = pi_get(theirpid);
 	KASSERT(them != NULL);
@@ -304,7 +407,7 @@ pid_unalloc(pid_t theirpid)
 
 	pi_drop(theirpid);
 
-	lock_release(pidlock);
+	lock_release(pidlock_for(theirpid));
 }
 
 /*
@@ -318,7 +421,7 @@ pid_disown(pid_t theirpid)
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	lock_acquire(pidlock_for(theirpid));
 
 	them = pi_get(theirpid);
 	KASSERT(them != NULL);
@@ -329,117 +432,120 @@ pid_disown(pid_t theirpid)
 		pi_drop(them->pi_pid);
 	}
 
-	lock_release(pidlock);
+	lock_release(pidlock_for(theirpid));
 }
 
 /*
- * pid_setexitstatus: Sets the exit status of this process. Must only
- * be called if the thread actually had a pid assigned. Wakes up any
- * waiters and disposes of the piddata if nobody else is still using it.
+ * pid_setexitstatus: Sets the exit status of process or thread PID.
+ * Wakes up any waiters and disposes of the piddata if nobody else is
+ * still using it.
  *
- * As far as the process is concerned, this releases its pid for
- * subsequent reuse; thus we set curproc->p_pid to INVALID_PID.
+ * For a process, this also disowns its children (including any of its
+ * threads that haven't been joined), and releases the pid for
+ * subsequent reuse; the caller should set p_pid to INVALID_PID.
  */
 void
-pid_setexitstatus(int status)
+pid_setexitstatus(pid_t pid, int status)
 {
 	struct pidinfo *us;
-	int i;
+	bool isthread;
+	unsigned l, i;
 
-	lock_acquire(pidlock);
-	KASSERT(curproc->p_pid != INVALID_PID);
+	KASSERT(pid != INVALID_PID);
 
-	/* First, disown all children */
-	for (i=0; i<PROCS_MAX; i++) {
-		if (pidinfo[i]==NULL) {
-			continue;
-		}
-		if (pidinfo[i]->pi_ppid == curproc->p_pid) {
-			pidinfo[i]->pi_ppid = INVALID_PID;
-			if (pidinfo[i]->pi_exited) {
-				pi_drop(pidinfo[i]->pi_pid);
+	lock_acquire(pidlock_for(pid));
+	us = pi_get(pid);
+	KASSERT(us != NULL);
+	isthread = us->pi_isthread;
+	lock_release(pidlock_for(pid));
+
+	/*
+	 * First, disown all children. Go through the table one lock's
+	 * worth of slots at a time, so we never hold more than one.
+	 * (Nobody else can drop us meanwhile, since we haven't exited.)
+	 */
+	for (l=0; l<PIDLOCKS && !isthread; l++) {
+		lock_acquire(pidlocks[l]);
+		for (i=l; i<PROCS_MAX; i+=PIDLOCKS) {
+			if (pidinfo[i]==NULL) {
+				continue;
+			}
+			if (pidinfo[i]->pi_ppid == pid) {
+				pidinfo[i]->pi_ppid = INVALID_PID;
+				if (pidinfo[i]->pi_exited) {
+					pi_drop(pidinfo[i]->pi_pid);
+				}
 			}
 		}
+		lock_release(pidlocks[l]);
 	}
 
 	/* Now, wake up our parent */
-	us = pi_get(curproc->p_pid);
-	KASSERT(us != NULL);
+	lock_acquire(pidlock_for(pid));
 
 	us->pi_exitstatus = status;
 	us->pi_exited = true;
 
 	if (us->pi_ppid == INVALID_PID) {
 		/* no parent */
-		pi_drop(curproc->p_pid);
+		pi_drop(pid);
 	}
 	else {
-		cv_broadcast(us->pi_cv, pidlock);
+		cv_broadcast(us->pi_cv, pidlock_for(pid));
 	}
 
-	curproc->p_pid = INVALID_PID;
-	lock_release(pidlock);
+	lock_release(pidlock_for(pid));
 }
 
 /*
- * Waits on a pid, returning the exit status when it's available.
- * status and ret are a kernel pointers, but pid/flags may come from
- * userland and may thus be maliciously invalid.
+ * Common code for pid_wait and pid_join: wait for THEIRPID, which
+ * must be a process (or thread, if ISTHREAD) belonging to us, and
+ * collect its exit status.
  *
- * status may be null, in which case the status is thrown away. ret
- * may only be null if WNOHANG is not set.
+ * Only one thread may wait for any given pid; a second one gets
+ * EINVAL, as it would otherwise be left holding a pointer to
+ * pidinfo that the first one frees.
  */
+static
 int
-pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
+pid_dowait(pid_t theirpid, bool isthread, int *status, int flags, pid_t *ret)
 {
 	struct pidinfo *them;
 
-	KASSERT(curproc->p_pid != INVALID_PID);
-
-	/* Don't let a process wait for itself. */
-	if (theirpid == curproc->p_pid) {
-		return EINVAL;
-	}
-
-	/*
-	 * We don't support the Unix meanings of negative pids or 0
-	 * (0 is INVALID_PID) and other code may break on them, so
-	 * check now.
-	 */
-	if (theirpid == INVALID_PID || theirpid<0) {
-		return ENOSYS;
-	}
-
-	/* Only valid options */
-	if (flags != 0 && flags != WNOHANG) {
-		return EINVAL;
-	}
-
-	lock_acquire(pidlock);
+	lock_acquire(pidlock_for(theirpid));
 
 	them = pi_get(theirpid);
 	if (them==NULL) {
-		lock_release(pidlock);
+		lock_release(pidlock_for(theirpid));
 		return ESRCH;
 	}
 
 	KASSERT(them->pi_pid==theirpid);
 
-	/* Only allow waiting for own children. */
+	/* Only allow waiting for own children (or own threads). */
 	if (them->pi_ppid != curproc->p_pid) {
-		lock_release(pidlock);
-		return EPERM;
+		lock_release(pidlock_for(theirpid));
+		return isthread ? ESRCH : EPERM;
+	}
+	if (them->pi_isthread != isthread) {
+		lock_release(pidlock_for(theirpid));
+		return isthread ? ESRCH : ECHILD;
+	}
+	if (them->pi_waiting) {
+		lock_release(pidlock_for(theirpid));
+		return EINVAL;
 	}
 
 	if (them->pi_exited == false) {
 		if (flags == WNOHANG) {
-			lock_release(pidlock);
+			lock_release(pidlock_for(theirpid));
 			KASSERT(ret != NULL);
 			*ret = 0;
 			return 0;
 		}
 		/* don't need to loop on this */
-		cv_wait(them->pi_cv, pidlock);
+		them->pi_waiting = true;
+		cv_wait(them->pi_cv, pidlock_for(theirpid));
 		KASSERT(them->pi_exited == true);
 	}
 
@@ -460,6 +566,62 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 	them->pi_ppid = 0;
 	pi_drop(them->pi_pid);
 
-	lock_release(pidlock);
+	lock_release(pidlock_for(theirpid));
 	return 0;
 }
+
+/*
+ * Waits on a pid, returning the exit status when it's available.
+ * status and ret are a kernel pointers, but pid/flags may come from
+ * userland and may thus be maliciously invalid.
+ *
+ * status may be null, in which case the status is thrown away. ret
+ * may only be null if WNOHANG is not set.
+ */
+int
+pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
+{
+	KASSERT(curproc->p_pid != INVALID_PID);
+
+	/* Don't let a process wait for itself. */
+	if (theirpid == curproc->p_pid) {
+		return EINVAL;
+	}
+
+	/*
+	 * We don't support the Unix meanings of negative pids or 0
+	 * (0 is INVALID_PID) and other code may break on them, so
+	 * check now.
+	 */
+	if (theirpid == INVALID_PID || theirpid<0) {
+		return ENOSYS;
+	}
+
+	/* Only valid options */
+	if (flags != 0 && flags != WNOHANG) {
+		return EINVAL;
+	}
+
+	return pid_dowait(theirpid, false, status, flags, ret);
+}
+
+/*
+ * Waits for thread TID, which must be another thread in the current
+ * process, to exit, and returns its exit status.
+ */
+int
+pid_join(pid_t tid, int *status)
+{
+	KASSERT(curproc->p_pid != INVALID_PID);
+
+	if (tid == INVALID_PID || tid < 0) {
+		return ESRCH;
+	}
+
+	/* Don't let a thread join itself. */
+	if (tid == curthread->t_tid) {
+		return EINVAL;
+	}
+
+	return pid_dowait(tid, true, status, 0, NULL);
+}
@@ -38,26 +38,61 @@
  * things they point to. Rearrange this (and/or change it to be a
  * regular lock) as needed.
  *
- * Unless you're implementing multithreaded user processes, the only
- * process that will have more than one thread is the kernel process.
+ * User processes may have more than one thread; see thread_create in
+ * proc_syscalls.c.
  */
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/wait.h>
 #include <spl.h>
 #include <synch.h>
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
+#include <vdso.h>
 #include <vnode.h>
 #include <pid.h>
 #include <filetable.h>
+#include <kmem.h>
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
  */
 struct proc *kproc;
 
+/*
+ * Cache of proc structures. Cached procs keep their p_threadslock,
+ * p_threads and p_lock set up.
+ */
+static struct kmem_cache *proc_cache;
+
+static
+int
+proc_ctor(void *obj)
+{
+	struct proc *proc = obj;
+
+	proc->p_threadslock = lock_create("p_threads");
+	if (proc->p_threadslock == NULL) {
+		return ENOMEM;
+	}
+	threadarray_init(&proc->p_threads);
+	spinlock_init(&proc->p_lock);
+	return 0;
+}
+
+static
+void
+proc_dtor(void *obj)
+{
+	struct proc *proc = obj;
+
+	spinlock_cleanup(&proc->p_lock);
+	threadarray_cleanup(&proc->p_threads);
+	lock_destroy(proc->p_threadslock);
+}
+
 /*
  * Create a proc structure.
  */
@@ -67,26 +102,18 @@ proc_create(const char *name)
 {
 	struct proc *proc;
 
-	proc = kmalloc(sizeof(*proc));
+	proc = kmem_cache_alloc(proc_cache);
 	if (proc == NULL) {
 		return NULL;
 	}
 	proc->p_name = kstrdup(name);
 	if (proc->p_name == NULL) {
-		kfree(proc);
+		kmem_cache_free(proc_cache, proc);
 		return NULL;
 	}
 
-	proc->p_threadslock = lock_create("p_threads");
-	if (proc->p_threadslock == NULL) {
-		kfree(proc->p_name);
-		kfree(proc);
-		return NULL;
-	}
-	threadarray_init(&proc->p_threads);
-
-	spinlock_init(&proc->p_lock);
 	proc->p_pid = INVALID_PID;
+	proc->p_exitstatus = _MKWAIT_EXIT(0);
 
 	/* VM fields */
 	proc->p_addrspace = NULL;
@@ -183,12 +210,10 @@ proc_destroy(struct proc *proc)
 	}
 
 	KASSERT(proc->p_pid == INVALID_PID);
-	spinlock_cleanup(&proc->p_lock);
-	threadarray_cleanup(&proc->p_threads);
-	lock_destroy(proc->p_threadslock);
+	KASSERT(threadarray_num(&proc->p_threads) == 0);
 
 	kfree(proc->p_name);
-	kfree(proc);
+	kmem_cache_free(proc_cache, proc);
 }
 
 /*
@@ -197,6 +222,12 @@ proc_destroy(struct proc *proc)
 void
 proc_bootstrap(void)
 {
+	proc_cache = kmem_cache_create("proc", sizeof(struct proc),
+				       proc_ctor, proc_dtor);
+	if (proc_cache == NULL) {
+		panic("proc_bootstrap: Out of memory\n");
+	}
+
 	kproc = proc_create("[kernel]");
 	if (kproc == NULL) {
 		panic("proc_create for kproc failed\n");
@@ -259,11 +290,12 @@ proc_create_runprogram(const char *name, struct proc **ret)
  * is not null. (If RET is null, what we're creating is a kernel-only
  * thread and it doesn't need an address space or file handles.)
  * However, the new thread always inherits its current working
- * directory from the caller. The new thread is given no address space
- * (the caller decides that).
+ * directory from the caller. The new thread gets a copy of the
+ * caller's address space if COPYAS is set, and none otherwise.
  */
+static
 int
-proc_fork(struct proc **ret)
+proc_clone(struct proc **ret, bool copyas)
 {
 	struct proc *newproc;
 	struct addrspace *as;
@@ -292,7 +324,7 @@ proc_fork(struct proc **ret)
 #endif
 
 	/* VM fields */
-	as = proc_getas();
+	as = copyas ? proc_getas() : NULL;
 	if (as != NULL) {
 		result = as_copy(as, &newproc->p_addrspace);
 		if (result) {
@@ -301,6 +333,7 @@ proc_fork(struct proc **ret)
 			proc_destroy(newproc);
 			return result;
 		}
+		vdso_setpid(newproc->p_addrspace, newproc->p_pid);
 	}
 
 	/* VFS fields */
@@ -334,7 +367,28 @@ proc_fork(struct proc **ret)
 }
 
 /*
- * Undo proc_fork if nothing's run in the new process yet.
+ * Make a copy of the current process for fork().
+ */
+int
+proc_fork(struct proc **ret)
+{
+	return proc_clone(ret, true);
+}
+
+/*
+ * Make a new process for spawn(): like proc_fork, but without copying
+ * the address space, since the new process is about to load a fresh
+ * one anyway.
+ */
+int
+proc_spawn(struct proc **ret)
+{
+	return proc_clone(ret, false);
+}
+
+/*
+ * Undo proc_fork (or proc_spawn) if nothing's run in the new process
+ * yet.
  */
 void
 proc_unfork(struct proc *newproc)
@@ -345,30 +399,72 @@ proc_unfork(struct proc *newproc)
 }
 
 /*
- * Make the current process exit.
+ * Common code for proc_exit and proc_thread_exit: take the current
+ * thread out of its process. If it was the last thread, the process
+ * has exited.
  */
+static
 void
-proc_exit(int status)
+proc_leave(int status)
 {
 	struct proc *proc = curproc;
+	struct thread *cur = curthread;
+	unsigned remaining;
 
 	/* The kernel isn't supposed to exit. */
 	KASSERT(proc != kproc);
 
-	/* Set exit status and wake up anyone waiting for us. */
-	pid_setexitstatus(status);
+	/* If we have a thread id, set its status and wake up any joiner. */
+	if (cur->t_tid != INVALID_PID) {
+		pid_setexitstatus(cur->t_tid, status);
+		cur->t_tid = INVALID_PID;
+	}
+	if (cur->t_ustack != 0) {
+		as_release_thread_stack(proc_getas(), cur->t_ustack);
+		cur->t_ustack = 0;
+	}
 
 	/* Detach from the process and attach to the kernel process. */
-	KASSERT(curthread->t_proc == proc);
-	proc_remthread(curthread);
-	proc_addthread(kproc, curthread);
+	KASSERT(cur->t_proc == proc);
+	remaining = proc_remthread(cur);
+	proc_addthread(kproc, cur);
 
-	/* There should be no threads left in the target process. */
-	KASSERT(threadarray_num(&proc->p_threads) == 0);
+	if (remaining > 0) {
+		/* Someone else will turn out the lights. */
+		return;
+	}
+
+	/* Set exit status and wake up anyone waiting for us. */
+	pid_setexitstatus(proc->p_pid, proc->p_exitstatus);
+	proc->p_pid = INVALID_PID;
 
 	/* Now we can destroy the process. */
 	proc_destroy(proc);
+}
 
+/*
+ * Make the current process exit.
+ */
+void
+proc_exit(int status)
+{
+	struct proc *proc = curproc;
+
+	spinlock_acquire(&proc->p_lock);
+	proc->p_exitstatus = status;
+	spinlock_release(&proc->p_lock);
+
+	proc_leave(status);
+	thread_exit();
+}
+
+/*
+ * Make the current thread exit.
+ */
+void
+proc_thread_exit(int status)
+{
+	proc_leave(status);
 	thread_exit();
 }
 
@@ -405,14 +501,16 @@ proc_addthread(struct proc *proc, struct thread *t)
 
 /*
  * Remove a thread from its process. Either the thread or the process
- * might or might not be current.
+ * might or might not be current. Returns the number of threads still
+ * in the process; since that's counted under p_threadslock, exactly
+ * one of several threads leaving at once sees zero.
  *
  * Turn off interrupts on the local cpu while changing t_proc, in
  * case it's current, to protect against the as_activate call in
  * the timer interrupt context switch, and any other implicit uses
  * of "curproc".
  */
-void
+unsigned
 proc_remthread(struct thread *t)
 {
 	struct proc *proc;
@@ -428,6 +526,7 @@ proc_remthread(struct thread *t)
 	for (i=0; i<num; i++) {
 		if (threadarray_get(&proc->p_threads, i) == t) {
 			threadarray_remove(&proc->p_threads, i);
+			num--;
 			lock_release(proc->p_threadslock);
 			goto finish;
 		}
@@ -440,15 +539,17 @@ finish:
 	spl = splhigh();
 	t->t_proc = NULL;
 	splx(spl);
+
+	return num;
 }
 
 /*
  * Fetch the address space of (the current) process.
  *
- * Caution: address spaces aren't refcounted. If you implement
- * multithreaded processes, make sure to set up a refcount scheme or
- * some other method to make this safe. Otherwise the returned address
- * space might disappear under you.
+ * Address spaces aren't refcounted. This is safe for the threads of a
+ * multithreaded process because the address space only goes away in
+ * proc_destroy, after the last of them has left, and execv refuses to
+ * replace it while there is more than one.
  */
 struct addrspace *
 proc_getas(void)
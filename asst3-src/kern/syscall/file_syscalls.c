@@ -47,6 +47,7 @@
 #include <vnode.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <pipe.h>
 #include <syscall.h>
 
 /*
@@ -105,19 +106,27 @@ sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
 }
 
 /*
- * Common logic for read and write.
+ * Common logic for read, write, readv, writev, pread, and pwrite.
  *
- * Look up the fd, then use VOP_READ or VOP_WRITE.
+ * Look up the fd, then use VOP_READ or VOP_WRITE on the IOVCNT user
+ * buffers in IOV, which add up to SIZE bytes. However many buffers
+ * there are, this is one VOP call and one trip through the offset
+ * lock.
+ *
+ * If PPOS is not null, it's an explicit position (pread/pwrite): the
+ * seek position in the openfile is neither used nor updated, so we
+ * don't take the offset lock at all and threads doing positional I/O
+ * on a shared file handle don't serialize here.
  */
 static
 int
-sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
-	      int badaccmode, ssize_t *retval)
+sys_readwrite(int fd, struct iovec *iov, unsigned iovcnt, size_t size,
+	      enum uio_rw rw, int badaccmode, const off_t *ppos,
+	      ssize_t *retval)
 {
 	struct openfile *file;
 	bool locked;
 	off_t pos;
-	struct iovec iov;
 	struct uio useruio;
 	int result;
 
@@ -128,8 +137,20 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 	}
 
 	/* Only lock the seek position if we're really using it. */
-	locked = VOP_ISSEEKABLE(file->of_vnode);
-	if (locked) {
+	locked = false;
+	if (ppos != NULL) {
+		if (!VOP_ISSEEKABLE(file->of_vnode)) {
+			result = ESPIPE;
+			goto fail;
+		}
+		if (*ppos < 0) {
+			result = EINVAL;
+			goto fail;
+		}
+		pos = *ppos;
+	}
+	else if (VOP_ISSEEKABLE(file->of_vnode)) {
+		locked = true;
 		lock_acquire(file->of_offsetlock);
 		pos = file->of_offset;
 	}
@@ -142,8 +163,8 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		goto fail;
 	}
 
-	/* set up a uio with the buffer, its size, and the current offset */
-	uio_uinit(&iov, &useruio, buf, size, pos, rw);
+	/* set up a uio with the buffers, their size, and the current offset */
+	uio_uinitv(iov, iovcnt, &useruio, size, pos, rw);
 
 	/* do the read or write */
 	result = (rw == UIO_READ) ?
@@ -183,7 +204,12 @@ fail:
 int
 sys_read(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_READ, O_WRONLY, retval);
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, size, UIO_READ, O_WRONLY, NULL,
+			     retval);
 }
 
 /*
@@ -192,7 +218,325 @@ sys_read(int fd, userptr_t buf, size_t size, int *retval)
 int
 sys_write(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_WRITE, O_RDONLY, retval);
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, size, UIO_WRITE, O_RDONLY, NULL,
+			     retval);
+}
+
+/*
+ * pread() - use sys_readwrite with an explicit position
+ */
+int
+sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, size, UIO_READ, O_WRONLY, &pos,
+			     retval);
+}
+
+/*
+ * pwrite() - use sys_readwrite with an explicit position
+ */
+int
+sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, size, UIO_WRITE, O_RDONLY, &pos,
+			     retval);
+}
+
+/*
+ * Common logic for readv and writev: copy in and check the iovec
+ * array, then use sys_readwrite.
+ *
+ * Small arrays go on the stack; bigger ones (up to IOV_MAX) are
+ * kmalloc'd. The buffers the iovecs point to are checked as they're
+ * used, by uiomove.
+ */
+#define IOV_ONSTACK 8
+
+static
+int
+sys_readwritev(int fd, const_userptr_t uiov, int iovcnt, enum uio_rw rw,
+	       int badaccmode, int *retval)
+{
+	struct iovec stackiov[IOV_ONSTACK];
+	struct iovec *iov;
+	size_t size;
+	int i;
+	int result;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+
+	if (iovcnt <= IOV_ONSTACK) {
+		iov = stackiov;
+	}
+	else {
+		iov = kmalloc(iovcnt * sizeof(struct iovec));
+		if (iov == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	result = copyin(uiov, iov, iovcnt * sizeof(struct iovec));
+	if (result) {
+		goto done;
+	}
+
+	/* the total has to fit in the (signed) return value */
+	size = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (iov[i].iov_len > ((size_t)-1 >> 1) - size) {
+			result = EINVAL;
+			goto done;
+		}
+		size += iov[i].iov_len;
+	}
+
+	result = sys_readwrite(fd, iov, iovcnt, size, rw, badaccmode, NULL,
+			       retval);
+
+done:
+	if (iov != stackiov) {
+		kfree(iov);
+	}
+	return result;
+}
+
+/*
+ * readv() - use sys_readwritev
+ */
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * writev() - use sys_readwritev
+ */
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_WRITE, O_RDONLY, retval);
+}
+
+/* How much copy_file_range moves per trip through its kernel buffer. */
+#define COPY_CHUNK	16384
+
+/*
+ * Work out where one side of a copy_file_range starts: from the user
+ * position UPOSP if there is one, or else the file's own offset if
+ * it's seekable (in which case *USEOFFSET is set and the caller must
+ * hold of_offsetlock from here on), or else nowhere in particular.
+ */
+static
+int
+copy_getpos(struct openfile *file, userptr_t uposp, off_t *pos,
+	    bool *useoffset)
+{
+	int result;
+
+	*useoffset = false;
+	if (uposp != NULL) {
+		if (!VOP_ISSEEKABLE(file->of_vnode)) {
+			return ESPIPE;
+		}
+		result = copyin(uposp, pos, sizeof(*pos));
+		if (result) {
+			return result;
+		}
+		if (*pos < 0) {
+			return EINVAL;
+		}
+	}
+	else if (VOP_ISSEEKABLE(file->of_vnode)) {
+		*useoffset = true;
+		*pos = 0;
+	}
+	else {
+		*pos = 0;
+	}
+	return 0;
+}
+
+/*
+ * copy_file_range() - copy up to LEN bytes from INFD to OUTFD inside
+ * the kernel. Each chunk is read into a kernel buffer and written
+ * straight back out of it, instead of going up to userspace and back
+ * down again.
+ *
+ * If INPOSP (or OUTPOSP) is given, the copy happens at that position
+ * and the new position is written back there; the file's own offset
+ * isn't touched. Otherwise the file's offset is used and updated.
+ *
+ * A short read ends the copy early, so the caller loops just as it
+ * would with read.
+ */
+int
+sys_copy_file_range(int infd, userptr_t inposp, int outfd, userptr_t outposp,
+		    size_t len, unsigned flags, int *retval)
+{
+	struct filetable *ft = curproc->p_filetable;
+	struct openfile *infile, *outfile;
+	struct lock *lock1, *lock2;
+	bool inuseoffset, outuseoffset;
+	off_t inpos, outpos;
+	struct iovec iov;
+	struct uio kuio;
+	char *buf;
+	size_t done, chunk, got, put;
+	int result;
+
+	if (flags != 0) {
+		return EINVAL;
+	}
+	if (len > ((size_t)-1 >> 1)) {
+		len = (size_t)-1 >> 1;
+	}
+
+	result = filetable_get(ft, infd, &infile);
+	if (result) {
+		return result;
+	}
+	result = filetable_get(ft, outfd, &outfile);
+	if (result) {
+		filetable_put(ft, infd, infile);
+		return result;
+	}
+
+	lock1 = lock2 = NULL;
+	buf = NULL;
+
+	if (infile->of_accmode == O_WRONLY ||
+	    outfile->of_accmode == O_RDONLY) {
+		result = EBADF;
+		goto out;
+	}
+	if (infile->of_vnode == outfile->of_vnode) {
+		/* overlapping copies aren't worth the trouble */
+		result = EINVAL;
+		goto out;
+	}
+
+	result = copy_getpos(infile, inposp, &inpos, &inuseoffset);
+	if (result) {
+		goto out;
+	}
+	result = copy_getpos(outfile, outposp, &outpos, &outuseoffset);
+	if (result) {
+		goto out;
+	}
+
+	/* take the offset locks in address order so two copies can't deadlock */
+	if (inuseoffset) {
+		lock1 = infile->of_offsetlock;
+	}
+	if (outuseoffset) {
+		lock2 = outfile->of_offsetlock;
+	}
+	if (lock1 != NULL && lock2 != NULL && lock2 < lock1) {
+		lock_acquire(lock2);
+		lock_acquire(lock1);
+	}
+	else {
+		if (lock1 != NULL) {
+			lock_acquire(lock1);
+		}
+		if (lock2 != NULL) {
+			lock_acquire(lock2);
+		}
+	}
+	if (inuseoffset) {
+		inpos = infile->of_offset;
+	}
+	if (outuseoffset) {
+		outpos = outfile->of_offset;
+	}
+
+	buf = kmalloc(len < COPY_CHUNK ? len : COPY_CHUNK);
+	if (buf == NULL) {
+		result = ENOMEM;
+		goto out;
+	}
+
+	done = 0;
+	while (done < len) {
+		chunk = len - done;
+		if (chunk > COPY_CHUNK) {
+			chunk = COPY_CHUNK;
+		}
+
+		uio_kinit(&iov, &kuio, buf, chunk, inpos, UIO_READ);
+		result = VOP_READ(infile->of_vnode, &kuio);
+		if (result) {
+			break;
+		}
+		got = chunk - kuio.uio_resid;
+		if (got == 0) {
+			break;
+		}
+
+		uio_kinit(&iov, &kuio, buf, got, outpos, UIO_WRITE);
+		result = VOP_WRITE(outfile->of_vnode, &kuio);
+		put = got - kuio.uio_resid;
+
+		/* only count what actually made it to the other side */
+		inpos += put;
+		outpos += put;
+		done += put;
+
+		if (result || put < got || got < chunk) {
+			break;
+		}
+	}
+
+	/* report a partial copy rather than the error that cut it short */
+	if (result && done > 0) {
+		result = 0;
+	}
+
+	if (inuseoffset) {
+		infile->of_offset = inpos;
+	}
+	else if (inposp != NULL && result == 0) {
+		result = copyout(&inpos, inposp, sizeof(inpos));
+	}
+	if (outuseoffset) {
+		outfile->of_offset = outpos;
+	}
+	else if (outposp != NULL && result == 0) {
+		result = copyout(&outpos, outposp, sizeof(outpos));
+	}
+
+	if (result == 0) {
+		*retval = done;
+	}
+
+ out:
+	if (buf != NULL) {
+		kfree(buf);
+	}
+	if (lock2 != NULL) {
+		lock_release(lock2);
+	}
+	if (lock1 != NULL) {
+		lock_release(lock1);
+	}
+	filetable_put(ft, outfd, outfile);
+	filetable_put(ft, infd, infile);
+	return result;
 }
 
 /*
@@ -333,6 +677,70 @@ sys_dup2(int oldfd, int newfd, int *retval)
 	return 0;
 }
 
+/*
+ * pipe() - make a pipe and put its read and write ends in the file
+ * table, handing the two fds back in FDS.
+ */
+int
+sys_pipe(userptr_t fds)
+{
+	struct filetable *ft;
+	struct vnode *readvn, *writevn;
+	struct openfile *readfile, *writefile, *oldfile;
+	int kfds[2];
+	int result;
+
+	ft = curproc->p_filetable;
+
+	result = pipe_create(&readvn, &writevn);
+	if (result) {
+		return result;
+	}
+
+	readfile = openfile_create(readvn, O_RDONLY);
+	if (readfile == NULL) {
+		VOP_DECREF(readvn);
+		VOP_DECREF(writevn);
+		return ENOMEM;
+	}
+	writefile = openfile_create(writevn, O_WRONLY);
+	if (writefile == NULL) {
+		openfile_decref(readfile);
+		VOP_DECREF(writevn);
+		return ENOMEM;
+	}
+
+	result = filetable_place(ft, readfile, &kfds[0]);
+	if (result) {
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+	result = filetable_place(ft, writefile, &kfds[1]);
+	if (result) {
+		openfile_decref(writefile);
+		goto fail;
+	}
+
+	result = copyout(kfds, fds, sizeof(kfds));
+	if (result) {
+		/* the table's reference to the write end goes too */
+		filetable_placeat(ft, NULL, kfds[1], &oldfile);
+		if (oldfile != NULL) {
+			openfile_decref(oldfile);
+		}
+		goto fail;
+	}
+	return 0;
+
+ fail:
+	filetable_placeat(ft, NULL, kfds[0], &oldfile);
+	if (oldfile != NULL) {
+		openfile_decref(oldfile);
+	}
+	return result;
+}
+
 /*
  * chdir() - change directory. Send the path off to the vfs layer.
  */
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Futex system calls: sleep and wake on a user memory word.
+ *
+ * futex_wait(addr, val) goes to sleep if *addr is still val, and
+ * futex_wake(addr, n) wakes up to n threads sleeping on addr. User
+ * code does the actual locking with atomic operations on the word
+ * and only comes in here when it has to wait; see mutex.c in libc.
+ *
+ * A futex is identified by (address space, user address). Waiters
+ * are hashed on that into a fixed table of buckets, each with a
+ * spinlock, a wait channel, and a list of the waiters in the bucket.
+ * Waking walks the bucket list, marks and unlinks the matching
+ * waiters, and then wakes the bucket's channel; waiters whose key
+ * collided but weren't picked just go back to sleep.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <proc.h>
+#include <current.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+#define FUTEX_NBUCKETS	64
+
+/*
+ * One of these lives on the kernel stack of each waiting thread.
+ */
+struct futex_waiter {
+	struct addrspace *fw_as;	/* key: address space */
+	vaddr_t fw_addr;		/* key: user address */
+	bool fw_woken;			/* set (and unlinked) by a waker */
+	struct futex_waiter *fw_next;	/* bucket list */
+};
+
+struct futex_bucket {
+	struct spinlock fb_lock;	/* protects the rest */
+	struct wchan *fb_wchan;		/* where the waiters sleep */
+	struct futex_waiter *fb_waiters;
+};
+
+static struct futex_bucket futex_table[FUTEX_NBUCKETS];
+
+/*
+ * Setup function.
+ */
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_NBUCKETS; i++) {
+		spinlock_init(&futex_table[i].fb_lock);
+		futex_table[i].fb_wchan = wchan_create("futex");
+		if (futex_table[i].fb_wchan == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		futex_table[i].fb_waiters = NULL;
+	}
+}
+
+static
+struct futex_bucket *
+futex_hash(struct addrspace *as, vaddr_t addr)
+{
+	uint32_t h;
+
+	h = (uint32_t)(uintptr_t)as ^ (addr >> 2);
+	h ^= h >> 16;
+	return &futex_table[h % FUTEX_NBUCKETS];
+}
+
+/*
+ * Take a waiter off its bucket list. Must hold the bucket lock.
+ */
+static
+void
+futex_unlink(struct futex_bucket *fb, struct futex_waiter *fw)
+{
+	struct futex_waiter **pp;
+
+	KASSERT(spinlock_do_i_hold(&fb->fb_lock));
+
+	for (pp = &fb->fb_waiters; *pp != NULL; pp = &(*pp)->fw_next) {
+		if (*pp == fw) {
+			*pp = fw->fw_next;
+			return;
+		}
+	}
+	panic("futex: waiter %p not in its bucket\n", fw);
+}
+
+/*
+ * futex_wait() - sleep on UADDR if it still contains VAL.
+ *
+ * We get on the bucket list *before* reading the user word, because
+ * we can't touch user memory while holding a spinlock. A wake that
+ * comes in between the read and the sleep then still finds us and
+ * sets fw_woken, so it isn't lost.
+ */
+int
+sys_futex_wait(userptr_t uaddr, int val)
+{
+	struct futex_waiter fw;
+	struct futex_bucket *fb;
+	int cur;
+	int result;
+
+	if ((vaddr_t)uaddr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	fw.fw_as = proc_getas();
+	fw.fw_addr = (vaddr_t)uaddr;
+	fw.fw_woken = false;
+	fb = futex_hash(fw.fw_as, fw.fw_addr);
+
+	spinlock_acquire(&fb->fb_lock);
+	fw.fw_next = fb->fb_waiters;
+	fb->fb_waiters = &fw;
+	spinlock_release(&fb->fb_lock);
+
+	result = copyin(uaddr, &cur, sizeof(cur));
+
+	spinlock_acquire(&fb->fb_lock);
+	if (result == 0 && cur != val) {
+		/* it changed already; let userlevel look again */
+		result = EAGAIN;
+	}
+	if (result == 0) {
+		while (!fw.fw_woken) {
+			wchan_sleep(fb->fb_wchan, &fb->fb_lock);
+		}
+	}
+	if (!fw.fw_woken) {
+		futex_unlink(fb, &fw);
+	}
+	spinlock_release(&fb->fb_lock);
+
+	return result;
+}
+
+/*
+ * futex_wake() - wake up to N threads sleeping on UADDR. Returns the
+ * number woken.
+ */
+int
+sys_futex_wake(userptr_t uaddr, int n, int *retval)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter **pp, *fw;
+	struct addrspace *as;
+	int count;
+
+	if ((vaddr_t)uaddr % sizeof(int) != 0 || n < 0) {
+		return EINVAL;
+	}
+
+	as = proc_getas();
+	fb = futex_hash(as, (vaddr_t)uaddr);
+	count = 0;
+
+	spinlock_acquire(&fb->fb_lock);
+	pp = &fb->fb_waiters;
+	while (*pp != NULL && count < n) {
+		fw = *pp;
+		if (fw->fw_as == as && fw->fw_addr == (vaddr_t)uaddr) {
+			*pp = fw->fw_next;
+			fw->fw_woken = true;
+			count++;
+		}
+		else {
+			pp = &fw->fw_next;
+		}
+	}
+	if (count > 0) {
+		wchan_wakeall(fb->fb_wchan, &fb->fb_lock);
+	}
+	spinlock_release(&fb->fb_lock);
+
+	*retval = count;
+	return 0;
+}
@@ -58,6 +58,8 @@
 #include <current.h>
 #include <addrspace.h>
 #include <vnode.h>
+#include <vm.h>
+#include <pagecache.h>
 #include <elf.h>
 
 /*
@@ -150,6 +152,71 @@ load_segment(struct addrspace *as, struct vnode *v,
  *
  * Returns the entry point (initial PC) for the program in ENTRYPOINT.
  */
+/*
+ * Load a read-only segment by mapping pages from the executable's
+ * page cache, so that everyone running the program shares them.
+ * Each page holds the file data from the page's own file offset up to
+ * the end of the segment's file data, and zeros after that.
+ *
+ * This only works if the segment sits at the same offset within a
+ * page in memory as in the file, and if the VM system can map pages
+ * we hand it; if not, returns ENOSYS and the caller loads the segment
+ * the ordinary way.
+ */
+static
+int
+load_segment_shared(struct addrspace *as, struct vnode *v,
+		    off_t offset, vaddr_t vaddr,
+		    size_t memsize, size_t filesize)
+{
+	vaddr_t va, kpage;
+	off_t pageoffset, fileend;
+	size_t len;
+	int result;
+
+	if (offset % PAGE_SIZE != vaddr % PAGE_SIZE) {
+		return ENOSYS;
+	}
+	if (filesize > memsize) {
+		kprintf("ELF: warning: segment filesize > segment memsize\n");
+		filesize = memsize;
+	}
+
+	DEBUG(DB_EXEC, "ELF: Sharing %lu bytes at 0x%lx\n",
+	      (unsigned long) filesize, (unsigned long) vaddr);
+
+	fileend = offset + filesize;
+	va = vaddr & PAGE_FRAME;
+	pageoffset = offset - (vaddr - va);
+
+	/* Pages past the end of the file data get faulted in as zeros. */
+	for (; pageoffset < fileend; va += PAGE_SIZE, pageoffset += PAGE_SIZE) {
+		len = PAGE_SIZE;
+		if (fileend - pageoffset < PAGE_SIZE) {
+			len = fileend - pageoffset;
+		}
+
+		result = pagecache_get(v, pageoffset, len, &kpage);
+		if (result == EIO) {
+			kprintf("ELF: short read on segment - file truncated?\n");
+			return ENOEXEC;
+		}
+		if (result) {
+			return result;
+		}
+
+		/* this hands our reference to the page to the address space */
+		result = as_adopt_pages(as, va, &kpage, 1);
+		if (result) {
+			free_kpages(kpage);
+			return result;
+		}
+	}
+
+	as_set_text(as, v);
+	return 0;
+}
+
 int
 load_elf(struct vnode *v, vaddr_t *entrypoint)
 {
@@ -288,6 +355,18 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 			return ENOEXEC;
 		}
 
+		if ((ph.p_flags & PF_W) == 0) {
+			result = load_segment_shared(as, v, ph.p_offset,
+						     ph.p_vaddr, ph.p_memsz,
+						     ph.p_filesz);
+			if (result != ENOSYS) {
+				if (result) {
+					return result;
+				}
+				continue;
+			}
+		}
+
 		result = load_segment(as, v, ph.p_offset, ph.p_vaddr,
 				      ph.p_memsz, ph.p_filesz,
 				      ph.p_flags & PF_X);
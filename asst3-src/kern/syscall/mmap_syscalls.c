@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * mmap, munmap, and msync.
+ *
+ * These just check the arguments and the file; the address space
+ * does the work (see as_map, as_unmap, and as_sync in addrspace.c),
+ * and vm_fault reads the pages in as they're touched.
+ *
+ * This is the UNSW flavour of mmap: there's no address hint and no
+ * separate flags argument, so MAP_SHARED or MAP_PRIVATE is or'd into
+ * PROT, and munmap and msync always act on a whole mapping.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/mman.h>
+#include <lib.h>
+#include <proc.h>
+#include <current.h>
+#include <addrspace.h>
+#include <vnode.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <syscall.h>
+
+/*
+ * mmap: map LEN bytes of file FD starting at OFFSET (or anonymous
+ * zero-filled memory if FD is -1) and hand back where it went.
+ */
+int
+sys_mmap(size_t len, int prot, int fd, off_t offset, int *retval)
+{
+	struct filetable *ft = curproc->p_filetable;
+	struct openfile *file = NULL;
+	struct vnode *vn = NULL;
+	int flags;
+	vaddr_t addr;
+	int result;
+
+	flags = prot & (MAP_SHARED | MAP_PRIVATE);
+	prot &= ~(MAP_SHARED | MAP_PRIVATE);
+	if ((prot & ~(PROT_READ | PROT_WRITE)) != 0 ||
+	    flags == (MAP_SHARED | MAP_PRIVATE)) {
+		return EINVAL;
+	}
+	if (offset < 0 || offset % PAGE_SIZE != 0) {
+		return EINVAL;
+	}
+	if (flags == 0) {
+		flags = (fd == -1) ? MAP_PRIVATE : MAP_SHARED;
+	}
+
+	if (fd != -1) {
+		result = filetable_get(ft, fd, &file);
+		if (result) {
+			return result;
+		}
+		/* writing through a shared mapping writes the file */
+		if (file->of_accmode == O_WRONLY ||
+		    (flags == MAP_SHARED && (prot & PROT_WRITE) &&
+		     file->of_accmode != O_RDWR)) {
+			filetable_put(ft, fd, file);
+			return EACCES;
+		}
+		vn = file->of_vnode;
+		result = VOP_MMAP(vn);
+		if (result) {
+			filetable_put(ft, fd, file);
+			return result;
+		}
+	}
+
+	/* the mapping takes its own reference to the vnode */
+	result = as_map(proc_getas(), len, prot, flags, vn, offset, &addr);
+	if (file != NULL) {
+		filetable_put(ft, fd, file);
+	}
+	if (result) {
+		return result;
+	}
+
+	*retval = (int)addr;
+	return 0;
+}
+
+/*
+ * munmap: remove the mapping mmap put at ADDR.
+ */
+int
+sys_munmap(userptr_t addr)
+{
+	return as_unmap(proc_getas(), (vaddr_t)addr);
+}
+
+/*
+ * msync: write the modified pages of the shared mapping at ADDR back
+ * to its file.
+ */
+int
+sys_msync(userptr_t addr)
+{
+	return as_sync(proc_getas(), (vaddr_t)addr);
+}
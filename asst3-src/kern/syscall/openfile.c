@@ -37,12 +37,57 @@
 #include <lib.h>
 #include <synch.h>
 #include <vfs.h>
+#include <pagecache.h>
+#include <kmem.h>
 #include <openfile.h>
 
+static struct kmem_cache *openfile_cache;
+
 /*
- * Constructor for struct openfile.
+ * Object cache constructor and destructor: the lock and spinlock
+ * stay set up while the openfile sits in the cache.
  */
 static
+int
+openfile_ctor(void *obj)
+{
+	struct openfile *file = obj;
+
+	file->of_offsetlock = lock_create("openfile");
+	if (file->of_offsetlock == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&file->of_reflock);
+	return 0;
+}
+
+static
+void
+openfile_dtor(void *obj)
+{
+	struct openfile *file = obj;
+
+	spinlock_cleanup(&file->of_reflock);
+	lock_destroy(file->of_offsetlock);
+}
+
+/*
+ * Make the object cache.
+ */
+void
+openfile_bootstrap(void)
+{
+	openfile_cache = kmem_cache_create("openfile", sizeof(struct openfile),
+					   openfile_ctor, openfile_dtor);
+	if (openfile_cache == NULL) {
+		panic("openfile_bootstrap: Out of memory\n");
+	}
+}
+
+/*
+ * Constructor for struct openfile. Takes over the caller's reference
+ * to VN.
+ */
 struct openfile *
 openfile_create(struct vnode *vn, int accmode)
 {
@@ -53,24 +98,21 @@ openfile_create(struct vnode *vn, int accmode)
 		accmode == O_WRONLY ||
 		accmode == O_RDWR);
 
-	file = kmalloc(sizeof(struct openfile));
+	file = kmem_cache_alloc(openfile_cache);
 	if (file == NULL) {
 		return NULL;
 	}
 
-	file->of_offsetlock = lock_create("openfile");
-	if (file->of_offsetlock == NULL) {
-		kfree(file);
-		return NULL;
-	}
-
-	spinlock_init(&file->of_reflock);
-
 	file->of_vnode = vn;
 	file->of_accmode = accmode;
 	file->of_offset = 0;
 	file->of_refcount = 1;
 
+	/* keep programs from sharing pages of a file that may change */
+	if (accmode != O_RDONLY) {
+		pagecache_startwrite(vn);
+	}
+
 	return file;
 }
 
@@ -82,12 +124,14 @@ static
 void
 openfile_destroy(struct openfile *file)
 {
+	if (file->of_accmode != O_RDONLY) {
+		pagecache_endwrite(file->of_vnode);
+	}
+
 	/* balance vfs_open with vfs_close (not VOP_DECREF) */
 	vfs_close(file->of_vnode);
 
-	spinlock_cleanup(&file->of_reflock);
-	lock_destroy(file->of_offsetlock);
-	kfree(file);
+	kmem_cache_free(openfile_cache, file);
 }
 
 /*
@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * poll() and the wait structure behind it.
+ *
+ * Nothing keeps track of who is polling what. Pollers all sleep on one
+ * wait channel, and poll_wakeup() wakes all of them; each rescans its
+ * own file handles with VOP_POLL and goes back to sleep if none of
+ * them is ready yet. A generation count, bumped by every wakeup, closes
+ * the window between scanning and going to sleep: if it changed in
+ * between, we scan again instead of sleeping.
+ *
+ * This wakes up more pollers than necessary, but poll_wakeup costs
+ * almost nothing when nobody is polling, which is the common case.
+ *
+ * Timeouts have a resolution of one hardclock tick: while anyone is
+ * polling with a timeout, poll_tick() wakes everyone each tick so they
+ * can check the time.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <clock.h>
+#include <proc.h>
+#include <current.h>
+#include <copyinout.h>
+#include <vnode.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <poll.h>
+#include <syscall.h>
+
+static struct spinlock poll_lock;
+static struct wchan *poll_wchan;
+static unsigned poll_generation;	/* bumped by every poll_wakeup */
+static unsigned poll_sleepers;		/* threads asleep in poll */
+static unsigned poll_timed;		/* ...of which have a timeout */
+
+/*
+ * Setup function.
+ */
+void
+poll_bootstrap(void)
+{
+	spinlock_init(&poll_lock);
+	poll_wchan = wchan_create("poll");
+	if (poll_wchan == NULL) {
+		panic("poll_bootstrap: Out of memory\n");
+	}
+}
+
+/*
+ * Something became ready. Safe to call from interrupt handlers.
+ */
+void
+poll_wakeup(void)
+{
+	spinlock_acquire(&poll_lock);
+	poll_generation++;
+	if (poll_sleepers > 0) {
+		wchan_wakeall(poll_wchan, &poll_lock);
+	}
+	spinlock_release(&poll_lock);
+}
+
+/*
+ * Called every hardclock. Looking at poll_timed without the lock is
+ * fine; if we miss it this tick we'll see it next tick.
+ */
+void
+poll_tick(void)
+{
+	if (poll_timed == 0) {
+		return;
+	}
+	spinlock_acquire(&poll_lock);
+	if (poll_timed > 0) {
+		wchan_wakeall(poll_wchan, &poll_lock);
+	}
+	spinlock_release(&poll_lock);
+}
+
+/*
+ * Check each file handle once, filling in revents. Returns the number
+ * of entries with something to report.
+ */
+static
+unsigned
+poll_scan(struct pollfd *fds, unsigned nfds)
+{
+	struct filetable *ft = curproc->p_filetable;
+	struct openfile *file;
+	unsigned i, nready;
+	int revents, result;
+
+	nready = 0;
+	for (i=0; i<nfds; i++) {
+		revents = 0;
+		if (fds[i].fd < 0) {
+			/* ignored, by definition */
+		}
+		else if (filetable_get(ft, fds[i].fd, &file)) {
+			revents = POLLNVAL;
+		}
+		else {
+			result = VOP_POLL(file->of_vnode, fds[i].events,
+					  &revents);
+			if (result) {
+				revents = POLLERR;
+			}
+			filetable_put(ft, fds[i].fd, file);
+		}
+		fds[i].revents = revents;
+		if (revents != 0) {
+			nready++;
+		}
+	}
+	return nready;
+}
+
+/*
+ * Check whether NOW is at or past DEADLINE.
+ */
+static
+bool
+poll_expired(const struct timespec *now, const struct timespec *deadline)
+{
+	if (now->tv_sec != deadline->tv_sec) {
+		return now->tv_sec > deadline->tv_sec;
+	}
+	return now->tv_nsec >= deadline->tv_nsec;
+}
+
+/*
+ * poll() - wait until something in FDS is ready or TIMEOUT (in
+ * milliseconds; -1 means forever) runs out.
+ */
+int
+sys_poll(userptr_t ufds, unsigned nfds, int timeout, int *retval)
+{
+	struct pollfd *fds;
+	struct timespec now, deadline, wait;
+	unsigned gen, nready;
+	bool timed;
+	int result;
+
+	if (nfds > OPEN_MAX) {
+		return EINVAL;
+	}
+
+	fds = kmalloc(nfds * sizeof(*fds));
+	if (fds == NULL) {
+		return ENOMEM;
+	}
+	result = copyin(ufds, fds, nfds * sizeof(*fds));
+	if (result) {
+		kfree(fds);
+		return result;
+	}
+
+	timed = timeout >= 0;
+	if (timed) {
+		gettime(&now);
+		wait.tv_sec = timeout / 1000;
+		wait.tv_nsec = (timeout % 1000) * 1000000;
+		timespec_add(&now, &wait, &deadline);
+	}
+
+	while (1) {
+		spinlock_acquire(&poll_lock);
+		gen = poll_generation;
+		spinlock_release(&poll_lock);
+
+		nready = poll_scan(fds, nfds);
+		if (nready > 0 || timeout == 0) {
+			break;
+		}
+		if (timed) {
+			gettime(&now);
+			if (poll_expired(&now, &deadline)) {
+				break;
+			}
+		}
+
+		spinlock_acquire(&poll_lock);
+		if (gen == poll_generation) {
+			poll_sleepers++;
+			if (timed) {
+				poll_timed++;
+			}
+			wchan_sleep(poll_wchan, &poll_lock);
+			if (timed) {
+				poll_timed--;
+			}
+			poll_sleepers--;
+		}
+		spinlock_release(&poll_lock);
+	}
+
+	result = copyout(fds, ufds, nfds * sizeof(*fds));
+	kfree(fds);
+	if (result) {
+		return result;
+	}
+	*retval = nready;
+	return 0;
+}
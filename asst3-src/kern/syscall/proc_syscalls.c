@@ -42,6 +42,7 @@
 #include <current.h>
 #include <copyinout.h>
 #include <pid.h>
+#include <addrspace.h>
 #include <syscall.h>
 
 /* note that sys_execv is in runprogram.c */
@@ -137,6 +138,145 @@ sys_fork(struct trapframe *tf, pid_t *retval)
 	return 0;
 }
 
+/*
+ * sys_thread_create
+ *
+ * Start a new thread in the current process. It enters user mode at
+ * ENTRY, with ARG0 and ARG1 in the first two argument registers, on a
+ * stack of its own from as_define_thread_stack. Returns the thread id.
+ *
+ * ENTRY is normally the trampoline in libc's thread_create(), which
+ * calls the user's function and passes what it returns to
+ * thread_exit().
+ */
+
+struct newthread {
+	vaddr_t nt_entry;
+	userptr_t nt_arg0;
+	userptr_t nt_arg1;
+	vaddr_t nt_stack;
+};
+
+static
+void
+thread_create_newthread(void *vnt, unsigned long tid)
+{
+	struct newthread nt;
+
+	nt = *(struct newthread *)vnt;
+	kfree(vnt);
+
+	curthread->t_tid = tid;
+	curthread->t_ustack = nt.nt_stack;
+
+	/*
+	 * This puts arg0 and arg1 in a0 and a1, which is all we need.
+	 * Leave room at the top of the stack for the 16 bytes of
+	 * argument save area the entry function is allowed to use.
+	 */
+	enter_new_process((int)nt.nt_arg0, nt.nt_arg1, NULL,
+			  nt.nt_stack - 16, nt.nt_entry);
+}
+
+int
+sys_thread_create(userptr_t entry, userptr_t arg0, userptr_t arg1,
+		  pid_t *retval)
+{
+	struct newthread *nt;
+	struct addrspace *as;
+	pid_t tid;
+	int result;
+
+	as = proc_getas();
+	if (as == NULL) {
+		return EINVAL;
+	}
+
+	nt = kmalloc(sizeof(*nt));
+	if (nt == NULL) {
+		return ENOMEM;
+	}
+	nt->nt_entry = (vaddr_t)entry;
+	nt->nt_arg0 = arg0;
+	nt->nt_arg1 = arg1;
+
+	result = as_define_thread_stack(as, &nt->nt_stack);
+	if (result) {
+		kfree(nt);
+		return result;
+	}
+
+	result = pid_alloc_thread(&tid);
+	if (result) {
+		as_release_thread_stack(as, nt->nt_stack);
+		kfree(nt);
+		return result;
+	}
+
+	result = thread_fork(curthread->t_name, NULL,
+			     thread_create_newthread, nt, tid);
+	if (result) {
+		pid_unalloc(tid);
+		as_release_thread_stack(as, nt->nt_stack);
+		kfree(nt);
+		return result;
+	}
+
+	*retval = tid;
+	return 0;
+}
+
+/*
+ * sys_thread_exit
+ *
+ * Like _exit, but only for the calling thread: CODE goes to whoever
+ * joins us, and the process's exit status is left alone.
+ */
+__DEAD
+void
+sys_thread_exit(int code)
+{
+	proc_thread_exit(_MKWAIT_EXIT(code));
+	thread_exit();
+}
+
+/*
+ * sys_thread_join
+ * pass this off to the pid code too.
+ */
+int
+sys_thread_join(pid_t tid, userptr_t retstatus)
+{
+	int status;
+	int result;
+
+	result = pid_join(tid, &status);
+	if (result) {
+		return result;
+	}
+
+	if (retstatus != NULL) {
+		result = copyout(&status, retstatus, sizeof(int));
+	}
+	return result;
+}
+
+/*
+ * sys_gettid
+ * the first thread in a process goes by the process id.
+ */
+int
+sys_gettid(pid_t *retval)
+{
+	if (curthread->t_tid != INVALID_PID) {
+		*retval = curthread->t_tid;
+	}
+	else {
+		*retval = curproc->p_pid;
+	}
+	return 0;
+}
+
 /*
  * sys_waitpid
  * just pass off the work to the pid code.
@@ -28,22 +28,27 @@
  */
 
 /*
- * Code for running a user program from the menu, and code for execv,
- * which have a lot in common.
+ * Code for running a user program from the menu, and code for execv
+ * and spawnv, which have a lot in common.
  */
 
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/spawn.h>
 #include <kern/unistd.h>
+#include <kern/wait.h>
 #include <limits.h>
 #include <lib.h>
 #include <proc.h>
+#include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <pid.h>
 #include <copyinout.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <vdso.h>
 #include <vfs.h>
 #include <openfile.h>
 #include <filetable.h>
@@ -55,34 +60,27 @@
  *
  * This is an abstraction that holds an argv while it's being shuffled
  * through the kernel during exec.
+ *
+ * The buffer is a run of separately allocated pages laid out exactly
+ * the way the argv will sit at the top of the new process's stack:
+ * the argv pointer array first, with the NULL at the end, then the
+ * strings. While the buffer is being filled the array holds offsets
+ * into the buffer; argbuf_copyout turns them into user addresses once
+ * it knows where the pages are going, and then gives the pages
+ * themselves to the new address space, so the strings are copied
+ * just once on the way through.
+ *
+ * The whole thing, pointers included, is limited to ARG_MAX bytes.
  */
-struct argbuf {
-	char *data;
-	size_t len;
-	size_t max;
-	int nargs;
-	bool tooksem;
-};
 
-/*
- * Throttle to limit the number of processes in exec at once. Or,
- * rather, the number trying to use large exec buffers at once. See
- * design notes for the rationale.
- */
-#define EXEC_BIGBUF_THROTTLE	1
-static struct semaphore *execthrottle;
+#define ARGBUF_MAXPAGES	(ARG_MAX / PAGE_SIZE)
 
-/*
- * Set things up.
- */
-void
-exec_bootstrap(void)
-{
-	execthrottle = sem_create("exec", EXEC_BIGBUF_THROTTLE);
-	if (execthrottle == NULL) {
-		panic("Cannot create exec throttle semaphore\n");
-	}
-}
+struct argbuf {
+	vaddr_t pages[ARGBUF_MAXPAGES];	/* kernel addresses of the pages */
+	unsigned npages;		/* number of pages allocated */
+	size_t len;			/* bytes used, array and strings */
+	int nargs;			/* number of strings */
+};
 
 /*
  * Initialize an argv buffer.
@@ -91,48 +89,72 @@ static
 void
 argbuf_init(struct argbuf *buf)
 {
-	buf->data = NULL;
+	buf->npages = 0;
 	buf->len = 0;
-	buf->max = 0;
 	buf->nargs = 0;
-	buf->tooksem = false;
 }
 
 /*
- * Clean up an argv buffer when done.
+ * Clean up an argv buffer when done. Pages that argbuf_copyout has
+ * handed to a process aren't ours any more and are not in the array.
  */
 static
 void
 argbuf_cleanup(struct argbuf *buf)
 {
-	if (buf->data != NULL) {
-		kfree(buf->data);
-		buf->data = NULL;
+	unsigned i;
+
+	for (i=0; i<buf->npages; i++) {
+		free_kpages(buf->pages[i]);
 	}
+	buf->npages = 0;
 	buf->len = 0;
-	buf->max = 0;
 	buf->nargs = 0;
-	if (buf->tooksem) {
-		V(execthrottle);
-		buf->tooksem = false;
-	}
 }
 
 /*
- * Allocate the memory for an argv buffer.
+ * Add another page to an argv buffer.
  */
 static
 int
-argbuf_allocate(struct argbuf *buf, size_t size)
+argbuf_grow(struct argbuf *buf)
 {
-	buf->data = kmalloc(size);
-	if (buf->data == NULL) {
+	vaddr_t page;
+
+	if (buf->npages == ARGBUF_MAXPAGES) {
+		return E2BIG;
+	}
+	page = alloc_kpages(1);
+	if (page == 0) {
 		return ENOMEM;
 	}
-	buf->max = size;
+	buf->pages[buf->npages++] = page;
 	return 0;
 }
 
+/*
+ * Kernel address of the byte at offset POS in an argv buffer, which
+ * must already have been allocated.
+ */
+static
+void *
+argbuf_ptr(struct argbuf *buf, size_t pos)
+{
+	KASSERT(pos < buf->npages * PAGE_SIZE);
+	return (void *)(buf->pages[pos / PAGE_SIZE] + pos % PAGE_SIZE);
+}
+
+/*
+ * The slot for argv[NUM] in an argv buffer. Slots are aligned and so
+ * never cross a page boundary.
+ */
+static
+userptr_t *
+argbuf_slot(struct argbuf *buf, int num)
+{
+	return argbuf_ptr(buf, num * sizeof(userptr_t));
+}
+
 /*
  * Prepare an argv buffer for runprogram, using a kernel pointer.
  *
@@ -148,107 +170,120 @@ argbuf_fromkernel(struct argbuf *buf, const char *progname)
 
 	len = strlen(progname) + 1;
 
-	result = argbuf_allocate(buf, len);
+	/* progname comes from the menu and is well under a page */
+	KASSERT(2 * sizeof(userptr_t) + len <= PAGE_SIZE);
+
+	result = argbuf_grow(buf);
 	if (result) {
 		return result;
 	}
-	strcpy(buf->data, progname);
-	buf->len = len;
 	buf->nargs = 1;
+	buf->len = 2 * sizeof(userptr_t);
+	*argbuf_slot(buf, 0) = (userptr_t)buf->len;
+	*argbuf_slot(buf, 1) = NULL;
+	strcpy(argbuf_ptr(buf, buf->len), progname);
+	buf->len += len;
 
 	return 0;
 }
 
 /*
- * Copy an argv array into kernel space, using an argvdata buffer.
+ * Copy one argument string from user space onto the end of an argv
+ * buffer, adding pages as needed. copyinstr fails with ENAMETOOLONG
+ * after filling the space it was given, so when a string runs off the
+ * end of a page we just pick it up again at the start of the next.
  */
 static
 int
-argbuf_copyin(struct argbuf *buf, userptr_t uargv)
+argbuf_copyinstr(struct argbuf *buf, userptr_t ustr)
 {
-	userptr_t thisarg;
-	size_t thisarglen;
+	size_t room, thisarglen;
 	int result;
 
-	/* loop through the argv, grabbing each arg string */
-	buf->nargs = 0;
 	while (1) {
-		/*
-		 * First, grab the pointer at argv.
-		 * (argv is incremented at the end of the loop)
-		 */
-		result = copyin(uargv, &thisarg, sizeof(userptr_t));
-		if (result) {
-			return result;
-		}
-
-		/* If we got NULL, we're at the end of the argv. */
-		if (thisarg == NULL) {
-			break;
+		if (buf->len == buf->npages * PAGE_SIZE) {
+			result = argbuf_grow(buf);
+			if (result) {
+				return result;
+			}
 		}
-
-		/* Use the pointer to fetch the argument string. */
-		result = copyinstr(thisarg, buf->data + buf->len,
-				   buf->max - buf->len, &thisarglen);
-		if (result == ENAMETOOLONG) {
-			return E2BIG;
+		room = buf->npages * PAGE_SIZE - buf->len;
+
+		result = copyinstr(ustr, argbuf_ptr(buf, buf->len), room,
+				   &thisarglen);
+		if (result == 0) {
+			/* thisarglen includes the \0 */
+			buf->len += thisarglen;
+			return 0;
 		}
-		else if (result) {
+		if (result != ENAMETOOLONG) {
 			return result;
 		}
-
-		/* Move ahead. Note: thisarglen includes the \0. */
-		buf->len += thisarglen;
-		uargv += sizeof(userptr_t);
-		buf->nargs++;
+		buf->len += room;
+		ustr += room;
 	}
-
-	return 0;
 }
 
 /*
  * Get an argv from user space.
+ *
+ * First fetch the pointers into the array slots, which tells us how
+ * many arguments there are and so where the strings start. Then go
+ * through again replacing each pointer with the offset its string
+ * gets copied to.
  */
 static
 int
 argbuf_fromuser(struct argbuf *buf, userptr_t uargv)
 {
+	userptr_t *slot;
+	userptr_t thisarg;
+	size_t pos;
+	int i;
 	int result;
 
-	/* try with a small buffer */
-	result = argbuf_allocate(buf, PAGE_SIZE);
-	if (result) {
-		return result;
-	}
+	buf->nargs = 0;
+	while (1) {
+		pos = buf->nargs * sizeof(userptr_t);
+		if (pos == buf->npages * PAGE_SIZE) {
+			result = argbuf_grow(buf);
+			if (result) {
+				return result;
+			}
+		}
 
-	/* do the copyin */
-	result = argbuf_copyin(buf, uargv);
-	if (result == E2BIG) {
-		/*
-		 * Try again with the full-size buffer. Just start
-		 * over instead of trying to keep the page we already
-		 * did; this is a bit inefficient but it's not that
-		 * important.
-		 */
-		argbuf_cleanup(buf);
-		argbuf_init(buf);
+		slot = argbuf_ptr(buf, pos);
+		result = copyin(uargv, slot, sizeof(userptr_t));
+		if (result) {
+			return result;
+		}
 
-		/* Wait on the semaphore, to throttle this allocation */
-		P(execthrottle);
-		buf->tooksem = true;
+		/* If we got NULL, we're at the end of the argv. */
+		if (*slot == NULL) {
+			break;
+		}
 
-		result = argbuf_allocate(buf, ARG_MAX);
+		uargv += sizeof(userptr_t);
+		buf->nargs++;
+	}
+	buf->len = (buf->nargs + 1) * sizeof(userptr_t);
+
+	for (i=0; i<buf->nargs; i++) {
+		slot = argbuf_slot(buf, i);
+		thisarg = *slot;
+		*slot = (userptr_t)buf->len;
+
+		result = argbuf_copyinstr(buf, thisarg);
 		if (result) {
 			return result;
 		}
-
-		result = argbuf_copyin(buf, uargv);
 	}
-	return result;
+
+	return 0;
 }
 
 /*
- * Copy an argv out of kernel space to user space.
+ * Put an argv on the top of the current process's new stack.
  *
  * Note: ustackp is an in/out argument.
  */
@@ -257,68 +292,47 @@ int
 argbuf_copyout(struct argbuf *buf, vaddr_t *ustackp,
 	       int *argc_ret, userptr_t *uargv_ret)
 {
-	vaddr_t ustack;
-	userptr_t ustringbase, uargvbase, uargv_i;
-	userptr_t thisarg;
-	size_t thisarglen;
-	size_t pos;
+	vaddr_t ubase;
+	userptr_t *slot;
+	unsigned i;
+	int j;
 	int result;
 
-	/* Begin the stack at the passed in top. */
-	ustack = *ustackp;
+	/* The pages go right under the (page-aligned) stack top. */
+	ubase = (*ustackp & PAGE_FRAME) - buf->npages * PAGE_SIZE;
 
-	/*
-	 * Allocate space.
-	 *
-	 * buf->pos is the amount of space used by the strings; put that
-	 * first, then align the stack, then make space for the argv
-	 * pointers. Allow an extra slot for the ending NULL.
-	 */
-
-	ustack -= buf->len;
-	ustack -= (ustack & (sizeof(void *) - 1));
-	ustringbase = (userptr_t)ustack;
-
-	ustack -= (buf->nargs + 1) * sizeof(userptr_t);
-	uargvbase = (userptr_t)ustack;
-
-	/* Now copy the data out. */
-	pos = 0;
-	uargv_i = uargvbase;
-	while (pos < buf->len) {
-		/* The user address of the string will be ustringbase + pos. */
-		thisarg = ustringbase + pos;
-
-		/* Place it in the argv array. */
-		result = copyout(&thisarg, uargv_i, sizeof(thisarg));
-		if (result) {
-			return result;
-		}
+	/* Turn the offsets in the argv array into user addresses. */
+	for (j=0; j<buf->nargs; j++) {
+		slot = argbuf_slot(buf, j);
+		*slot = (userptr_t)(ubase + (vaddr_t)*slot);
+	}
 
-		/* Push out the string. */
-		result = copyoutstr(buf->data + pos, thisarg,
-				    buf->len - pos, &thisarglen);
-		if (result) {
-			return result;
-		}
+	/* Don't let the rest of the last page out. */
+	bzero(argbuf_ptr(buf, buf->len), buf->npages * PAGE_SIZE - buf->len);
 
-		/* thisarglen includes the \0 */
-		pos += thisarglen;
-		uargv_i += sizeof(thisarg);
+	/*
+	 * Hand the pages to the address space if the VM system can
+	 * take them; otherwise copy them out.
+	 */
+	result = as_adopt_pages(proc_getas(), ubase, buf->pages,
+				buf->npages);
+	if (result == 0) {
+		buf->npages = 0;
 	}
-	/* Should have come out even... */
-	KASSERT(pos == buf->len);
-
-	/* Add the NULL. */
-	thisarg = NULL;
-	result = copyout(&thisarg, uargv_i, sizeof(userptr_t));
-	if (result) {
-		return result;
+	else {
+		for (i=0; i<buf->npages; i++) {
+			result = copyout((void *)buf->pages[i],
+					 (userptr_t)(ubase + i * PAGE_SIZE),
+					 PAGE_SIZE);
+			if (result) {
+				return result;
+			}
+		}
 	}
 
-	*ustackp = ustack;
+	*ustackp = ubase;
 	*argc_ret = buf->nargs;
-	*uargv_ret = uargvbase;
+	*uargv_ret = (userptr_t)ubase;
 	return 0;
 }
 
@@ -354,6 +368,7 @@ loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
 		kfree(newname);
 		return ENOMEM;
 	}
+	vdso_setpid(newvm, curproc->p_pid);
 
 	/* replace address spaces, and activate the new one */
 	oldvm = proc_setas(newvm);
@@ -557,9 +572,21 @@ sys_execv(userptr_t prog, userptr_t uargv)
 	char *path;
 	struct argbuf kargv;
 	vaddr_t entrypoint, stackptr;
+	unsigned nthreads;
 	int argc;
 	int result;
 
+	/*
+	 * We have no way to stop the other threads of a multithreaded
+	 * process, so don't pull the address space out from under them.
+	 */
+	lock_acquire(curproc->p_threadslock);
+	nthreads = threadarray_num(&curproc->p_threads);
+	lock_release(curproc->p_threadslock);
+	if (nthreads > 1) {
+		return EBUSY;
+	}
+
 	path = kmalloc(PATH_MAX);
 	if (!path) {
 		return ENOMEM;
@@ -611,3 +638,202 @@ sys_execv(userptr_t prog, userptr_t uargv)
 	panic("enter_new_process returned\n");
 	return EINVAL;
 }
+
+/*
+ * spawnv.
+ *
+ * This does the work of fork followed by execv without copying the
+ * parent's address space only to throw it away. The parent gathers
+ * up the path, the argv, and the file actions, makes a process with a
+ * copy of its file table (but no address space), and applies the
+ * file actions to that table. Then it starts the child's thread and
+ * waits for it to report back: the child has to load the executable
+ * itself, because loadexec works on the current process. If that
+ * fails, the error goes back to the parent, which collects the dead
+ * child; otherwise the parent returns the child's pid.
+ */
+
+struct spawninfo {
+	char *si_path;			/* executable; destroyed by loadexec */
+	struct argbuf *si_args;		/* argv, owned by the parent */
+	struct semaphore *si_done;	/* V'd once the child has loaded */
+	int si_result;			/* and this is how it went */
+};
+
+/*
+ * Apply the file actions to a new process's file table.
+ */
+static
+int
+spawn_fdactions(struct filetable *ft, const struct spawn_action *acts,
+		unsigned nacts)
+{
+	struct openfile *file, *oldfile;
+	unsigned i;
+	int result;
+
+	for (i=0; i<nacts; i++) {
+		switch (acts[i].sa_op) {
+		    case SPAWN_DUP2:
+			if (!filetable_okfd(ft, acts[i].sa_newfd)) {
+				return EBADF;
+			}
+			result = filetable_get(ft, acts[i].sa_fd, &file);
+			if (result) {
+				return result;
+			}
+			if (acts[i].sa_fd == acts[i].sa_newfd) {
+				filetable_put(ft, acts[i].sa_fd, file);
+				break;
+			}
+			openfile_incref(file);
+			filetable_put(ft, acts[i].sa_fd, file);
+			filetable_placeat(ft, file, acts[i].sa_newfd,
+					  &oldfile);
+			if (oldfile != NULL) {
+				openfile_decref(oldfile);
+			}
+			break;
+		    case SPAWN_CLOSE:
+			if (!filetable_okfd(ft, acts[i].sa_fd)) {
+				return EBADF;
+			}
+			filetable_placeat(ft, NULL, acts[i].sa_fd, &oldfile);
+			if (oldfile == NULL) {
+				return EBADF;
+			}
+			openfile_decref(oldfile);
+			break;
+		    default:
+			return EINVAL;
+		}
+	}
+	return 0;
+}
+
+/*
+ * The child side. Load the executable, copy out the argv, and tell
+ * the parent; then either go to user mode or quietly die.
+ */
+static
+void
+spawn_newthread(void *vsi, unsigned long junk)
+{
+	struct spawninfo *si = vsi;
+	vaddr_t entrypoint, stackptr;
+	userptr_t uargv;
+	int argc;
+	int result;
+
+	(void)junk;
+
+	result = loadexec(si->si_path, &entrypoint, &stackptr);
+	if (result == 0) {
+		result = argbuf_copyout(si->si_args, &stackptr,
+					&argc, &uargv);
+	}
+
+	/* si belongs to the parent and goes away once we V */
+	si->si_result = result;
+	V(si->si_done);
+
+	if (result) {
+		proc_exit(_MKWAIT_EXIT(255));
+	}
+
+	/* Warp to user mode. */
+	enter_new_process(argc, uargv, NULL /*uenv*/, stackptr, entrypoint);
+
+	/* enter_new_process does not return. */
+	panic("enter_new_process returned\n");
+}
+
+int
+sys_spawnv(userptr_t prog, userptr_t uargv, userptr_t uacts, int nacts,
+	   pid_t *retval)
+{
+	struct spawninfo si;
+	struct argbuf kargv;
+	struct spawn_action *acts;
+	struct proc *newproc;
+	pid_t pid, junkpid;
+	int status;
+	int result;
+
+	if (nacts < 0 || nacts > SPAWN_MAXACTIONS) {
+		return EINVAL;
+	}
+
+	si.si_path = kmalloc(PATH_MAX);
+	if (si.si_path == NULL) {
+		return ENOMEM;
+	}
+	result = copyinstr(prog, si.si_path, PATH_MAX, NULL);
+	if (result) {
+		kfree(si.si_path);
+		return result;
+	}
+
+	acts = kmalloc(nacts * sizeof(*acts));
+	if (acts == NULL) {
+		kfree(si.si_path);
+		return ENOMEM;
+	}
+	result = copyin(uacts, acts, nacts * sizeof(*acts));
+	if (result) {
+		goto fail_acts;
+	}
+
+	argbuf_init(&kargv);
+	result = argbuf_fromuser(&kargv, uargv);
+	if (result) {
+		goto fail_args;
+	}
+
+	si.si_args = &kargv;
+	si.si_result = 0;
+	si.si_done = sem_create("spawn", 0);
+	if (si.si_done == NULL) {
+		result = ENOMEM;
+		goto fail_args;
+	}
+
+	result = proc_spawn(&newproc);
+	if (result) {
+		goto fail_sem;
+	}
+	pid = newproc->p_pid;
+
+	result = spawn_fdactions(newproc->p_filetable, acts, nacts);
+	if (result) {
+		proc_unfork(newproc);
+		goto fail_sem;
+	}
+
+	result = thread_fork(curthread->t_name, newproc,
+			     spawn_newthread, &si, 0);
+	if (result) {
+		proc_unfork(newproc);
+		goto fail_sem;
+	}
+
+	/* wait for the child to load */
+	P(si.si_done);
+	result = si.si_result;
+	if (result) {
+		/* it's exiting; collect it so it doesn't hang around */
+		pid_wait(pid, &status, 0, &junkpid);
+	}
+	else {
+		*retval = pid;
+	}
+
+ fail_sem:
+	sem_destroy(si.si_done);
+ fail_args:
+	argbuf_cleanup(&kargv);
+ fail_acts:
+	kfree(acts);
+	kfree(si.si_path);
+	return result;
+}
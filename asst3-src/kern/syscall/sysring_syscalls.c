@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Batched system calls: sysring_enter.
+ *
+ * User code queues requests in a struct sysring in its own memory
+ * (see <kern/sysring.h>) and then makes one trap to run them all.
+ * We copy the entries in a chunk at a time, run each one through the
+ * same sys_* function the dispatcher would use, and copy the chunk
+ * back out with the results filled in. sr_head is written back after
+ * each chunk, so if we fail partway (bad ring pointer, say) user code
+ * can still see how far we got.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/syscall.h>
+#include <kern/sysring.h>
+#include <lib.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/* Entries copied in and out at a time. */
+#define SYSRING_CHUNK	16
+
+/*
+ * Run one request. Returns an error code; the call's own result goes
+ * in *retval.
+ */
+static
+int
+sysring_run(const struct sysring_entry *sre, int arg0, int *retval)
+{
+	int err;
+
+	*retval = 0;
+	switch (sre->sre_callno) {
+	    case SYS_open:
+		err = sys_open((const_userptr_t)arg0, sre->sre_args[1],
+			       sre->sre_args[2], retval);
+		break;
+	    case SYS_dup2:
+		err = sys_dup2(arg0, sre->sre_args[1], retval);
+		break;
+	    case SYS_close:
+		err = sys_close(arg0);
+		break;
+	    case SYS_read:
+		err = sys_read(arg0, (userptr_t)sre->sre_args[1],
+			       sre->sre_args[2], retval);
+		break;
+	    case SYS_write:
+		err = sys_write(arg0, (userptr_t)sre->sre_args[1],
+				sre->sre_args[2], retval);
+		break;
+	    case SYS_fstat:
+		err = sys_fstat(arg0, (userptr_t)sre->sre_args[1]);
+		break;
+	    default:
+		err = ENOSYS;
+		break;
+	}
+	return err;
+}
+
+/*
+ * sysring_enter: run every queued entry in the ring at RINGPTR.
+ * Returns the number of entries run.
+ *
+ * An entry with SYSRING_LASTFD set takes its first argument from the
+ * result of the last open or dup2 run by this call. If that failed,
+ * the entry fails the same way without being run, so the rest of an
+ * open/read/close chain is skipped when the open fails. With no open
+ * or dup2 before it, a SYSRING_LASTFD entry fails with EBADF.
+ */
+int
+sys_sysring_enter(userptr_t ringptr, int *retval)
+{
+	struct sysring ring;
+	struct sysring_entry sre[SYSRING_CHUNK];
+	userptr_t entries;
+	unsigned pending, slot, n, i;
+	int lastfd, lastfderr;
+	int done;
+	int err;
+
+	err = copyin(ringptr, &ring, sizeof(ring));
+	if (err) {
+		return err;
+	}
+	if (ring.sr_size == 0 || ring.sr_size > SYSRING_MAXSIZE ||
+	    (ring.sr_size & (ring.sr_size - 1)) != 0) {
+		return EINVAL;
+	}
+	pending = ring.sr_tail - ring.sr_head;
+	if (pending > ring.sr_size) {
+		return EINVAL;
+	}
+
+	entries = ringptr + sizeof(struct sysring);
+	lastfd = -1;
+	lastfderr = EBADF;
+	done = 0;
+
+	while (pending > 0) {
+		/* Don't let a chunk wrap past the end of the ring. */
+		slot = ring.sr_head & (ring.sr_size - 1);
+		n = pending;
+		if (n > SYSRING_CHUNK) {
+			n = SYSRING_CHUNK;
+		}
+		if (n > ring.sr_size - slot) {
+			n = ring.sr_size - slot;
+		}
+
+		err = copyin(entries + slot * sizeof(sre[0]), sre,
+			     n * sizeof(sre[0]));
+		if (err) {
+			return err;
+		}
+
+		for (i=0; i<n; i++) {
+			if (sre[i].sre_flags & SYSRING_LASTFD) {
+				if (lastfderr) {
+					sre[i].sre_retval = 0;
+					sre[i].sre_errno = lastfderr;
+					continue;
+				}
+				err = sysring_run(&sre[i], lastfd,
+						  &sre[i].sre_retval);
+			}
+			else {
+				err = sysring_run(&sre[i], sre[i].sre_args[0],
+						  &sre[i].sre_retval);
+			}
+			sre[i].sre_errno = err;
+			if (sre[i].sre_callno == SYS_open ||
+			    sre[i].sre_callno == SYS_dup2) {
+				lastfd = sre[i].sre_retval;
+				lastfderr = err;
+			}
+		}
+
+		err = copyout(sre, entries + slot * sizeof(sre[0]),
+			      n * sizeof(sre[0]));
+		if (err) {
+			return err;
+		}
+		ring.sr_head += n;
+		err = copyout(&ring.sr_head, ringptr, sizeof(ring.sr_head));
+		if (err) {
+			return err;
+		}
+		pending -= n;
+		done += n;
+	}
+
+	*retval = done;
+	return 0;
+}
@@ -33,6 +33,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <clock.h>
 #include <thread.h>
 #include <synch.h>
 #include <vm.h> /* for PAGE_SIZE */
@@ -379,3 +380,166 @@ kmalloctest4(int nargs, char **args)
 	kprintf("Multipage kmalloc test done\n");
 	return 0;
 }
+
+////////////////////////////////////////////////////////////
+// km5
+
+/*
+ * Multi-cpu kmalloc benchmark. Runs a pile of threads that each keep
+ * a small working set of subpage blocks of assorted sizes and
+ * repeatedly free one and allocate a replacement, for a fixed amount
+ * of wall-clock time. Each block is tagged with its owner and slot
+ * so that a block handed out twice shows up. We report the total
+ * number of kmalloc/kfree pairs per second and the smallest and
+ * largest per-thread share.
+ *
+ * This mostly exercises the per-cpu magazines (see "kh" afterwards
+ * for their hit rates); run it under several "cpus" settings in
+ * sys161.conf to see how it scales.
+ */
+
+#define KM5_NTHREADS	16	/* default number of threads */
+#define KM5_SECONDS	2	/* default run time */
+#define KM5_SLOTS	32	/* blocks held per thread */
+#define NUM_KM5_SIZES	8
+
+static const unsigned km5_sizes[NUM_KM5_SIZES] = {
+	12, 24, 40, 100, 200, 480, 1000, 2000
+};
+
+static volatile bool km5_go;
+static volatile bool km5_stop;
+static unsigned long *km5_counts;
+static struct semaphore *km5_donesem;
+
+static
+void
+km5_check(uint32_t *ptr, unsigned long num, unsigned slot)
+{
+	if (ptr[0] != (num << 16 | slot)) {
+		panic("kmalloctest5: thread %lu slot %u: block %p "
+		      "was clobbered\n", num, slot, ptr);
+	}
+}
+
+static
+void
+km5_thread(void *junk, unsigned long num)
+{
+	uint32_t *ptrs[KM5_SLOTS];
+	unsigned long count;
+	uint32_t seed;
+	unsigned slot;
+
+	(void)junk;
+
+	for (slot=0; slot<KM5_SLOTS; slot++) {
+		ptrs[slot] = NULL;
+	}
+	seed = num + 1;
+
+	/* Wait for everyone to be ready; yield so the starter can run. */
+	while (!km5_go) {
+		thread_yield();
+	}
+
+	count = 0;
+	while (!km5_stop) {
+		seed = seed * 1103515245 + 12345;
+		slot = (seed >> 16) % KM5_SLOTS;
+		if (ptrs[slot] != NULL) {
+			km5_check(ptrs[slot], num, slot);
+			kfree(ptrs[slot]);
+		}
+		ptrs[slot] = kmalloc(km5_sizes[(seed >> 8) % NUM_KM5_SIZES]);
+		if (ptrs[slot] == NULL) {
+			panic("kmalloctest5: thread %lu: kmalloc failed\n",
+			      num);
+		}
+		ptrs[slot][0] = num << 16 | slot;
+		count++;
+	}
+
+	for (slot=0; slot<KM5_SLOTS; slot++) {
+		if (ptrs[slot] != NULL) {
+			km5_check(ptrs[slot], num, slot);
+			kfree(ptrs[slot]);
+		}
+	}
+
+	km5_counts[num] = count;
+	V(km5_donesem);
+}
+
+int
+kmalloctest5(int nargs, char **args)
+{
+	unsigned long total, min, max;
+	unsigned nthreads, i;
+	int seconds;
+	int result;
+
+	if (nargs > 3) {
+		kprintf("Usage: km5 [threads] [seconds]\n");
+		return EINVAL;
+	}
+	nthreads = nargs > 1 ? (unsigned)atoi(args[1]) : KM5_NTHREADS;
+	seconds = nargs > 2 ? atoi(args[2]) : KM5_SECONDS;
+	if (nthreads == 0 || seconds <= 0) {
+		kprintf("Usage: km5 [threads] [seconds]\n");
+		return EINVAL;
+	}
+
+	if (km5_donesem == NULL) {
+		km5_donesem = sem_create("km5_donesem", 0);
+		if (km5_donesem == NULL) {
+			panic("kmalloctest5: sem_create failed\n");
+		}
+	}
+	km5_counts = kmalloc(nthreads * sizeof(km5_counts[0]));
+	if (km5_counts == NULL) {
+		return ENOMEM;
+	}
+
+	kprintf("Starting kmalloc benchmark: %u threads, %d seconds\n",
+		nthreads, seconds);
+
+	km5_go = false;
+	km5_stop = false;
+	for (i=0; i<nthreads; i++) {
+		km5_counts[i] = 0;
+		result = thread_fork("kmalloctest5", NULL,
+				     km5_thread, NULL, i);
+		if (result) {
+			panic("kmalloctest5: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	km5_go = true;
+	clocksleep(seconds);
+	km5_stop = true;
+
+	for (i=0; i<nthreads; i++) {
+		P(km5_donesem);
+	}
+
+	total = 0;
+	min = max = km5_counts[0];
+	for (i=0; i<nthreads; i++) {
+		total += km5_counts[i];
+		if (km5_counts[i] < min) {
+			min = km5_counts[i];
+		}
+		if (km5_counts[i] > max) {
+			max = km5_counts[i];
+		}
+	}
+	kfree(km5_counts);
+	km5_counts = NULL;
+
+	kprintf("kmalloctest5: %lu kmalloc/kfree pairs/sec, "
+		"per-thread min %lu max %lu\n", total / seconds, min, max);
+	kprintf("kmalloctest5: passed\n");
+	return 0;
+}
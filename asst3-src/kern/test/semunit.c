@@ -59,7 +59,7 @@
 // support code
 
 static unsigned waiters_running = 0;
-static struct spinlock waiters_lock = SPINLOCK_INITIALIZER;
+static struct spinlock waiters_lock = SPINLOCK_INITIALIZER("waiters_lock");
 
 static
 void
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Spinlock contention benchmark.
+ *
+ * Runs a pile of threads that do nothing but acquire a lock, touch a
+ * shared counter, spin briefly, and release it, for a fixed amount of
+ * wall-clock time. This is done once with an ordinary test-and-set
+ * spinlock and once with a ticket lock. For each we report the total
+ * number of acquisitions (throughput) and the smallest and largest
+ * per-thread share (fairness; a starved thread shows up as a tiny
+ * minimum).
+ *
+ * The interesting numbers come from running it under several CPU
+ * counts; change the "cpus" line in sys161.conf (1 through 32) and
+ * rerun.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <spinlock.h>
+#include <ticketlock.h>
+#include <test.h>
+
+#define SPB_NTHREADS	32	/* default number of threads */
+#define SPB_SECONDS	2	/* default run time per lock type */
+#define SPB_HOLDLOOPS	20	/* busy-work while holding the lock */
+
+#define SPB_SPINLOCK	0
+#define SPB_TICKETLOCK	1
+
+static struct spinlock spb_spinlock = SPINLOCK_INITIALIZER("spb_spinlock");
+static struct ticketlock spb_ticketlock = TICKETLOCK_INITIALIZER("spb_ticketlock");
+
+static volatile bool spb_go;
+static volatile bool spb_stop;
+static volatile unsigned long spb_shared;
+static unsigned long *spb_counts;
+static int spb_kind;
+static struct semaphore *spb_donesem;
+
+static
+void
+spb_thread(void *junk, unsigned long num)
+{
+	unsigned long count;
+	volatile unsigned i;
+
+	(void)junk;
+
+	/* Wait for everyone to be ready; yield so the starter can run. */
+	while (!spb_go) {
+		thread_yield();
+	}
+
+	count = 0;
+	while (!spb_stop) {
+		if (spb_kind == SPB_SPINLOCK) {
+			spinlock_acquire(&spb_spinlock);
+		}
+		else {
+			ticketlock_acquire(&spb_ticketlock);
+		}
+
+		spb_shared++;
+		for (i=0; i<SPB_HOLDLOOPS; i++);
+
+		if (spb_kind == SPB_SPINLOCK) {
+			spinlock_release(&spb_spinlock);
+		}
+		else {
+			ticketlock_release(&spb_ticketlock);
+		}
+		count++;
+	}
+
+	spb_counts[num] = count;
+	V(spb_donesem);
+}
+
+static
+int
+spb_run(int kind, const char *name, unsigned nthreads, int seconds)
+{
+	unsigned long total, min, max;
+	unsigned i;
+	int result;
+
+	spb_kind = kind;
+	spb_go = false;
+	spb_stop = false;
+	spb_shared = 0;
+
+	for (i=0; i<nthreads; i++) {
+		spb_counts[i] = 0;
+		result = thread_fork("spinbench", NULL, spb_thread, NULL, i);
+		if (result) {
+			panic("spinbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	spb_go = true;
+	clocksleep(seconds);
+	spb_stop = true;
+
+	for (i=0; i<nthreads; i++) {
+		P(spb_donesem);
+	}
+
+	total = 0;
+	min = max = spb_counts[0];
+	for (i=0; i<nthreads; i++) {
+		total += spb_counts[i];
+		if (spb_counts[i] < min) {
+			min = spb_counts[i];
+		}
+		if (spb_counts[i] > max) {
+			max = spb_counts[i];
+		}
+	}
+	if (total != spb_shared) {
+		kprintf("spinbench: %s lost updates (%lu counted, %lu seen)\n",
+			name, total, spb_shared);
+		return EINVAL;
+	}
+
+	kprintf("spinbench: %-10s %8lu acquires/sec, "
+		"per-thread min %lu max %lu\n",
+		name, total / seconds, min, max);
+	return 0;
+}
+
+int
+spinbench(int nargs, char **args)
+{
+	unsigned nthreads;
+	int seconds;
+	int result;
+
+	if (nargs > 3) {
+		kprintf("Usage: spb [threads] [seconds]\n");
+		return EINVAL;
+	}
+	nthreads = nargs > 1 ? (unsigned)atoi(args[1]) : SPB_NTHREADS;
+	seconds = nargs > 2 ? atoi(args[2]) : SPB_SECONDS;
+	if (nthreads == 0 || seconds <= 0) {
+		kprintf("Usage: spb [threads] [seconds]\n");
+		return EINVAL;
+	}
+
+	if (spb_donesem == NULL) {
+		spb_donesem = sem_create("spb_donesem", 0);
+		if (spb_donesem == NULL) {
+			panic("spinbench: sem_create failed\n");
+		}
+	}
+	spb_counts = kmalloc(nthreads * sizeof(spb_counts[0]));
+	if (spb_counts == NULL) {
+		return ENOMEM;
+	}
+
+	kprintf("Starting spinlock benchmark: %u threads, %d seconds each\n",
+		nthreads, seconds);
+
+	result = spb_run(SPB_SPINLOCK, "spinlock", nthreads, seconds);
+	if (result == 0) {
+		result = spb_run(SPB_TICKETLOCK, "ticketlock",
+				 nthreads, seconds);
+	}
+
+	kfree(spb_counts);
+	spb_counts = NULL;
+
+	kprintf("Spinlock benchmark done.\n");
+	return result;
+}
@@ -34,6 +34,8 @@
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <poll.h>
+#include <vdso.h>
 
 /*
  * Time handling.
@@ -103,6 +105,8 @@ hardclock(void)
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
+	poll_tick();
+	vdso_tick();
 	thread_yield();
 }
 
@@ -37,7 +37,7 @@
 #include <spinlock.h>
 #include <hangman.h>
 
-static struct spinlock hangman_lock = SPINLOCK_INITIALIZER;
+static struct spinlock hangman_lock = SPINLOCK_INITIALIZER("hangman_lock");
 
 /*
  * Look for a path through the waits-for graph that goes from START to
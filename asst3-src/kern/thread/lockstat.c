@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Lock contention statistics. See lockstat.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <lockstat.h>
+
+/* Set from the menu; tested inline by the LOCKSTAT_* macros. */
+volatile bool lockstat_enabled;
+
+/*
+ * The list of locks that have been counted. This can't be protected
+ * with a struct spinlock, since then taking the list lock would
+ * recurse into here; use a bare spinlock word and splhigh instead.
+ */
+static volatile spinlock_data_t lockstat_listlock = SPINLOCK_DATA_INITIALIZER;
+static struct lockstat *lockstat_list;
+
+/* What the menu gets back: a copy, so locks can come and go meanwhile. */
+struct lockstat_snap {
+	char s_name[32];
+	const void *s_addr;
+	unsigned s_acquires;
+	unsigned s_contended;
+	uint64_t s_spins;
+	uint64_t s_waitnsecs;
+	uint32_t s_maxholdnsecs;
+};
+
+static
+int
+lockstat_list_lock(void)
+{
+	int spl;
+
+	spl = splhigh();
+	while (spinlock_data_get(&lockstat_listlock) != 0 ||
+	       spinlock_data_testandset(&lockstat_listlock) != 0) {
+		/* spin */
+	}
+	membar_store_any();
+	return spl;
+}
+
+static
+void
+lockstat_list_unlock(int spl)
+{
+	membar_any_store();
+	spinlock_data_set(&lockstat_listlock, 0);
+	splx(spl);
+}
+
+static
+uint64_t
+timespec_nsecs(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Set up the counters for a lock. NAME must last as long as the lock
+ * does (lock names do).
+ */
+void
+lockstat_init(struct lockstat *ls, const char *name)
+{
+	ls->ls_name = name;
+	ls->ls_acquires = 0;
+	ls->ls_contended = 0;
+	ls->ls_spins = 0;
+	ls->ls_waitnsecs = 0;
+	ls->ls_maxholdnsecs = 0;
+	ls->ls_holdstart.tv_sec = 0;
+	ls->ls_holdstart.tv_nsec = 0;
+	ls->ls_registered = false;
+	ls->ls_next = ls->ls_prev = NULL;
+}
+
+/*
+ * The lock is going away; take it off the list.
+ */
+void
+lockstat_cleanup(struct lockstat *ls)
+{
+	int spl;
+
+	spl = lockstat_list_lock();
+	if (ls->ls_registered) {
+		if (ls->ls_prev != NULL) {
+			ls->ls_prev->ls_next = ls->ls_next;
+		}
+		else {
+			lockstat_list = ls->ls_next;
+		}
+		if (ls->ls_next != NULL) {
+			ls->ls_next->ls_prev = ls->ls_prev;
+		}
+		ls->ls_registered = false;
+	}
+	lockstat_list_unlock(spl);
+}
+
+/*
+ * Called on each trip around the wait loop of a contended acquire.
+ * The first trip starts the clock.
+ */
+void
+lockstat_wait(struct lockstat *ls, struct lockstat_waiter *w)
+{
+	(void)ls;
+
+	if (w->w_spins == 0) {
+		gettime(&w->w_start);
+	}
+	w->w_spins++;
+}
+
+/*
+ * Called once the lock is ours, so the lock itself protects LS.
+ */
+void
+lockstat_acquired(struct lockstat *ls, struct lockstat_waiter *w)
+{
+	struct timespec now, waited;
+	int spl;
+
+	if (!ls->ls_registered) {
+		spl = lockstat_list_lock();
+		if (!ls->ls_registered) {
+			ls->ls_prev = NULL;
+			ls->ls_next = lockstat_list;
+			if (lockstat_list != NULL) {
+				lockstat_list->ls_prev = ls;
+			}
+			lockstat_list = ls;
+			ls->ls_registered = true;
+		}
+		lockstat_list_unlock(spl);
+	}
+
+	gettime(&now);
+
+	ls->ls_acquires++;
+	if (w->w_spins > 0) {
+		timespec_sub(&now, &w->w_start, &waited);
+		ls->ls_contended++;
+		ls->ls_spins += w->w_spins;
+		ls->ls_waitnsecs += timespec_nsecs(&waited);
+	}
+	ls->ls_holdstart = now;
+}
+
+/*
+ * Called just before the lock is given up, while still held.
+ */
+void
+lockstat_released(struct lockstat *ls)
+{
+	struct timespec now, held;
+	uint64_t nsecs;
+
+	if (ls->ls_holdstart.tv_sec == 0 && ls->ls_holdstart.tv_nsec == 0) {
+		/* acquired before collection was turned on */
+		return;
+	}
+
+	gettime(&now);
+	timespec_sub(&now, &ls->ls_holdstart, &held);
+	nsecs = timespec_nsecs(&held);
+	if (nsecs > ls->ls_maxholdnsecs) {
+		ls->ls_maxholdnsecs = nsecs > 0xffffffff ? 0xffffffff : nsecs;
+	}
+	ls->ls_holdstart.tv_sec = 0;
+	ls->ls_holdstart.tv_nsec = 0;
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Turn collection on or off.
+ */
+void
+lockstat_enable(bool on)
+{
+	lockstat_enabled = on;
+	membar_any_any();
+}
+
+/*
+ * Zero the counters of every lock on the list. This races with locks
+ * being counted on other CPUs, which is fine for statistics.
+ */
+void
+lockstat_reset(void)
+{
+	struct lockstat *ls;
+	int spl;
+
+	spl = lockstat_list_lock();
+	for (ls = lockstat_list; ls != NULL; ls = ls->ls_next) {
+		ls->ls_acquires = 0;
+		ls->ls_contended = 0;
+		ls->ls_spins = 0;
+		ls->ls_waitnsecs = 0;
+		ls->ls_maxholdnsecs = 0;
+	}
+	lockstat_list_unlock(spl);
+}
+
+/*
+ * Print the NUM most contended locks, ordered by contended
+ * acquisitions and then by time spent waiting.
+ *
+ * We can't print (or allocate) while holding the list lock, so
+ * allocate the snapshot first, fill it by insertion under the lock,
+ * and print it afterwards.
+ */
+static
+bool
+lockstat_worse(const struct lockstat *ls, const struct lockstat_snap *s)
+{
+	if (ls->ls_contended != s->s_contended) {
+		return ls->ls_contended > s->s_contended;
+	}
+	return ls->ls_waitnsecs > s->s_waitnsecs;
+}
+
+void
+lockstat_print(unsigned num)
+{
+	struct lockstat_snap *snap;
+	struct lockstat *ls;
+	unsigned i, j, nsnap, nlocks;
+	int spl;
+
+	if (num == 0) {
+		return;
+	}
+	snap = kmalloc(num * sizeof(*snap));
+	if (snap == NULL) {
+		kprintf("lockstat: out of memory\n");
+		return;
+	}
+
+	nsnap = nlocks = 0;
+	spl = lockstat_list_lock();
+	for (ls = lockstat_list; ls != NULL; ls = ls->ls_next) {
+		nlocks++;
+		if (ls->ls_acquires == 0) {
+			continue;
+		}
+		/* find where it goes */
+		for (i=0; i<nsnap; i++) {
+			if (lockstat_worse(ls, &snap[i])) {
+				break;
+			}
+		}
+		if (i == num) {
+			continue;
+		}
+		/* shift the rest down, dropping the last if full */
+		if (nsnap < num) {
+			nsnap++;
+		}
+		for (j=nsnap-1; j>i; j--) {
+			snap[j] = snap[j-1];
+		}
+		snprintf(snap[i].s_name, sizeof(snap[i].s_name), "%s",
+			 ls->ls_name);
+		snap[i].s_addr = ls;
+		snap[i].s_acquires = ls->ls_acquires;
+		snap[i].s_contended = ls->ls_contended;
+		snap[i].s_spins = ls->ls_spins;
+		snap[i].s_waitnsecs = ls->ls_waitnsecs;
+		snap[i].s_maxholdnsecs = ls->ls_maxholdnsecs;
+	}
+	lockstat_list_unlock(spl);
+
+	kprintf("lockstat: %u locks tracked, collection %s\n", nlocks,
+		lockstat_enabled ? "on" : "off");
+	kprintf("%-20s %-10s %10s %10s %12s %14s %12s\n", "name", "stats",
+		"acquires", "contended", "spins", "wait(ns)", "maxhold(ns)");
+	for (i=0; i<nsnap; i++) {
+		kprintf("%-20s %-10p %10u %10u %12llu %14llu %12u\n",
+			snap[i].s_name, snap[i].s_addr, snap[i].s_acquires,
+			snap[i].s_contended,
+			(unsigned long long)snap[i].s_spins,
+			(unsigned long long)snap[i].s_waitnsecs,
+			snap[i].s_maxholdnsecs);
+	}
+
+	kfree(snap);
+}
@@ -45,13 +45,17 @@
 
 
 /*
- * Initialize spinlock.
+ * Initialize spinlock. NAME is only used by lockstat and must last as
+ * long as the lock does; spinlock_init passes the lock expression.
  */
 void
-spinlock_init(struct spinlock *splk)
+spinlock_init_named(struct spinlock *splk, const char *name)
 {
+	(void)name;
+
 	spinlock_data_set(&splk->splk_lock, 0);
 	splk->splk_holder = NULL;
+	LOCKSTAT_INIT(&splk->splk_stat, name);
 	HANGMAN_LOCKABLEINIT(&splk->splk_hangman, "spinlock");
 }
 
@@ -63,6 +67,7 @@ spinlock_cleanup(struct spinlock *splk)
 {
 	KASSERT(splk->splk_holder == NULL);
 	KASSERT(spinlock_data_get(&splk->splk_lock) == 0);
+	LOCKSTAT_CLEANUP(&splk->splk_stat);
 }
 
 /*
@@ -76,6 +81,7 @@ void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+	LOCKSTAT_WAITER(lsw);
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -105,9 +111,11 @@ spinlock_acquire(struct spinlock *splk)
 		 * we don't.
 		 */
 		if (spinlock_data_get(&splk->splk_lock) != 0) {
+			LOCKSTAT_WAIT(&splk->splk_stat, &lsw);
 			continue;
 		}
 		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
+			LOCKSTAT_WAIT(&splk->splk_stat, &lsw);
 			continue;
 		}
 		break;
@@ -115,6 +123,7 @@ spinlock_acquire(struct spinlock *splk)
 
 	membar_store_any();
 	splk->splk_holder = mycpu;
+	LOCKSTAT_ACQUIRED(&splk->splk_stat, &lsw);
 
 	if (CURCPU_EXISTS()) {
 		HANGMAN_ACQUIRE(&curcpu->c_hangman, &splk->splk_hangman);
@@ -135,6 +144,7 @@ spinlock_release(struct spinlock *splk)
 		HANGMAN_RELEASE(&curcpu->c_hangman, &splk->splk_hangman);
 	}
 
+	LOCKSTAT_RELEASED(&splk->splk_stat);
 	splk->splk_holder = NULL;
 	membar_any_store();
 	spinlock_data_set(&splk->splk_lock, 0);
@@ -67,7 +67,7 @@ sem_create(const char *name, unsigned initial_count)
 		return NULL;
 	}
 
-	spinlock_init(&sem->sem_lock);
+	spinlock_init_named(&sem->sem_lock, sem->sem_name);
 	sem->sem_count = initial_count;
 
 	return sem;
@@ -162,8 +162,9 @@ lock_create(const char *name)
 		kfree(lock);
 		return NULL;
 	}
-	spinlock_init(&lock->lk_lock);
+	spinlock_init_named(&lock->lk_lock, lock->lk_name);
 	lock->lk_holder = NULL;
+	LOCKSTAT_INIT(&lock->lk_stat, lock->lk_name);
 
 	return lock;
 }
@@ -174,6 +175,7 @@ lock_destroy(struct lock *lock)
 	KASSERT(lock != NULL);
 
 	KASSERT(lock->lk_holder == NULL);
+	LOCKSTAT_CLEANUP(&lock->lk_stat);
 	spinlock_cleanup(&lock->lk_lock);
 	wchan_destroy(lock->lk_wchan);
 
@@ -184,6 +186,8 @@ lock_destroy(struct lock *lock)
 void
 lock_acquire(struct lock *lock)
 {
+	LOCKSTAT_WAITER(lsw);
+
 	DEBUGASSERT(lock != NULL);
 	KASSERT(curthread->t_in_interrupt == false);
 
@@ -195,9 +199,11 @@ lock_acquire(struct lock *lock)
 	KASSERT(lock->lk_holder != curthread);
 	while (lock->lk_holder != NULL) {
 		/* As in the semaphore. */
+		LOCKSTAT_WAIT(&lock->lk_stat, &lsw);
 		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
 	}
 	lock->lk_holder = curthread;
+	LOCKSTAT_ACQUIRED(&lock->lk_stat, &lsw);
 
 	/* Call this (atomically) once the lock is acquired */
 	HANGMAN_ACQUIRE(&curthread->t_hangman, &lock->lk_hangman);
@@ -213,6 +219,7 @@ lock_release(struct lock *lock)
 	spinlock_acquire(&lock->lk_lock);
 
 	KASSERT(lock->lk_holder == curthread);
+	LOCKSTAT_RELEASED(&lock->lk_stat);
 	lock->lk_holder = NULL;
 	wchan_wakeone(lock->lk_wchan, &lock->lk_lock);
 
@@ -264,7 +271,7 @@ cv_create(const char *name)
 		return NULL;
 	}
 
-	spinlock_init(&cv->cv_wchanlock);
+	spinlock_init_named(&cv->cv_wchanlock, cv->cv_name);
 	return cv;
 }
 
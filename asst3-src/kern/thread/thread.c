@@ -50,9 +50,12 @@
 #include <current.h>
 #include <synch.h>
 #include <addrspace.h>
+#include <vm.h>
 #include <mainbus.h>
 #include <vnode.h>
 #include <pid.h>
+#include <kmem.h>
+#include <trace.h>
 
 
 /* Magic number used as a guard value on kernel thread stacks. */
@@ -62,6 +65,7 @@
 struct wchan {
 	const char *wc_name;		/* name for this channel */
 	struct threadlist wc_threads;	/* list of waiting threads */
+	LOCKSTAT(wc_stat);		/* sleep statistics */
 };
 
 /* Master array of CPUs. */
@@ -72,6 +76,9 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/* Where thread structures come from. */
+static struct kmem_cache *thread_cache;
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -123,14 +130,14 @@ thread_create(const char *name)
 
 	DEBUGASSERT(name != NULL);
 
-	thread = kmalloc(sizeof(*thread));
+	thread = kmem_cache_alloc(thread_cache);
 	if (thread == NULL) {
 		return NULL;
 	}
 
 	thread->t_name = kstrdup(name);
 	if (thread->t_name == NULL) {
-		kfree(thread);
+		kmem_cache_free(thread_cache, thread);
 		return NULL;
 	}
 	thread->t_wchan_name = "NEW";
@@ -150,6 +157,10 @@ thread_create(const char *name)
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
+	/* User thread fields */
+	thread->t_tid = INVALID_PID;
+	thread->t_ustack = 0;
+
 	/* If you add to struct thread, be sure to initialize here */
 
 	return thread;
@@ -195,6 +206,7 @@ cpu_create(unsigned hardware_number)
 	if (result != 0) {
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
+	TRACE_CPUINIT(c->c_number);
 
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
 	c->c_curthread = thread_create(namebuf);
@@ -287,7 +299,7 @@ thread_destroy(struct thread *thread)
 	thread->t_wchan_name = "DESTROYED";
 
 	kfree(thread->t_name);
-	kfree(thread);
+	kmem_cache_free(thread_cache, thread);
 }
 
 /*
@@ -376,6 +388,12 @@ thread_bootstrap(void)
 {
 	cpuarray_init(&allcpus);
 
+	thread_cache = kmem_cache_create("thread", sizeof(struct thread),
+					 NULL, NULL);
+	if (thread_cache == NULL) {
+		panic("thread_bootstrap: Out of memory\n");
+	}
+
 	/*
 	 * Create the cpu structure for the bootup CPU, the one we're
 	 * currently running on. Assume the hardware number is 0; that
@@ -641,18 +659,28 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	 * lock to look at it, this should not be visible or matter.
 	 */
 
+	/*
+	 * Before really idling, use the time to zero pages for the VM
+	 * system (a page at a time, so we look at the runqueue again
+	 * between pages).
+	 */
+
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
 	do {
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
+			if (!vm_idle_zero()) {
+				cpu_idle();
+			}
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
 
+	TRACE(TRACE_SWITCH, (uint32_t)(uintptr_t)next, newstate);
+
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
 	 * curthread and it may not be, depending on how curthread and
@@ -981,6 +1009,7 @@ wchan_create(const char *name)
 	}
 	threadlist_init(&wc->wc_threads);
 	wc->wc_name = name;
+	LOCKSTAT_INIT(&wc->wc_stat, name);
 
 	return wc;
 }
@@ -992,6 +1021,7 @@ wchan_create(const char *name)
 void
 wchan_destroy(struct wchan *wc)
 {
+	LOCKSTAT_CLEANUP(&wc->wc_stat);
 	threadlist_cleanup(&wc->wc_threads);
 	kfree(wc);
 }
@@ -1006,6 +1036,8 @@ wchan_destroy(struct wchan *wc)
 void
 wchan_sleep(struct wchan *wc, struct spinlock *lk)
 {
+	LOCKSTAT_WAITER(lsw);
+
 	/* may not sleep in an interrupt handler */
 	KASSERT(!curthread->t_in_interrupt);
 
@@ -1015,8 +1047,15 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 	/* must not hold other spinlocks */
 	KASSERT(curcpu->c_spinlocks == 1);
 
+	/*
+	 * For lockstat purposes a sleep counts as a contended
+	 * "acquire" of the channel; the associated spinlock
+	 * protects the counters.
+	 */
+	LOCKSTAT_WAIT(&wc->wc_stat, &lsw);
 	thread_switch(S_SLEEP, wc, lk);
 	spinlock_acquire(lk);
+	LOCKSTAT_ACQUIRED(&wc->wc_stat, &lsw);
 }
 
 /*
@@ -1167,6 +1206,26 @@ ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 	spinlock_release(&target->c_ipi_lock);
 }
 
+/*
+ * Send a TLB shootdown IPI to all CPUs except the current one.
+ */
+unsigned
+ipi_tlbshootdown_broadcast(const struct tlbshootdown *mapping)
+{
+	unsigned i, n;
+	struct cpu *c;
+
+	n = 0;
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c != curcpu->c_self) {
+			ipi_tlbshootdown(c, mapping);
+			n++;
+		}
+	}
+	return n;
+}
+
 /*
  * Handle an incoming interprocessor interrupt.
  */
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <ticketlock.h>
+#include <membar.h>
+#include <current.h>	/* for curcpu */
+
+/*
+ * Ticket spinlocks.
+ */
+
+
+/*
+ * Initialize ticket lock. As with spinlocks, NAME is for lockstat.
+ */
+void
+ticketlock_init_named(struct ticketlock *tkl, const char *name)
+{
+	(void)name;
+
+	spinlock_data_set(&tkl->tkl_next, 0);
+	spinlock_data_set(&tkl->tkl_owner, 0);
+	tkl->tkl_holder = NULL;
+	LOCKSTAT_INIT(&tkl->tkl_stat, name);
+	HANGMAN_LOCKABLEINIT(&tkl->tkl_hangman, "ticketlock");
+}
+
+/*
+ * Clean up ticket lock.
+ */
+void
+ticketlock_cleanup(struct ticketlock *tkl)
+{
+	KASSERT(tkl->tkl_holder == NULL);
+	KASSERT(spinlock_data_get(&tkl->tkl_next) ==
+		spinlock_data_get(&tkl->tkl_owner));
+	LOCKSTAT_CLEANUP(&tkl->tkl_stat);
+}
+
+/*
+ * Get the lock.
+ *
+ * As with spinlocks, disable interrupts first. Then take a ticket
+ * and wait for our number to come up. The ticket counters are
+ * allowed to wrap around; only equality is ever tested.
+ */
+void
+ticketlock_acquire(struct ticketlock *tkl)
+{
+	struct cpu *mycpu;
+	spinlock_data_t ticket;
+	LOCKSTAT_WAITER(lsw);
+
+	splraise(IPL_NONE, IPL_HIGH);
+
+	/* this must work before curcpu initialization */
+	if (CURCPU_EXISTS()) {
+		mycpu = curcpu->c_self;
+		if (tkl->tkl_holder == mycpu) {
+			panic("Deadlock on ticketlock %p\n", tkl);
+		}
+		mycpu->c_spinlocks++;
+
+		HANGMAN_WAIT(&curcpu->c_hangman, &tkl->tkl_hangman);
+	}
+	else {
+		mycpu = NULL;
+	}
+
+	ticket = spinlock_data_fetchadd(&tkl->tkl_next, 1);
+	while (spinlock_data_get(&tkl->tkl_owner) != ticket) {
+		/* spin (read-only) */
+		LOCKSTAT_WAIT(&tkl->tkl_stat, &lsw);
+	}
+
+	membar_store_any();
+	tkl->tkl_holder = mycpu;
+	LOCKSTAT_ACQUIRED(&tkl->tkl_stat, &lsw);
+
+	if (CURCPU_EXISTS()) {
+		HANGMAN_ACQUIRE(&curcpu->c_hangman, &tkl->tkl_hangman);
+	}
+}
+
+/*
+ * Release the lock by serving the next ticket.
+ *
+ * Only the holder ever writes tkl_owner, so a plain increment is
+ * safe; the barrier makes sure our critical section is visible
+ * before the next waiter sees its number.
+ */
+void
+ticketlock_release(struct ticketlock *tkl)
+{
+	/* this must work before curcpu initialization */
+	if (CURCPU_EXISTS()) {
+		KASSERT(tkl->tkl_holder == curcpu->c_self);
+		KASSERT(curcpu->c_spinlocks > 0);
+		curcpu->c_spinlocks--;
+		HANGMAN_RELEASE(&curcpu->c_hangman, &tkl->tkl_hangman);
+	}
+
+	LOCKSTAT_RELEASED(&tkl->tkl_stat);
+	tkl->tkl_holder = NULL;
+	membar_any_store();
+	spinlock_data_set(&tkl->tkl_owner,
+			  spinlock_data_get(&tkl->tkl_owner) + 1);
+	spllower(IPL_HIGH, IPL_NONE);
+}
+
+/*
+ * Check if the current cpu holds the lock.
+ */
+bool
+ticketlock_do_i_hold(struct ticketlock *tkl)
+{
+	if (!CURCPU_EXISTS()) {
+		return true;
+	}
+
+	/* Same assumption as spinlock_do_i_hold */
+	return (tkl->tkl_holder == curcpu->c_self);
+}
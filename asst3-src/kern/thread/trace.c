@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Kernel event tracing. See trace.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/poll.h>
+#include <lib.h>
+#include <spl.h>
+#include <clock.h>
+#include <membar.h>
+#include <cpu.h>
+#include <current.h>
+#include <synch.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <device.h>
+#include <platform/maxcpus.h>
+#include <trace.h>
+
+/* Records per cpu. Must be a power of 2 so the counters can wrap. */
+#define TRACE_NRECS	512
+
+/* Bounce buffer size for trace_dump. */
+#define TRACE_DUMPBUF	(64 * sizeof(struct trace_record))
+
+struct tracering {
+	/* Written only by the owning cpu, with interrupts off. */
+	volatile unsigned tr_head;	/* next record to fill */
+	unsigned tr_dropped;		/* records lost to a full ring */
+
+	/* Written only by whoever holds trace_drainlock. */
+	volatile unsigned tr_tail;	/* next record to drain */
+	unsigned tr_reported;		/* of tr_dropped, how many reported */
+
+	struct trace_record tr_recs[TRACE_NRECS];
+};
+
+/* Set from the menu; tested inline by TRACE(). */
+volatile bool trace_enabled;
+
+/* Indexed by cpu number. */
+static struct tracering *trace_rings[MAXCPUS];
+
+/* Serializes drains. */
+static struct lock *trace_drainlock;
+
+/*
+ * Give cpu CPUNUM its ring. Called from cpu_create.
+ */
+void
+trace_cpuinit(unsigned cpunum)
+{
+	struct tracering *tr;
+
+	KASSERT(cpunum < MAXCPUS);
+
+	tr = kmalloc(sizeof(*tr));
+	if (tr == NULL) {
+		panic("trace_cpuinit: Out of memory\n");
+	}
+	tr->tr_head = 0;
+	tr->tr_dropped = 0;
+	tr->tr_tail = 0;
+	tr->tr_reported = 0;
+	trace_rings[cpunum] = tr;
+}
+
+/*
+ * Log an event on the current cpu. This can be called from anywhere,
+ * interrupt handlers and thread_switch included.
+ */
+void
+trace_log(unsigned event, uint32_t arg0, uint32_t arg1)
+{
+	struct tracering *tr;
+	struct trace_record *rec;
+	struct timespec ts;
+	unsigned head;
+	int spl;
+
+	/* Interrupt handlers on this cpu log into the same ring. */
+	spl = splhigh();
+
+	tr = trace_rings[curcpu->c_number];
+	head = tr->tr_head;
+	if (head - tr->tr_tail >= TRACE_NRECS) {
+		tr->tr_dropped++;
+		splx(spl);
+		return;
+	}
+
+	gettime(&ts);
+	rec = &tr->tr_recs[head % TRACE_NRECS];
+	rec->tr_sec = ts.tv_sec;
+	rec->tr_nsec = ts.tv_nsec;
+	rec->tr_event = event;
+	rec->tr_cpu = curcpu->c_number;
+	rec->tr_pad = 0;
+	rec->tr_thread = (uint32_t)(uintptr_t)curthread;
+	rec->tr_args[0] = arg0;
+	rec->tr_args[1] = arg1;
+
+	/* The record has to be there before the drainer can see it. */
+	membar_store_store();
+	tr->tr_head = head + 1;
+
+	splx(spl);
+}
+
+/*
+ * Move whole records into UIO until it can't take another one or
+ * the rings are empty. Each ring's tail moves past a record before
+ * the record is copied out, so a failed copy loses it.
+ */
+static
+int
+trace_drain(struct uio *uio)
+{
+	struct tracering *tr;
+	struct trace_record rec;
+	struct timespec ts;
+	unsigned i, tail, lost;
+	int result = 0;
+
+	lock_acquire(trace_drainlock);
+	for (i=0; i<MAXCPUS && uio->uio_resid >= sizeof(rec); i++) {
+		tr = trace_rings[i];
+		if (tr == NULL) {
+			continue;
+		}
+
+		lost = tr->tr_dropped - tr->tr_reported;
+		if (lost > 0) {
+			gettime(&ts);
+			bzero(&rec, sizeof(rec));
+			rec.tr_sec = ts.tv_sec;
+			rec.tr_nsec = ts.tv_nsec;
+			rec.tr_event = TRACE_LOST;
+			rec.tr_cpu = i;
+			rec.tr_args[0] = lost;
+			tr->tr_reported += lost;
+			result = uiomove(&rec, sizeof(rec), uio);
+			if (result) {
+				goto done;
+			}
+		}
+
+		while (uio->uio_resid >= sizeof(rec)) {
+			tail = tr->tr_tail;
+			if (tail == tr->tr_head) {
+				break;
+			}
+			/* Don't read the record before seeing it's there. */
+			membar_load_load();
+			rec = tr->tr_recs[tail % TRACE_NRECS];
+			/* And don't give the slot back before reading it. */
+			membar_any_store();
+			tr->tr_tail = tail + 1;
+
+			result = uiomove(&rec, sizeof(rec), uio);
+			if (result) {
+				goto done;
+			}
+		}
+	}
+ done:
+	lock_release(trace_drainlock);
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+//
+// The trace: device. Reads drain the rings; a read too short for a
+// whole record, or one with nothing left to drain, returns 0.
+
+static
+int
+traceopen(struct device *dev, int openflags)
+{
+	(void)dev;
+
+	if ((openflags & O_ACCMODE) != O_RDONLY) {
+		return EINVAL;
+	}
+	return 0;
+}
+
+static
+int
+traceio(struct device *dev, struct uio *uio)
+{
+	(void)dev;
+
+	if (uio->uio_rw != UIO_READ) {
+		return EINVAL;
+	}
+	return trace_drain(uio);
+}
+
+static
+int
+traceioctl(struct device *dev, int op, userptr_t data)
+{
+	(void)dev;
+	(void)op;
+	(void)data;
+
+	return EINVAL;
+}
+
+static
+int
+tracepoll(struct device *dev, int events, int *revents)
+{
+	(void)dev;
+
+	/* Reads never block. */
+	*revents = events & POLLIN;
+	return 0;
+}
+
+static const struct device_ops trace_devops = {
+	.devop_eachopen = traceopen,
+	.devop_io = traceio,
+	.devop_ioctl = traceioctl,
+	.devop_poll = tracepoll,
+};
+
+/*
+ * Create the drain lock and attach trace:.
+ */
+void
+trace_bootstrap(void)
+{
+	struct device *dev;
+	int result;
+
+	trace_drainlock = lock_create("trace_drain");
+	if (trace_drainlock == NULL) {
+		panic("trace_bootstrap: Out of memory\n");
+	}
+
+	dev = kmalloc(sizeof(*dev));
+	if (dev == NULL) {
+		panic("Could not add trace device: out of memory\n");
+	}
+	dev->d_ops = &trace_devops;
+	dev->d_blocks = 0;
+	dev->d_blocksize = 1;
+	dev->d_devnumber = 0; /* assigned by vfs_adddev */
+	dev->d_data = NULL;
+
+	result = vfs_adddev("trace", dev, 0);
+	if (result) {
+		panic("Could not add trace device: %s\n", strerror(result));
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Turn tracing on or off.
+ */
+void
+trace_enable(bool on)
+{
+	trace_enabled = on;
+	membar_any_any();
+}
+
+/*
+ * Show how full each ring is. The counts are racy, which is fine.
+ */
+void
+trace_print(void)
+{
+	struct tracering *tr;
+	unsigned i;
+
+	kprintf("trace: %s, %u records per cpu\n",
+		trace_enabled ? "on" : "off", TRACE_NRECS);
+	kprintf("%-4s %10s %10s\n", "cpu", "queued", "dropped");
+	for (i=0; i<MAXCPUS; i++) {
+		tr = trace_rings[i];
+		if (tr == NULL) {
+			continue;
+		}
+		kprintf("%-4u %10u %10u\n", i, tr->tr_head - tr->tr_tail,
+			tr->tr_dropped);
+	}
+}
+
+/*
+ * Drain everything into the file PATH. Stops at the first drain that
+ * doesn't fill the buffer, so a busy system can't keep us going.
+ */
+int
+trace_dump(char *path)
+{
+	struct vnode *vn;
+	struct iovec iov;
+	struct uio ku;
+	char *buf;
+	size_t len;
+	off_t pos;
+	int result;
+
+	buf = kmalloc(TRACE_DUMPBUF);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	result = vfs_open(path, O_WRONLY|O_CREAT|O_TRUNC, 0664, &vn);
+	if (result) {
+		kfree(buf);
+		return result;
+	}
+
+	pos = 0;
+	do {
+		uio_kinit(&iov, &ku, buf, TRACE_DUMPBUF, 0, UIO_READ);
+		result = trace_drain(&ku);
+		if (result) {
+			break;
+		}
+		len = TRACE_DUMPBUF - ku.uio_resid;
+		if (len == 0) {
+			break;
+		}
+
+		uio_kinit(&iov, &ku, buf, len, pos, UIO_WRITE);
+		result = VOP_WRITE(vn, &ku);
+		if (result) {
+			break;
+		}
+		pos += len;
+	} while (len == TRACE_DUMPBUF);
+
+	vfs_close(vn);
+	kfree(buf);
+
+	if (result == 0) {
+		kprintf("trace: %llu records\n",
+			(unsigned long long)pos / sizeof(struct trace_record));
+	}
+	return result;
+}
@@ -225,6 +225,17 @@ dev_isseekable(struct vnode *v)
 	return true;
 }
 
+/*
+ * Called for poll. Hand off to DEVOP_POLL.
+ */
+static
+int
+dev_poll(struct vnode *v, int events, int *revents)
+{
+	struct device *d = v->vn_data;
+	return DEVOP_POLL(d, events, revents);
+}
+
 /*
  * For fsync() - meaningless, do nothing.
  */
@@ -335,6 +346,7 @@ static const struct vnode_ops dev_vnode_ops = {
 	.vop_stat = dev_stat,
 	.vop_gettype = dev_gettype,
 	.vop_isseekable = dev_isseekable,
+	.vop_poll = dev_poll,
 	.vop_fsync = null_fsync,
 	.vop_mmap = dev_mmap,
 	.vop_truncate = dev_truncate,
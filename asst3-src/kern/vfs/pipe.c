@@ -0,0 +1,606 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Anonymous pipes.
+ *
+ * Each pipe has a ring buffer of PIPE_SIZE bytes. Readers sleep on
+ * pp_readcv until there's something to read or the write end goes
+ * away; writers sleep on pp_writecv until there's room or the read
+ * end goes away. Writes of PIPE_BUF bytes or less are atomic: they
+ * wait until the whole thing fits.
+ *
+ * Large writes from page-aligned user buffers skip the ring buffer.
+ * The writer posts its uio and sleeps, and the reader copies straight
+ * out of the writer's page frames (through the kernel's direct map)
+ * into its own buffer, a page at a time. That's one copy instead of
+ * two. Pages the writer hasn't touched yet have no frame; if the
+ * reader runs into one it hands the rest back to the writer to go
+ * through the ring buffer as usual.
+ *
+ * Every change that could make either end ready also calls
+ * poll_wakeup(), for the benefit of anyone in poll().
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <vm.h>
+#include <addrspace.h>
+#include <proc.h>
+#include <vnode.h>
+#include <poll.h>
+#include <pipe.h>
+
+/* Size of the ring buffer. */
+#define PIPE_SIZE	PAGE_SIZE
+
+struct pipe {
+	struct lock *pp_lock;
+	struct cv *pp_readcv;		/* readers wait here for data */
+	struct cv *pp_writecv;		/* writers wait here for room */
+
+	char *pp_buf;			/* ring buffer */
+	unsigned pp_head;		/* offset of the first byte */
+	unsigned pp_count;		/* number of bytes in pp_buf */
+
+	bool pp_readeropen;		/* read end still exists */
+	bool pp_writeropen;		/* write end still exists */
+
+	/* page handoff in progress, if any */
+	struct uio *pp_handoff;		/* writer's uio */
+	struct addrspace *pp_handoffas;	/* writer's address space */
+
+	struct vnode pp_readvn;
+	struct vnode pp_writevn;
+};
+
+////////////////////////////////////////////////////////////
+// Data movement
+
+/*
+ * Move LEN bytes between the ring buffer, starting at offset POS,
+ * and UIO. This takes one uiomove call, or two if the range wraps.
+ * Note that on error part of the data may have been moved; callers
+ * work out how much from the change in uio_resid.
+ */
+static
+int
+pipe_ringmove(struct pipe *pp, unsigned pos, size_t len, struct uio *uio)
+{
+	size_t chunk;
+	int result;
+
+	while (len > 0) {
+		pos %= PIPE_SIZE;
+		chunk = PIPE_SIZE - pos;
+		if (chunk > len) {
+			chunk = len;
+		}
+		result = uiomove(pp->pp_buf + pos, chunk, uio);
+		if (result) {
+			return result;
+		}
+		pos += chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+/*
+ * Check whether a write can use the page handoff path: a single
+ * user buffer, page-aligned and at least a page long, while the ring
+ * buffer is empty (so ordering is preserved) and nobody else is
+ * handing off.
+ */
+static
+bool
+pipe_canhandoff(struct pipe *pp, struct uio *uio)
+{
+	vaddr_t base;
+
+	if (uio->uio_segflg != UIO_USERSPACE || uio->uio_iovcnt != 1) {
+		return false;
+	}
+	base = (vaddr_t)uio->uio_iov->iov_ubase;
+	if ((base & ~PAGE_FRAME) != 0 || uio->uio_resid < PAGE_SIZE) {
+		return false;
+	}
+	return pp->pp_count == 0 && pp->pp_handoff == NULL;
+}
+
+/*
+ * Writer side of the page handoff: post the uio and wait until a
+ * reader has either drained it or given it back. Whatever is left in
+ * UIO afterwards goes through the ring buffer.
+ */
+static
+void
+pipe_handoff(struct pipe *pp, struct uio *uio)
+{
+	pp->pp_handoff = uio;
+	pp->pp_handoffas = proc_getas();
+	cv_broadcast(pp->pp_readcv, pp->pp_lock);
+	poll_wakeup();
+
+	while (pp->pp_handoff == uio && pp->pp_readeropen) {
+		cv_wait(pp->pp_writecv, pp->pp_lock);
+	}
+	if (pp->pp_handoff == uio) {
+		/* the reader went away */
+		pp->pp_handoff = NULL;
+		pp->pp_handoffas = NULL;
+	}
+}
+
+/*
+ * Reader side of the page handoff: copy from the writer's frames into
+ * UIO until one or the other runs out.
+ *
+ * The writer is asleep in pipe_handoff, so its process (and therefore
+ * its address space) can't go away, and as_lookup_frame gives us a
+ * reference to the frame, so it stays put while we copy from it even
+ * if another thread unmaps the page. We don't hold the writer's as_lock across the copy; our own
+ * buffer may fault, and two processes piping to each other would
+ * otherwise be able to deadlock on each other's address spaces.
+ */
+static
+int
+pipe_takepages(struct pipe *pp, struct uio *uio)
+{
+	struct uio *src = pp->pp_handoff;
+	struct iovec *iov = src->uio_iov;
+	vaddr_t va;
+	paddr_t pa;
+	size_t len, moved;
+	int result = 0;
+
+	pa = 0;
+	while (uio->uio_resid > 0 && src->uio_resid > 0) {
+		va = (vaddr_t)iov->iov_ubase;
+		pa = as_lookup_frame(pp->pp_handoffas, va);
+		if (pa == 0) {
+			/* never touched; let the writer fault it in */
+			break;
+		}
+
+		len = PAGE_SIZE - (va & ~PAGE_FRAME);
+		if (len > src->uio_resid) {
+			len = src->uio_resid;
+		}
+
+		moved = uio->uio_resid;
+		result = uiomove((char *)PADDR_TO_KVADDR(pa) +
+				 (va & ~PAGE_FRAME), len, uio);
+		moved -= uio->uio_resid;
+		free_kpages(PADDR_TO_KVADDR(pa));
+
+		iov->iov_ubase += moved;
+		iov->iov_len -= moved;
+		src->uio_offset += moved;
+		src->uio_resid -= moved;
+
+		if (result) {
+			break;
+		}
+	}
+
+	if (src->uio_resid == 0 || pa == 0) {
+		/* done with it (or can't do any more); wake the writer */
+		pp->pp_handoff = NULL;
+		pp->pp_handoffas = NULL;
+	}
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// Vnode operations
+
+/*
+ * This should never be called; pipes aren't opened with vfs_open.
+ */
+static
+int
+pipe_eachopen(struct vnode *vn, int openflags)
+{
+	(void)vn;
+	(void)openflags;
+	return 0;
+}
+
+/*
+ * Called when the last reference to one end goes away. Tell anyone
+ * waiting on the other end, and free the pipe once both ends are gone.
+ */
+static
+int
+pipe_reclaim(struct vnode *vn)
+{
+	struct pipe *pp = vn->vn_data;
+	bool gone;
+
+	lock_acquire(pp->pp_lock);
+	if (vn == &pp->pp_readvn) {
+		pp->pp_readeropen = false;
+		cv_broadcast(pp->pp_writecv, pp->pp_lock);
+		poll_wakeup();
+	}
+	else {
+		KASSERT(vn == &pp->pp_writevn);
+		pp->pp_writeropen = false;
+		cv_broadcast(pp->pp_readcv, pp->pp_lock);
+		poll_wakeup();
+	}
+	vnode_cleanup(vn);
+	gone = !pp->pp_readeropen && !pp->pp_writeropen;
+	lock_release(pp->pp_lock);
+
+	if (gone) {
+		KASSERT(pp->pp_handoff == NULL);
+		kfree(pp->pp_buf);
+		cv_destroy(pp->pp_writecv);
+		cv_destroy(pp->pp_readcv);
+		lock_destroy(pp->pp_lock);
+		kfree(pp);
+	}
+	return 0;
+}
+
+/*
+ * Read. Wait until there's something to read, then take as much as
+ * we can without waiting again. If the write end is gone and the
+ * buffer is empty, that's EOF and we return without moving anything.
+ *
+ * A handoff whose first page has no frame yet moves nothing; the
+ * writer gets it back and sends the data through the ring buffer, so
+ * wait for that instead of returning a zero-length read (which would
+ * look like EOF).
+ */
+static
+int
+pipe_read(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *pp = vn->vn_data;
+	size_t start, len, moved;
+	int result = 0;
+
+	KASSERT(vn == &pp->pp_readvn);
+
+	start = uio->uio_resid;
+	if (start == 0) {
+		return 0;
+	}
+
+	lock_acquire(pp->pp_lock);
+	while (1) {
+		while (pp->pp_count == 0 && pp->pp_handoff == NULL &&
+		       pp->pp_writeropen) {
+			cv_wait(pp->pp_readcv, pp->pp_lock);
+		}
+
+		if (pp->pp_count > 0) {
+			len = pp->pp_count;
+			if (len > uio->uio_resid) {
+				len = uio->uio_resid;
+			}
+			moved = uio->uio_resid;
+			result = pipe_ringmove(pp, pp->pp_head, len, uio);
+			moved -= uio->uio_resid;
+			pp->pp_head = (pp->pp_head + moved) % PIPE_SIZE;
+			pp->pp_count -= moved;
+			break;
+		}
+		if (pp->pp_handoff == NULL) {
+			/* EOF */
+			break;
+		}
+		result = pipe_takepages(pp, uio);
+		if (result || uio->uio_resid < start) {
+			break;
+		}
+		/* nothing moved: let the writer fall back to the ring */
+		cv_broadcast(pp->pp_writecv, pp->pp_lock);
+	}
+
+	cv_broadcast(pp->pp_writecv, pp->pp_lock);
+	poll_wakeup();
+	lock_release(pp->pp_lock);
+	return result;
+}
+
+/*
+ * Write. Keep going until all the data has gone into the pipe. If
+ * the read end goes away, fail with EPIPE, unless some of the data
+ * had already been written, in which case report a short write.
+ */
+static
+int
+pipe_write(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *pp = vn->vn_data;
+	size_t start, room, len, moved;
+	int result = 0;
+
+	KASSERT(vn == &pp->pp_writevn);
+
+	start = uio->uio_resid;
+
+	lock_acquire(pp->pp_lock);
+	if (pp->pp_readeropen && pipe_canhandoff(pp, uio)) {
+		pipe_handoff(pp, uio);
+	}
+
+	while (uio->uio_resid > 0) {
+		if (!pp->pp_readeropen) {
+			result = EPIPE;
+			break;
+		}
+
+		room = PIPE_SIZE - pp->pp_count;
+		if (room == 0 ||
+		    (uio->uio_resid <= PIPE_BUF && room < uio->uio_resid)) {
+			cv_wait(pp->pp_writecv, pp->pp_lock);
+			continue;
+		}
+
+		len = room;
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		moved = uio->uio_resid;
+		result = pipe_ringmove(pp, pp->pp_head + pp->pp_count,
+				       len, uio);
+		moved -= uio->uio_resid;
+		pp->pp_count += moved;
+
+		cv_broadcast(pp->pp_readcv, pp->pp_lock);
+		poll_wakeup();
+		if (result) {
+			break;
+		}
+	}
+	lock_release(pp->pp_lock);
+
+	if (result == EPIPE && uio->uio_resid < start) {
+		result = 0;
+	}
+	return result;
+}
+
+/*
+ * ioctl. No ioctls.
+ */
+static
+int
+pipe_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	(void)vn;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+/*
+ * stat. The size is the number of bytes waiting to be read.
+ */
+static
+int
+pipe_stat(struct vnode *vn, struct stat *buf)
+{
+	struct pipe *pp = vn->vn_data;
+
+	bzero(buf, sizeof(*buf));
+
+	lock_acquire(pp->pp_lock);
+	buf->st_size = pp->pp_count;
+	lock_release(pp->pp_lock);
+
+	buf->st_mode = S_IFIFO | 0600;
+	buf->st_nlink = 0;
+	buf->st_blksize = PIPE_SIZE;
+
+	return 0;
+}
+
+/*
+ * Return the type: always a pipe.
+ */
+static
+int
+pipe_gettype(struct vnode *vn, mode_t *ret)
+{
+	(void)vn;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+/*
+ * Check if seeking is allowed: it isn't.
+ */
+static
+bool
+pipe_isseekable(struct vnode *vn)
+{
+	(void)vn;
+	return false;
+}
+
+/*
+ * poll. The read end is readable if there's data (or a handoff)
+ * waiting, and hung up once the write end is gone, at which point
+ * reads return EOF without waiting. The write end is writable if an
+ * atomic write of PIPE_BUF bytes would fit, and an error once the
+ * read end is gone.
+ */
+static
+int
+pipe_poll(struct vnode *vn, int events, int *revents)
+{
+	struct pipe *pp = vn->vn_data;
+	int ret = 0;
+
+	lock_acquire(pp->pp_lock);
+	if (vn == &pp->pp_readvn) {
+		if (pp->pp_count > 0 || pp->pp_handoff != NULL ||
+		    !pp->pp_writeropen) {
+			ret |= events & POLLIN;
+		}
+		if (!pp->pp_writeropen) {
+			ret |= POLLHUP;
+		}
+	}
+	else {
+		if (!pp->pp_readeropen) {
+			ret |= POLLERR;
+		}
+		else if (PIPE_SIZE - pp->pp_count >= PIPE_BUF) {
+			ret |= events & POLLOUT;
+		}
+	}
+	lock_release(pp->pp_lock);
+
+	*revents = ret;
+	return 0;
+}
+
+/*
+ * fsync and truncate don't mean anything for a pipe.
+ */
+static
+int
+pipe_fsync(struct vnode *vn)
+{
+	(void)vn;
+	return EINVAL;
+}
+
+static
+int
+pipe_truncate(struct vnode *vn, off_t len)
+{
+	(void)vn;
+	(void)len;
+	return EINVAL;
+}
+
+/*
+ * Vnode ops table for both ends of a pipe.
+ */
+static const struct vnode_ops pipe_vnode_ops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_poll = pipe_poll,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+////////////////////////////////////////////////////////////
+// Constructor
+
+int
+pipe_create(struct vnode **readret, struct vnode **writeret)
+{
+	struct pipe *pp;
+	int result;
+
+	pp = kmalloc(sizeof(*pp));
+	if (pp == NULL) {
+		return ENOMEM;
+	}
+	pp->pp_buf = kmalloc(PIPE_SIZE);
+	if (pp->pp_buf == NULL) {
+		goto fail_pp;
+	}
+	pp->pp_lock = lock_create("pipe");
+	if (pp->pp_lock == NULL) {
+		goto fail_buf;
+	}
+	pp->pp_readcv = cv_create("pipe read");
+	if (pp->pp_readcv == NULL) {
+		goto fail_lock;
+	}
+	pp->pp_writecv = cv_create("pipe write");
+	if (pp->pp_writecv == NULL) {
+		goto fail_readcv;
+	}
+
+	pp->pp_head = 0;
+	pp->pp_count = 0;
+	pp->pp_readeropen = true;
+	pp->pp_writeropen = true;
+	pp->pp_handoff = NULL;
+	pp->pp_handoffas = NULL;
+
+	result = vnode_init(&pp->pp_readvn, &pipe_vnode_ops, NULL, pp);
+	/* vnode_init doesn't actually fail */
+	KASSERT(result == 0);
+	result = vnode_init(&pp->pp_writevn, &pipe_vnode_ops, NULL, pp);
+	KASSERT(result == 0);
+
+	*readret = &pp->pp_readvn;
+	*writeret = &pp->pp_writevn;
+	return 0;
+
+ fail_readcv:
+	cv_destroy(pp->pp_readcv);
+ fail_lock:
+	lock_destroy(pp->pp_lock);
+ fail_buf:
+	kfree(pp->pp_buf);
+ fail_pp:
+	kfree(pp);
+	return ENOMEM;
+}
@@ -32,6 +32,7 @@
  */
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <synch.h>
 #include <vfs.h>
@@ -52,6 +53,7 @@ vnode_init(struct vnode *vn, const struct vnode_ops *ops,
 	spinlock_init(&vn->vn_countlock);
 	vn->vn_fs = fs;
 	vn->vn_data = fsdata;
+	pagecache_init(&vn->vn_pagecache);
 	return 0;
 }
 
@@ -63,6 +65,7 @@ vnode_cleanup(struct vnode *vn)
 {
 	KASSERT(vn->vn_refcount == 1);
 
+	pagecache_cleanup(&vn->vn_pagecache);
 	spinlock_cleanup(&vn->vn_countlock);
 
 	vn->vn_ops = NULL;
@@ -71,6 +74,16 @@ vnode_cleanup(struct vnode *vn)
 	vn->vn_data = NULL;
 }
 
+/*
+ * Generic poll for things that never block.
+ */
+int
+vnode_poll_ready(struct vnode *vn, int events, int *revents)
+{
+	(void)vn;
+	*revents = events & (POLLIN | POLLOUT);
+	return 0;
+}
 
 /*
  * Increment refcount.
@@ -29,17 +29,34 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/mman.h>
+#include <kern/stat.h>
 #include <lib.h>
 #include <spl.h>
 #include <spinlock.h>
+#include <cpu.h>
 #include <current.h>
 #include <mips/tlb.h>
+#include <mips/trapframe.h>
 #include <addrspace.h>
 #include <vm.h>
 #include <proc.h>
+#include <synch.h>
+#include <limits.h>
+#include <uio.h>
+#include <vnode.h>
+#include <vdso.h>
+#include <kmem.h>
 
+// the main stack also holds exec's argv (up to ARG_MAX) at the top
+#define MAINSTACKSIZE (USRSTACKSIZE + ARG_MAX)
+
+// regions come from their own object cache rather than kmalloc
+static struct kmem_cache *region_cache;
+
+// initial size of an address space's region array; it doubles from there
+#define REGIONS_MIN 8
 
-// #include <synch.h>
 
 /*
  * Note! If OPT_DUMBVM is set, as is the case until you start the VM
@@ -51,6 +68,330 @@
  *
  */
 
+// set up the region cache; called from vm_bootstrap
+void
+as_bootstrap(void)
+{
+	region_cache = kmem_cache_create("region", sizeof(struct region),
+					 NULL, NULL);
+	if (region_cache == NULL) {
+		panic("as_bootstrap: Out of memory\n");
+	}
+}
+
+// index of the first region that ends above VADDR, or as_nregions if there's none
+static unsigned
+region_index(struct addrspace *as, vaddr_t vaddr)
+{
+	unsigned lo = 0, hi = as->as_nregions;
+
+	while (lo < hi) {
+		unsigned mid = lo + (hi - lo) / 2;
+		struct region *r = as->as_regions[mid];
+
+		if (r->base + r->memsize <= vaddr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+// put REG into the region array at index I, growing the array if it's full
+static int
+region_insert(struct addrspace *as, unsigned i, struct region *reg)
+{
+	KASSERT(i <= as->as_nregions);
+
+	if (as->as_nregions == as->as_maxregions) {
+		unsigned newmax = as->as_maxregions ? as->as_maxregions * 2 : REGIONS_MIN;
+		struct region **newregions = kmalloc(newmax * sizeof(*newregions));
+		if (newregions == NULL) return ENOMEM;
+
+		if (as->as_regions != NULL) {
+			memcpy(newregions, as->as_regions, as->as_nregions * sizeof(*newregions));
+			kfree(as->as_regions);
+		}
+		as->as_regions = newregions;
+		as->as_maxregions = newmax;
+	}
+
+	memmove(&as->as_regions[i + 1], &as->as_regions[i],
+		(as->as_nregions - i) * sizeof(*as->as_regions));
+	as->as_regions[i] = reg;
+	as->as_nregions++;
+	return 0;
+}
+
+// take the region at index I out of the array and free it
+static void
+region_remove(struct addrspace *as, unsigned i)
+{
+	struct region *reg = as->as_regions[i];
+
+	KASSERT(i < as->as_nregions);
+
+	memmove(&as->as_regions[i], &as->as_regions[i + 1],
+		(as->as_nregions - i - 1) * sizeof(*as->as_regions));
+	as->as_nregions--;
+	if (as->as_lastregion == reg) {
+		as->as_lastregion = NULL;
+	}
+	kmem_cache_free(region_cache, reg);
+}
+
+// A directly follows B's end and they could be one region
+static bool
+region_mergeable(const struct region *a, const struct region *b)
+{
+	return a->base + a->memsize == b->base &&
+		a->mapflags == 0 && b->mapflags == 0 &&
+		a->readable == b->readable &&
+		a->writeable == b->writeable &&
+		a->executable == b->executable &&
+		a->oldwriteable == b->oldwriteable;
+}
+
+// find LEN bytes of unused address space for mmap, as high as we can below the vdso
+static vaddr_t
+region_gap(struct addrspace *as, size_t len)
+{
+	vaddr_t top = VDSO_BASE;
+	unsigned i;
+
+	for (i = as->as_nregions; i-- > 0; ) {
+		struct region *r = as->as_regions[i];
+		vaddr_t end = r->base + r->memsize;
+
+		if (r->base >= top) continue;
+		if (end <= top && top - end >= len) break;
+		top = r->base;
+	}
+
+	// leave page 0 unmapped so NULL pointers still fault
+	if (top < PAGE_SIZE || top - PAGE_SIZE < len) return 0;
+	return top - len;
+}
+
+// a modified page of a shared file mapping on its way back to the file
+struct wbpage {
+	vaddr_t wbp_va;		// the user page
+	vaddr_t wbp_kpage;	// its frame, which we hold a reference to
+	off_t wbp_offset;	// where it goes in the file
+};
+
+// find the modified pages of shared file mapping R and take a reference on each
+// frame, so they can be written out once as_lock is dropped (the file system may
+// be waiting for as_lock itself, to fault in a buffer of one of our threads).
+// if CLEAN, they're marked unmodified first so writes that race with us fault again.
+// call with as_lock held (or from as_destroy, when nobody else can be using AS)
+static int
+region_wbcollect(struct addrspace *as, struct region *r, bool clean,
+		 struct wbpage **retpages, unsigned *retnpages)
+{
+	vaddr_t end = r->base + r->memsize;
+	vaddr_t chunk, next, va;
+	struct wbpage *pages;
+	unsigned n = 0;
+
+	KASSERT(r->mapvn != NULL && (r->mapflags & MAP_SHARED));
+
+	*retpages = NULL;
+	*retnpages = 0;
+	if (as->pt == NULL) return 0;
+
+	// count them first so we know how much to allocate
+	for (chunk = r->base; chunk < end; chunk = next) {
+		paddr_t *l2 = as->pt[chunk >> 22];
+
+		next = (chunk | 0x3fffff) + 1;
+		if (next > end) next = end;
+		if (l2 == NULL) continue;
+
+		for (va = chunk; va < next; va += PAGE_SIZE) {
+			if (l2[(va << 10) >> 22] & TLBLO_DIRTY) n++;
+		}
+	}
+	if (n == 0) return 0;
+
+	pages = kmalloc(n * sizeof(*pages));
+	if (pages == NULL) return ENOMEM;
+
+	// a level 2 table at a time, so we only have to shoot down tlbs once per table
+	n = 0;
+	for (chunk = r->base; chunk < end; chunk = next) {
+		paddr_t *l2 = as->pt[chunk >> 22];
+		bool any = false;
+
+		next = (chunk | 0x3fffff) + 1;
+		if (next > end) next = end;
+		if (l2 == NULL) continue;
+
+		for (va = chunk; va < next; va += PAGE_SIZE) {
+			paddr_t *pte = &l2[(va << 10) >> 22];
+
+			if ((*pte & TLBLO_DIRTY) == 0) continue;
+
+			pages[n].wbp_va = va;
+			pages[n].wbp_kpage = paddr_to_kvaddr(*pte & PAGE_FRAME);
+			pages[n].wbp_offset = r->mapoffset + (va - r->base);
+			ref_kpage(pages[n].wbp_kpage);
+			n++;
+			if (clean) {
+				*pte &= ~(paddr_t)TLBLO_DIRTY;
+				any = true;
+			}
+		}
+		if (any) vm_tlbinvalidate(chunk, next);
+	}
+
+	*retpages = pages;
+	*retnpages = n;
+	return 0;
+}
+
+// write the NPAGES pages region_wbcollect found to VN, stopping at the first error;
+// *NDONE says how many got there. call without as_lock
+static int
+region_wbwrite(struct vnode *vn, const struct wbpage *pages, unsigned npages,
+	       unsigned *ndone)
+{
+	struct stat st;
+	struct iovec iov;
+	struct uio ku;
+	unsigned i;
+	int result;
+
+	*ndone = 0;
+	result = VOP_STAT(vn, &st);
+	if (result) return result;
+
+	for (i = 0; i < npages; i++) {
+		off_t offset = pages[i].wbp_offset;
+		size_t len;
+
+		// don't grow the file with the zeros past its end
+		if (offset >= st.st_size) continue;
+		len = st.st_size - offset < PAGE_SIZE ? st.st_size - offset : PAGE_SIZE;
+
+		uio_kinit(&iov, &ku, (void *)pages[i].wbp_kpage, len, offset, UIO_WRITE);
+		result = VOP_WRITE(vn, &ku);
+		if (result) break;
+	}
+	*ndone = i;
+	return result;
+}
+
+// drop the references region_wbcollect took
+static void
+region_wbdone(struct wbpage *pages, unsigned npages)
+{
+	unsigned i;
+
+	for (i = 0; i < npages; i++) {
+		free_kpages(pages[i].wbp_kpage);
+	}
+	if (pages != NULL) kfree(pages);
+}
+
+// let go of the file behind mmap region R, if there is one
+static void
+region_release(struct region *r)
+{
+	if (r->mapvn == NULL) return;
+
+	if ((r->mapflags & MAP_SHARED) && r->writeable) {
+		pagecache_endwrite(r->mapvn);
+	}
+	VOP_DECREF(r->mapvn);
+	r->mapvn = NULL;
+}
+
+// the first level 2 table at or after index I, or PTE_NUMBER if there are no more
+static unsigned
+pt_next(const struct addrspace *as, unsigned i)
+{
+	while (i < PTE_NUMBER) {
+		uint32_t bits = as->as_ptmap[i / 32] >> (i % 32);
+
+		if (bits == 0) {
+			// nothing else in this word
+			i = (i / 32 + 1) * 32;
+			continue;
+		}
+		while ((bits & 1) == 0) {
+			bits >>= 1;
+			i++;
+		}
+		return i;
+	}
+	return PTE_NUMBER;
+}
+
+// make the level one page table and the counts that go with it
+static int
+pt_create(struct addrspace *as)
+{
+	paddr_t **pt;
+
+	pt = (paddr_t **) alloc_zeroed_kpage();
+	if (pt == NULL) return ENOMEM;
+
+	as->as_ptcount = kmalloc(PTE_NUMBER * sizeof(*as->as_ptcount));
+	if (as->as_ptcount == NULL) {
+		free_kpages((vaddr_t)pt);
+		return ENOMEM;
+	}
+	bzero(as->as_ptcount, PTE_NUMBER * sizeof(*as->as_ptcount));
+	as->pt = pt;
+	return 0;
+}
+
+int
+as_ptalloc(struct addrspace *as, vaddr_t vaddr)
+{
+	uint32_t fbits = vaddr >> 22;
+	int result;
+
+	if (as->pt == NULL) {
+		result = pt_create(as);
+		if (result) return result;
+	}
+	if (as->pt[fbits] == NULL) {
+		// zeroed before anyone (the utlb handler included) can see it
+		paddr_t *l2 = (paddr_t *) alloc_zeroed_kpage();
+		if (l2 == NULL) return ENOMEM;
+
+		as->as_ptcount[fbits] = 0;
+		as->as_ptmap[fbits / 32] |= 1U << (fbits % 32);
+		as->pt[fbits] = l2;
+	}
+	return 0;
+}
+
+struct region *
+as_find_region(struct addrspace *as, vaddr_t vaddr)
+{
+	struct region *r;
+	unsigned i;
+
+	// faults tend to come in runs on the same region
+	r = as->as_lastregion;
+	if (r != NULL && vaddr >= r->base && vaddr - r->base < r->memsize) {
+		return r;
+	}
+
+	i = region_index(as, vaddr);
+	if (i == as->as_nregions) return NULL;
+
+	r = as->as_regions[i];
+	if (vaddr < r->base) return NULL;
+
+	as->as_lastregion = r;
+	return r;
+}
+
 // create a new address space including a pagetable(lv1, filled with 0) and regions track
 struct addrspace *
 as_create(void)
@@ -64,25 +405,36 @@ as_create(void)
 	 * Initialize as needed.
 	 */
 
-	as->regions = NULL;
+	as->as_regions = NULL;
+	as->as_nregions = 0;
+	as->as_maxregions = 0;
+	as->as_lastregion = NULL;
 
-	// allocate one frame as pt by looking up the frame table. this is the level one page table related to this process
-	as->pt = (paddr_t **) alloc_kpages(1);
-	if (as->pt == NULL) {
+	// the level one page table is made on the first fault (see as_ptalloc), so
+	// processes that exec or exit straight away never pay for one
+	as->pt = NULL;
+	as->as_ptcount = NULL;
+	bzero(as->as_ptmap, sizeof(as->as_ptmap));
+
+	// TIPS: using: 'break kfree ;  condition X ptr == 0xwhatever' to debug double free error
+
+	// threads of the same process fault on the page table at the same time
+	as->as_lock = lock_create("as_lock");
+	if (as->as_lock == NULL) {
 	    kfree(as);
 	    return NULL;
 	}
 
-	// init the level one page table. bcz type is pointer, then one is 4 bytes(32 bits)
-	for (int i=0; i<PTE_NUMBER; i++) {
-		as->pt[i] = NULL;
-	}
+	as->as_stacksinuse = 0;
+	as->as_stacksdefined = 0;
+	as->as_text = NULL;
 
-	// as->aslock = lock_create("aslock");
-	// I got a double free error. at first i thought this due to threads and i try to 
-	// add lock. but then i figure it out and find the reason is that, in vm_fault(line:77),
-	// kfree() was used
-	// TIPS: using: 'break kfree ;  condition X ptr == 0xwhatever' to debug double free error
+	// the read-only page getpid() looks at
+	if (vdso_as_init(as)) {
+	    lock_destroy(as->as_lock);
+	    kfree(as);
+	    return NULL;
+	}
 
 	return as;
 }
@@ -106,65 +458,91 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 		return EINVAL;
 	}
 
-	struct region *oregion;
-	struct region *nregion = newas->regions;
+	// other threads of the old process may still be faulting pages in
+	lock_acquire(old->as_lock);
+
+	// the forking thread may be on one of the thread stacks, so keep them all reserved
+	newas->as_stacksinuse = old->as_stacksinuse;
+	newas->as_stacksdefined = old->as_stacksdefined;
 
-	// copy all the region in old to newas
-	for (oregion = old->regions; oregion != NULL; oregion = oregion -> next){
+	// read-only pages (shared text among them) are shared rather than copied
+	if (old->as_text != NULL) {
+		VOP_INCREF(old->as_text);
+		newas->as_text = old->as_text;
+	}
+
+	// copy all the region in old to newas; they're already in order
+	if (old->as_nregions > 0) {
+		newas->as_regions = kmalloc(old->as_nregions * sizeof(*newas->as_regions));
+		if (newas->as_regions == NULL) {
+			lock_release(old->as_lock);
+			as_destroy(newas);
+			return ENOMEM;
+		}
+		newas->as_maxregions = old->as_nregions;
+	}
+	for (unsigned i = 0; i < old->as_nregions; i++) {
 		// create a new region for newas to hold the copy one
-		struct region *tmp = kmalloc(sizeof(struct region));
+		struct region *tmp = kmem_cache_alloc(region_cache);
 		if (tmp == NULL){
+			lock_release(old->as_lock);
 			as_destroy(newas);
 			return ENOMEM;
 		}
 
-		tmp->base = oregion->base;
-		tmp->memsize = oregion->memsize;
-		tmp->readable = oregion->readable;
-		tmp->writeable = oregion->writeable;
-		tmp->oldwriteable = oregion->oldwriteable;
-		tmp->next = NULL;
+		*tmp = *old->as_regions[i];
+		newas->as_regions[newas->as_nregions++] = tmp;
 
-		// check if this region is a head of the linked list
-		if (nregion == NULL) {
-			newas->regions = tmp;
-		} else {
-			nregion->next = tmp;
+		// both copies of an mmap region hold the file
+		if (tmp->mapvn != NULL) {
+			VOP_INCREF(tmp->mapvn);
+			if ((tmp->mapflags & MAP_SHARED) && tmp->writeable) {
+				pagecache_startwrite(tmp->mapvn);
+			}
 		}
-		nregion = tmp;
-
-		// copy the pagetable when level 2 pt exsit
+	}
 
+	// copy the pagetable when level 2 pt exsit; the bitmap says which ones do
+	for (unsigned i = old->pt != NULL ? pt_next(old, 0) : PTE_NUMBER; i < PTE_NUMBER; i = pt_next(old, i + 1)){
 		// create a level 2 page table at first
-		for (int i = 0; i < PTE_NUMBER; i++){
-			if (old->pt[i] != NULL){
-				newas->pt[i] = (paddr_t *) alloc_kpages(1);
-				if (newas->pt[i] == 0) {
+		if (as_ptalloc(newas, i << 22)) {
+			lock_release(old->as_lock);
+			as_destroy(newas);
+			return ENOMEM;
+		}
+
+		// copy entry and frame, stopping once we've seen all the ones in use
+		unsigned left = old->as_ptcount[i];
+		for (int j = 0; left > 0; j++){
+			if (old->pt[i][j] != 0) {
+				left--;
+			}
+			if (old->pt[i][j] != 0 && ((old->pt[i][j] & TLBLO_DIRTY) == 0 ||
+						(as_find_region(old, i << 22 | j << 12)->mapflags & MAP_SHARED))) {
+				// nobody can write it (or it's a MAP_SHARED page, where writes are
+				// meant to be seen by both of us), so both of us can use the same frame
+				ref_kpage(paddr_to_kvaddr(old->pt[i][j] & PAGE_FRAME));
+				newas->pt[i][j] = old->pt[i][j];
+			} else if (old->pt[i][j] != 0){
+				vaddr_t vpage = alloc_kpages(1);
+				if (vpage == 0) {
+					lock_release(old->as_lock);
 					as_destroy(newas);
 					return ENOMEM;
 				}
-
-				// copy entry and frame
-				for (int j = 0; j < PTE_NUMBER; j++){
-					if (old->pt[i][j] != 0){
-						vaddr_t vpage = alloc_kpages(1);
-       					if (vpage == 0) return ENOMEM;
-        				// paddr_t pframe = kvaddr_to_paddr(vpage);
-        				bzero((void *)vpage, PAGE_SIZE);
-						// this function need vaddr. bcz we need to copy the whole page, no need to use offset
-						memmove((void *) vpage, (const void *) paddr_to_kvaddr(old->pt[i][j] & PAGE_FRAME), PAGE_SIZE);
-						// the add the frame number to the entry
-						newas->pt[i][j] = (kvaddr_to_paddr(vpage) & PAGE_FRAME) | (TLBLO_DIRTY & old->pt[i][j]) | (TLBLO_VALID & old->pt[i][j]);
-					} else {
-						newas->pt[i][j] = 0;
-					}
-				}
-			} 
-			// else do nothing
+				// this function need vaddr. bcz we need to copy the whole page, no need to use offset
+				memmove((void *) vpage, (const void *) paddr_to_kvaddr(old->pt[i][j] & PAGE_FRAME), PAGE_SIZE);
+				// the add the frame number to the entry
+				newas->pt[i][j] = (kvaddr_to_paddr(vpage) & PAGE_FRAME) | (TLBLO_DIRTY & old->pt[i][j]) | (TLBLO_VALID & old->pt[i][j]);
+			} else {
+				continue;
+			}
+			// counted as we go, so as_destroy can clean up a partial copy
+			newas->as_ptcount[i]++;
 		}
-
 	}
-	
+
+	lock_release(old->as_lock);
 
 	*ret = newas;
 	return 0;
@@ -179,35 +557,66 @@ as_destroy(struct addrspace *as)
 
 	if (as == NULL) return;
 
-	// lock_acquire(as->aslock);
+	// don't leave the utlb handler walking a table we're about to free
+	int spl = splhigh();
+	if (cpupagedirs[curcpu->c_number] == (vaddr_t)as->pt) {
+		cpupagedirs[curcpu->c_number] = 0;
+	}
+	splx(spl);
 
-	// free the pagetable from level 2 to level 1
-	for (int i = 0; i < PTE_NUMBER; i++){
-		if (as->pt[i] != NULL){
-			for (int j = 0; j < PTE_NUMBER; j++){
-				if (as->pt[i][j] != 0){
-					free_kpages(paddr_to_kvaddr(as->pt[i][j]) & PAGE_FRAME);
-					// free this page in kseg0
-				}
+	// shared file mappings go back to their files before the pages go
+	for (unsigned i = 0; i < as->as_nregions; i++) {
+		struct region *r = as->as_regions[i];
+
+		if (r->mapvn != NULL && (r->mapflags & MAP_SHARED)) {
+			struct wbpage *pages;
+			unsigned npages, ndone;
+
+			// nobody's left to tell if this fails
+			if (region_wbcollect(as, r, false, &pages, &npages) == 0) {
+				(void)region_wbwrite(r->mapvn, pages, npages, &ndone);
+				region_wbdone(pages, npages);
 			}
-			// after free all level 2 page table, we can free this entry of level one
-			kfree(as->pt[i]);
 		}
+		region_release(r);
+	}
+
+	// free the pagetable from level 2 to level 1, visiting only the level 2
+	// tables that exist and only as far as their last entry in use
+	for (unsigned i = as->pt != NULL ? pt_next(as, 0) : PTE_NUMBER; i < PTE_NUMBER; i = pt_next(as, i + 1)){
+		unsigned left = as->as_ptcount[i];
+
+		for (int j = 0; left > 0; j++){
+			if (as->pt[i][j] != 0){
+				// free this page in kseg0
+				free_kpages(paddr_to_kvaddr(as->pt[i][j] & PAGE_FRAME));
+				left--;
+			}
+		}
+		// after free all level 2 page table, we can free this entry of level one
+		free_kpages((vaddr_t)as->pt[i]);
 	}
 
 	// after free all level one entry, we can free the whole page table
-	kfree(as->pt);
+	if (as->pt != NULL) {
+		free_kpages((vaddr_t)as->pt);
+		kfree(as->as_ptcount);
+	}
 
 	// and then we need to free the regions
-	struct region *curr = as->regions;
-	struct region *tmp;
-	while(curr != NULL) {
-		tmp = curr;
-		curr = tmp->next;
-		kfree(tmp);
-	}
-	// lock_release(as->aslock);
-	// lock_destroy(as->aslock);
+	for (unsigned i = 0; i < as->as_nregions; i++) {
+		kmem_cache_free(region_cache, as->as_regions[i]);
+	}
+	if (as->as_regions != NULL) {
+		kfree(as->as_regions);
+	}
+	// drop our hold on the program's page cache (the pages went above)
+	if (as->as_text != NULL) {
+		VOP_DECREF(as->as_text);
+	}
+
+	vdso_as_cleanup(as);
+	lock_destroy(as->as_lock);
 	kfree(as);
 }
 
@@ -220,8 +629,12 @@ as_activate(void)
 	if (as == NULL) {
 		/*
 		 * Kernel thread without an address space; leave the
-		 * prior address space in place.
+		 * prior address space in place, but stop the utlb
+		 * handler refilling from its page table.
 		 */
+		int spl = splhigh();
+		cpupagedirs[curcpu->c_number] = 0;
+		splx(spl);
 		return;
 	}
 
@@ -231,7 +644,10 @@ as_activate(void)
 
 	// emmm... I just copy it from dumbvm
 
+	// the utlb handler in exception-mips1.S refills straight from
+	// as->pt and only traps to vm_fault when the entry is missing
 	int spl = splhigh();
+	cpupagedirs[curcpu->c_number] = (vaddr_t)as->pt;
 	for (int i = 0; i < NUM_TLB; i++) {
 		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
 	}
@@ -246,6 +662,11 @@ as_deactivate(void)
 	 * anything. See proc.c for an explanation of why it (might)
 	 * be needed.
 	 */
+
+	// stop the utlb handler refilling from the outgoing page table
+	int spl = splhigh();
+	cpupagedirs[curcpu->c_number] = 0;
+	splx(spl);
 }
 
 /*
@@ -272,23 +693,6 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t memsize,
 	// for stack, it can queal to KSEG0
 	if (vaddr + memsize > MIPS_KSEG0) return EFAULT;
 
-	// maske sure the new region will not overlap other regions
-	int flag = 0;
-	struct region *curr = as->regions;
-	while(curr != NULL) {
-		if (curr->base >= vaddr && (curr->base <= vaddr + memsize)) {
-			flag = 1;
-		} else if ((vaddr+memsize) >= curr->base && (vaddr+memsize) <= (curr->base + curr->memsize)){
-			flag = 1;
-		} else if (vaddr >= curr->base && vaddr <= (curr->base + curr->memsize)){
-			flag = 1;
-		} else if ((vaddr+memsize) >= curr->base && (vaddr+memsize) <= (curr->base + curr->memsize)){
-			flag = 1;
-		}
-		curr = curr->next;
-	}
-	if (flag == 1) return EFAULT;
-
     // This is also copied from dumbvm.c. It change all the memsize to 4096 ? 
 
     /* Align the region. First, the base... */
@@ -298,20 +702,52 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t memsize,
     /* ...and now the length. */
     memsize = (memsize + PAGE_SIZE - 1) & PAGE_FRAME;
 
+	// maske sure the new region will not overlap other regions: the first
+	// region ending above vaddr is the only one that can
+	unsigned i = region_index(as, vaddr);
+	struct region *next = i < as->as_nregions ? as->as_regions[i] : NULL;
+	struct region *prev = i > 0 ? as->as_regions[i - 1] : NULL;
+
+	if (next != NULL && next->base < vaddr + memsize) return EFAULT;
+
+    struct region new = {
+        .base = vaddr,
+        .memsize = memsize,
+        .readable = readable,
+        .writeable = writeable,
+        .executable = executable,
+        .oldwriteable = writeable,
+        .mapflags = 0,
+        .mapvn = NULL,
+        .mapoffset = 0,
+    };
+
+    // grow a neighbour rather than adding a region if we can, and join
+    // the two neighbours if we've just filled the gap between them
+    if (prev != NULL && region_mergeable(prev, &new)) {
+        prev->memsize += memsize;
+        if (next != NULL && region_mergeable(prev, next)) {
+            prev->memsize += next->memsize;
+            region_remove(as, i);
+        }
+        return 0;
+    }
+    if (next != NULL && region_mergeable(&new, next)) {
+        next->base = vaddr;
+        next->memsize += memsize;
+        return 0;
+    }
+
     // then allocate a region
-    struct region *reg = kmalloc(sizeof(struct region));
+    struct region *reg = kmem_cache_alloc(region_cache);
     if (reg == NULL) return ENOMEM;
+    *reg = new;
 
-    // then init the value in that region
-    reg->base = vaddr;
-    reg->memsize = memsize;
-    reg->readable = readable;
-    reg->writeable = writeable;
-    reg->executable = executable;
-
-    // regions are linked list in the addr space
-    reg->next = as->regions;
-    as->regions = reg;
+    // the array is kept sorted by base
+    if (region_insert(as, i, reg)) {
+        kmem_cache_free(region_cache, reg);
+        return ENOMEM;
+    }
 
 	// return ENOSYS; /* Unimplemented */
 	return 0;
@@ -325,11 +761,10 @@ as_prepare_load(struct addrspace *as)
 	 */
 	if (as == NULL) return ENOMEM;
 
-	struct region *curr = as->regions;
-	while(curr != NULL){
+	for (unsigned i = 0; i < as->as_nregions; i++) {
+		struct region *curr = as->as_regions[i];
 		curr->oldwriteable = curr->writeable;
 		curr->writeable = 1;
-		curr = curr->next;
 	}
 
 	return 0;
@@ -342,37 +777,24 @@ as_complete_load(struct addrspace *as)
 	 * Write this.
 	 */
 
-	for(int i = 0; i < NUM_TLB; i++) {
-		if (as->pt[i] != NULL) {
-			for(int j = 0; j < NUM_TLB; j++) {
-				// not only the region may be changed, but the entry might be changed as well
-				// this will lead the error of [f] case: not support read-only segments
-				// by joining the index we can get the vaddr (page address)
-
-				if (as->pt[i][j] != 0) {
-					vaddr_t vaddr = i << 22|j << 12;
-					// check the permission of this addr's region, if it is read only, we need to remove the writeable bit
-					struct region *tregion = as->regions;
-        			while (tregion != NULL) {
-            			if (vaddr >= tregion->base && vaddr < (tregion->base + tregion->memsize)) break;
-            			tregion = tregion->next;
-        			}
-					if (tregion == NULL) return EFAULT;
-
-					if (tregion->oldwriteable == 0) {
-						as->pt[i][j] = (as->pt[i][j] & PAGE_FRAME) | TLBLO_VALID;	// remove writeable
-					}
+    if (as == NULL) return ENOMEM;
+
+	for (unsigned r = 0; r < as->as_nregions; r++) {
+		struct region *curr = as->as_regions[r];
+
+		if (curr->oldwriteable == 0) {
+			// the loader has written the read-only regions, so take the writeable bit
+			// off the pages it faulted in; this is the [f] case: read-only segments
+			for (vaddr_t vaddr = curr->base; as->pt != NULL && vaddr - curr->base < curr->memsize; vaddr += PAGE_SIZE) {
+				paddr_t *l2 = as->pt[vaddr >> 22];
+				uint32_t mbits = (vaddr << 10) >> 22;
+
+				if (l2 != NULL && l2[mbits] != 0) {
+					l2[mbits] = (l2[mbits] & PAGE_FRAME) | TLBLO_VALID;	// remove writeable
 				}
 			}
 		}
-	}
-
-    if (as == NULL) return ENOMEM;
-
-	struct region *curr = as->regions;
-	while(curr != NULL){
 		curr->writeable = curr->oldwriteable;
-		curr = curr->next;
 	}
 
 	as_activate();
@@ -393,10 +815,360 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
     *stackptr = USERSTACK;
 
     // since we only need treat the stack as other part, we just return as_define_region()
-    return as_define_region(as, *stackptr - USRSTACKSIZE, USRSTACKSIZE, 1, 1, 1);
+    return as_define_region(as, *stackptr - MAINSTACKSIZE, MAINSTACKSIZE, 1, 1, 1);
 
 
 	return 0;
 }
 
+// pick a free thread stack slot and hand back its initial stack pointer
+int
+as_define_thread_stack(struct addrspace *as, vaddr_t *stackptr)
+{
+    if (as == NULL) return ENOMEM;
+
+    lock_acquire(as->as_lock);
+
+    unsigned slot;
+    for (slot = 0; slot < THREADSTACKS_MAX; slot++) {
+        if ((as->as_stacksinuse & (1U << slot)) == 0) break;
+    }
+    if (slot == THREADSTACKS_MAX) {
+        lock_release(as->as_lock);
+        return ENOMEM;
+    }
+
+    // slot 0 starts one guard page below the main stack, and so on down
+    vaddr_t top = USERSTACK - MAINSTACKSIZE - slot * (USRSTACKSIZE + PAGE_SIZE) - PAGE_SIZE;
+
+    // the region is only set up the first time; after that the slot keeps its pages
+    if ((as->as_stacksdefined & (1U << slot)) == 0) {
+        int result = as_define_region(as, top - USRSTACKSIZE, USRSTACKSIZE, 1, 1, 1);
+        if (result) {
+            lock_release(as->as_lock);
+            return result;
+        }
+        as->as_stacksdefined |= 1U << slot;
+    }
+    as->as_stacksinuse |= 1U << slot;
+
+    lock_release(as->as_lock);
+
+    *stackptr = top;
+    return 0;
+}
+
+// give a thread stack slot back; STACKPTR is what as_define_thread_stack handed out
+void
+as_release_thread_stack(struct addrspace *as, vaddr_t stackptr)
+{
+    unsigned slot = (USERSTACK - MAINSTACKSIZE - PAGE_SIZE - stackptr) / (USRSTACKSIZE + PAGE_SIZE);
+
+    KASSERT(slot < THREADSTACKS_MAX);
+
+    lock_acquire(as->as_lock);
+    KASSERT(as->as_stacksinuse & (1U << slot));
+    as->as_stacksinuse &= ~(1U << slot);
+    lock_release(as->as_lock);
+}
+
+// find the frame behind VADDR without faulting it in; 0 if it isn't there yet
+paddr_t
+as_lookup_frame(struct addrspace *as, vaddr_t vaddr)
+{
+    uint32_t fbits = vaddr >> 22;
+    uint32_t mbits = (vaddr << 10) >> 22;
+    paddr_t pte = 0;
+
+    if (vaddr >= USERSPACETOP) return 0;
+
+    // the reference keeps the frame around even if the page is unmapped meanwhile
+    lock_acquire(as->as_lock);
+    if (as->pt != NULL && as->pt[fbits] != NULL) {
+        pte = as->pt[fbits][mbits];
+    }
+    if (pte & TLBLO_VALID) {
+        ref_kpage(paddr_to_kvaddr(pte & PAGE_FRAME));
+    }
+    lock_release(as->as_lock);
+
+    if ((pte & TLBLO_VALID) == 0) return 0;
+    return pte & PAGE_FRAME;
+}
+
+// add an mmap region; see as_map in addrspace.h
+int
+as_map(struct addrspace *as, size_t len, int prot, int flags,
+       struct vnode *vn, off_t offset, vaddr_t *ret)
+{
+    KASSERT(flags == MAP_SHARED || flags == MAP_PRIVATE);
+    KASSERT(offset % PAGE_SIZE == 0);
+
+    if (len == 0 || len > VDSO_BASE) return EINVAL;
+    len = (len + PAGE_SIZE - 1) & PAGE_FRAME;
+
+    struct region *reg = kmem_cache_alloc(region_cache);
+    if (reg == NULL) return ENOMEM;
+
+    lock_acquire(as->as_lock);
+
+    vaddr_t vaddr = region_gap(as, len);
+    if (vaddr == 0) {
+        lock_release(as->as_lock);
+        kmem_cache_free(region_cache, reg);
+        return ENOMEM;
+    }
+
+    reg->base = vaddr;
+    reg->memsize = len;
+    reg->readable = (prot & PROT_READ) != 0;
+    reg->writeable = (prot & PROT_WRITE) != 0;
+    reg->executable = 0;
+    reg->oldwriteable = reg->writeable;
+    reg->mapflags = flags;
+    reg->mapvn = vn;
+    reg->mapoffset = offset;
+
+    if (region_insert(as, region_index(as, vaddr), reg)) {
+        lock_release(as->as_lock);
+        kmem_cache_free(region_cache, reg);
+        return ENOMEM;
+    }
+
+    // the region holds the file until it's unmapped
+    if (vn != NULL) {
+        VOP_INCREF(vn);
+        // we'll be writing to it behind the page cache's back
+        if (flags == MAP_SHARED && reg->writeable) {
+            pagecache_startwrite(vn);
+        }
+    }
+
+    lock_release(as->as_lock);
+
+    *ret = vaddr;
+    return 0;
+}
+
+// find the mmap region that starts at VADDR; call with as_lock held
+static unsigned
+mapping_index(struct addrspace *as, vaddr_t vaddr)
+{
+    unsigned i = region_index(as, vaddr);
+
+    if (i == as->as_nregions || as->as_regions[i]->base != vaddr ||
+        as->as_regions[i]->mapflags == 0) {
+        return as->as_nregions;
+    }
+    return i;
+}
+
+int
+as_unmap(struct addrspace *as, vaddr_t vaddr)
+{
+    unsigned i;
+    struct region *r, saved;
+    struct wbpage *pages = NULL;
+    unsigned npages = 0, ndone;
+    vaddr_t va, chunk, next, end;
+    int result = 0;
+
+    lock_acquire(as->as_lock);
+
+    i = mapping_index(as, vaddr);
+    if (i == as->as_nregions) {
+        lock_release(as->as_lock);
+        return EINVAL;
+    }
+    r = as->as_regions[i];
+    end = r->base + r->memsize;
+
+    // hang on to the modified pages of a shared mapping; they're written
+    // back once the mapping is gone and as_lock has been dropped
+    if (r->mapvn != NULL && (r->mapflags & MAP_SHARED)) {
+        result = region_wbcollect(as, r, false, &pages, &npages);
+        if (result) {
+            lock_release(as->as_lock);
+            return result;
+        }
+    }
+
+    // a level 2 table at a time: make the pages invisible to the utlb handler
+    // (and the table too, if that empties it), get them out of every tlb,
+    // and only then give the frames back
+    for (chunk = r->base; chunk < end; chunk = next) {
+        uint32_t fbits = chunk >> 22;
+        paddr_t *l2;
+        unsigned n = 0;
+
+        next = (chunk | 0x3fffff) + 1;
+        if (next > end) next = end;
+        if (as->pt == NULL || as->pt[fbits] == NULL) continue;
+        l2 = as->pt[fbits];
+
+        for (va = chunk; va < next; va += PAGE_SIZE) {
+            uint32_t mbits = (va << 10) >> 22;
+
+            if (l2[mbits] != 0) {
+                l2[mbits] &= ~(paddr_t)TLBLO_VALID;
+                n++;
+            }
+        }
+        if (n == 0) continue;
+
+        KASSERT(as->as_ptcount[fbits] >= n);
+        as->as_ptcount[fbits] -= n;
+        if (as->as_ptcount[fbits] == 0) {
+            as->pt[fbits] = NULL;
+            as->as_ptmap[fbits / 32] &= ~(1U << (fbits % 32));
+        }
+
+        // the utlb handler runs with interrupts off, so once every cpu has
+        // taken this nobody is still walking the table either
+        vm_tlbinvalidate(chunk, next);
+
+        for (va = chunk; va < next; va += PAGE_SIZE) {
+            uint32_t mbits = (va << 10) >> 22;
+
+            if (l2[mbits] != 0) {
+                free_kpages(paddr_to_kvaddr(l2[mbits] & PAGE_FRAME));
+                l2[mbits] = 0;
+            }
+        }
+        if (as->pt[fbits] == NULL) {
+            free_kpages((vaddr_t)l2);
+        }
+    }
+
+    // the file goes after the write back, so it stays open for writing until then
+    saved = *r;
+    region_remove(as, i);
+
+    lock_release(as->as_lock);
+
+    if (npages > 0) {
+        result = region_wbwrite(saved.mapvn, pages, npages, &ndone);
+        region_wbdone(pages, npages);
+    }
+    region_release(&saved);
+    return result;
+}
+
+int
+as_sync(struct addrspace *as, vaddr_t vaddr)
+{
+    unsigned i;
+    struct region *r;
+    struct vnode *vn;
+    struct wbpage *pages;
+    unsigned npages, ndone;
+    int result;
+
+    lock_acquire(as->as_lock);
+
+    i = mapping_index(as, vaddr);
+    if (i == as->as_nregions) {
+        lock_release(as->as_lock);
+        return EINVAL;
+    }
+    r = as->as_regions[i];
+
+    // private and anonymous mappings have nowhere to go
+    if (r->mapvn == NULL || (r->mapflags & MAP_SHARED) == 0) {
+        lock_release(as->as_lock);
+        return 0;
+    }
+
+    result = region_wbcollect(as, r, true, &pages, &npages);
+    if (result || npages == 0) {
+        lock_release(as->as_lock);
+        return result;
+    }
+    // another thread may unmap the region while we write
+    vn = r->mapvn;
+    VOP_INCREF(vn);
+    lock_release(as->as_lock);
+
+    result = region_wbwrite(vn, pages, npages, &ndone);
+    if (result) {
+        // the ones we didn't get to are still modified, as far as the next
+        // try is concerned (if they're still mapped)
+        lock_acquire(as->as_lock);
+        for (i = ndone; i < npages; i++) {
+            vaddr_t va = pages[i].wbp_va;
+            paddr_t *l2 = as->pt != NULL ? as->pt[va >> 22] : NULL;
+            uint32_t mbits = (va << 10) >> 22;
+
+            if (l2 != NULL && (l2[mbits] & TLBLO_VALID) &&
+                paddr_to_kvaddr(l2[mbits] & PAGE_FRAME) == pages[i].wbp_kpage) {
+                l2[mbits] |= TLBLO_DIRTY;
+            }
+        }
+        lock_release(as->as_lock);
+    }
+
+    region_wbdone(pages, npages);
+    VOP_DECREF(vn);
+    return result;
+}
 
+// map NPAGES kernel pages in at VADDR as user pages, which then belong to AS (exec's argv)
+// the range has to be in a writeable region and not faulted in yet
+int
+as_adopt_pages(struct addrspace *as, vaddr_t vaddr, const vaddr_t *kpages, unsigned npages)
+{
+    vaddr_t top = vaddr + npages * PAGE_SIZE;
+    struct region *tregion;
+    unsigned i;
+
+    KASSERT((vaddr & ~PAGE_FRAME) == 0);
+    if (npages == 0) return 0;
+
+    lock_acquire(as->as_lock);
+
+    tregion = as_find_region(as, vaddr);
+    if (tregion == NULL || top - tregion->base > tregion->memsize || tregion->writeable == 0) {
+        lock_release(as->as_lock);
+        return EFAULT;
+    }
+
+    // get the level 2 tables first so we can't fail halfway through
+    for (i = 0; i < npages; i++) {
+        vaddr_t va = vaddr + i * PAGE_SIZE;
+        uint32_t fbits = va >> 22;
+        uint32_t mbits = (va << 10) >> 22;
+
+        if (as_ptalloc(as, va)) {
+            lock_release(as->as_lock);
+            return ENOMEM;
+        }
+        if (as->pt[fbits][mbits] != 0) {
+            lock_release(as->as_lock);
+            return EINVAL;
+        }
+    }
+
+    for (i = 0; i < npages; i++) {
+        vaddr_t va = vaddr + i * PAGE_SIZE;
+        paddr_t pframe = kvaddr_to_paddr(kpages[i]) & PAGE_FRAME;
+
+        as->pt[va >> 22][(va << 10) >> 22] = pframe | TLBLO_DIRTY | TLBLO_VALID;
+        as->as_ptcount[va >> 22]++;
+    }
+
+    lock_release(as->as_lock);
+    return 0;
+}
+
+// AS has pages from V's page cache mapped; hold on to V so the cache outlives this exec
+void
+as_set_text(struct addrspace *as, struct vnode *v)
+{
+    if (as->as_text == v) return;
+
+    VOP_INCREF(v);
+    if (as->as_text != NULL) {
+        VOP_DECREF(as->as_text);
+    }
+    as->as_text = v;
+}
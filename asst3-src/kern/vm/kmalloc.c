@@ -30,6 +30,9 @@
 #include <types.h>
 #include <lib.h>
 #include <spinlock.h>
+#include <cpu.h>
+#include <current.h>
+#include <spl.h>
 #include <vm.h>
 
 /*
@@ -121,16 +124,64 @@ fill_deadbeef(void *vptr, size_t len)
 #undef CHECKBEEF
 #undef CHECKGUARDS
 
+/*
+ * MAGAZINES enables the per-cpu magazine layer (q.v.) in front of the
+ * subpage allocator. It is turned off by GUARDS and LABELS, both of
+ * which offset the pointers handed to clients and rely on the checks
+ * in subpage_kfree.
+ */
+
+#if !defined(GUARDS) && !defined(LABELS)
+#define MAGAZINES
+#endif
+
 ////////////////////////////////////////
 
 #if PAGE_SIZE == 4096
 
-#define NSIZES 8
-static const size_t sizes[NSIZES] = { 16, 32, 64, 128, 256, 512, 1024, 2048 };
+/*
+ * Powers of two, plus an intermediate size between each pair where
+ * that fits more blocks on a page: 48 gets 85 blocks to 64's 64, 768
+ * gets 5 to 1024's 4, and so on. 1536 would get no more than 2048
+ * does, so the step between 1024 and 2048 is 1360, the largest size
+ * that fits 3 to a page.
+ */
+#define NSIZES 14
+static const size_t sizes[NSIZES] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1360, 2048
+};
 
 #define SMALLEST_SUBPAGE_SIZE 16
 #define LARGEST_SUBPAGE_SIZE 2048
 
+/* Most cpus we keep per-cpu state for (System/161's limit) */
+#define KMALLOC_MAXCPUS 32
+
+/*
+ * Size to block type lookup table, indexed by (size - 1) / 16. Each
+ * entry is the smallest block type that holds every size in its
+ * 16-byte bucket, which is exact because all the sizes are multiples
+ * of 16. kheap_bootstrap checks this against sizes[].
+ */
+#define SIZECLASS_SHIFT 4
+#define NSIZECLASSES (LARGEST_SUBPAGE_SIZE >> SIZECLASS_SHIFT)
+static const uint8_t sizeclass[NSIZECLASSES] = {
+	[0 ... 0] = 0,		/* 16 */
+	[1 ... 1] = 1,		/* 32 */
+	[2 ... 2] = 2,		/* 48 */
+	[3 ... 3] = 3,		/* 64 */
+	[4 ... 5] = 4,		/* 96 */
+	[6 ... 7] = 5,		/* 128 */
+	[8 ... 11] = 6,		/* 192 */
+	[12 ... 15] = 7,	/* 256 */
+	[16 ... 23] = 8,	/* 384 */
+	[24 ... 31] = 9,	/* 512 */
+	[32 ... 47] = 10,	/* 768 */
+	[48 ... 63] = 11,	/* 1024 */
+	[64 ... 84] = 12,	/* 1360 */
+	[85 ... 127] = 13,	/* 2048 */
+};
+
 #elif PAGE_SIZE == 8192
 #error "No support for 8k pages (yet?)"
 #else
@@ -160,13 +211,12 @@ struct pageref {
 ////////////////////////////////////////
 
 /*
- * Use one spinlock for the whole thing. Making parts of the kmalloc
- * logic per-cpu is worthwhile for scalability; however, for the time
- * being at least we won't, because it adds a lot of complexity and in
- * OS/161 performance and scalability aren't super-critical.
+ * Use one spinlock for the whole pageref layer. The common case
+ * doesn't get here: it's handled by the per-cpu magazine layer
+ * further down, which has its own locking.
  */
 
-static struct spinlock kmalloc_spinlock = SPINLOCK_INITIALIZER;
+static struct spinlock kmalloc_spinlock = SPINLOCK_INITIALIZER("kmalloc_spinlock");
 
 ////////////////////////////////////////
 
@@ -345,6 +395,21 @@ freepageref(struct pageref *p)
 static struct pageref *sizebases[NSIZES];
 static struct pageref *allbase;
 
+/*
+ * Block type of each heap page, indexed by physical page number and
+ * stored plus one so that zero means "not a subpage heap page". This
+ * lets kfree find the size class of a block without taking the lock
+ * and walking allbase, which the magazine layer depends on. It is
+ * written under kmalloc_spinlock, but may be read without it by
+ * anyone holding a live block on the page, since the page cannot go
+ * away underneath them. It covers all of RAM and is allocated by
+ * kheap_bootstrap; until then it is NULL and kfree takes the slow way.
+ */
+static uint8_t *heappage_blktype;
+static unsigned heappage_npages;
+
+#define HEAPPAGE_INDEX(va) (KVADDR_TO_PADDR(va) / PAGE_SIZE)
+
 ////////////////////////////////////////
 
 #ifdef GUARDS
@@ -794,6 +859,121 @@ subpage_stats(struct pageref *pr)
 	kprintf("\n");
 }
 
+////////////////////////////////////////
+
+/*
+ * Allocation statistics, for tuning sizes[]. For each block type
+ * (and for whole-page allocations) we count allocations and the
+ * bytes asked for and actually used, and we also count allocations
+ * by requested size in the same 16-byte buckets as sizeclass[], with
+ * one more for anything larger. Counters are per-cpu so that
+ * keeping them doesn't need a lock; kh adds them up.
+ */
+
+#define KMSTATS_NCLASSES (NSIZES + 1)		/* last is whole pages */
+#define KMSTATS_NBUCKETS (NSIZECLASSES + 1)	/* last is > 2048 */
+
+struct kmstats {
+	unsigned ks_allocs[KMSTATS_NCLASSES];
+	uint64_t ks_requested[KMSTATS_NCLASSES];
+	uint64_t ks_allocated[KMSTATS_NCLASSES];
+	unsigned ks_reqhist[KMSTATS_NBUCKETS];
+};
+
+static struct kmstats kmstats[KMALLOC_MAXCPUS];
+
+/*
+ * Count an allocation of SZ bytes that used ALLOCSZ bytes of block
+ * type CLASS (NSIZES for whole pages).
+ */
+static
+void
+kmstats_add(size_t sz, unsigned class, size_t allocsz)
+{
+	struct kmstats *ks;
+	unsigned bucket;
+	int spl;
+
+	bucket = sz == 0 ? 0 : (sz - 1) >> SIZECLASS_SHIFT;
+	if (bucket >= KMSTATS_NBUCKETS) {
+		bucket = KMSTATS_NBUCKETS - 1;
+	}
+
+	spl = splhigh();
+	if (CURCPU_EXISTS() && curcpu->c_number < KMALLOC_MAXCPUS) {
+		ks = &kmstats[curcpu->c_number];
+	}
+	else {
+		ks = &kmstats[0];
+	}
+	ks->ks_allocs[class]++;
+	ks->ks_requested[class] += sz;
+	ks->ks_allocated[class] += allocsz;
+	ks->ks_reqhist[bucket]++;
+	splx(spl);
+}
+
+/*
+ * Print the histogram.
+ */
+static
+void
+kmstats_print(void)
+{
+	unsigned i, j, allocs;
+	uint64_t requested, allocated;
+
+	kprintf("Allocations by block size (since boot):\n");
+	kprintf("   size     allocs      requested      allocated  used\n");
+	for (i=0; i<KMSTATS_NCLASSES; i++) {
+		allocs = 0;
+		requested = allocated = 0;
+		for (j=0; j<KMALLOC_MAXCPUS; j++) {
+			allocs += kmstats[j].ks_allocs[i];
+			requested += kmstats[j].ks_requested[i];
+			allocated += kmstats[j].ks_allocated[i];
+		}
+		if (allocs == 0) {
+			continue;
+		}
+		if (i < NSIZES) {
+			kprintf("  %5lu", (unsigned long) sizes[i]);
+		}
+		else {
+			kprintf("  pages");
+		}
+		kprintf(" %10u %14llu %14llu  %3u%%\n", allocs,
+			(unsigned long long) requested,
+			(unsigned long long) allocated,
+			(unsigned) (requested * 100 / allocated));
+	}
+
+	kprintf("Allocations by requested size:\n");
+	for (i=0; i<KMSTATS_NBUCKETS; i++) {
+		allocs = 0;
+		for (j=0; j<KMALLOC_MAXCPUS; j++) {
+			allocs += kmstats[j].ks_reqhist[i];
+		}
+		if (allocs == 0) {
+			continue;
+		}
+		if (i < NSIZECLASSES) {
+			kprintf("  %4u-%-4u %10u  -> %lu\n",
+				(i << SIZECLASS_SHIFT) + 1,
+				(i + 1) << SIZECLASS_SHIFT, allocs,
+				(unsigned long) sizes[sizeclass[i]]);
+		}
+		else {
+			kprintf("  %4u+     %10u  -> pages\n",
+				LARGEST_SUBPAGE_SIZE + 1, allocs);
+		}
+	}
+}
+
+#ifdef MAGAZINES
+static void mag_printstats(void);
+#endif
+
 /*
  * Print the whole heap.
  */
@@ -812,6 +992,11 @@ kheap_printstats(void)
 	}
 
 	spinlock_release(&kmalloc_spinlock);
+
+#ifdef MAGAZINES
+	mag_printstats();
+#endif
+	kmstats_print();
 }
 
 ////////////////////////////////////////
@@ -852,18 +1037,14 @@ static
 inline
 int blocktype(size_t clientsz)
 {
-	unsigned i;
-	for (i=0; i<NSIZES; i++) {
-		if (clientsz <= sizes[i]) {
-			return i;
-		}
+	if (clientsz == 0) {
+		return 0;
 	}
-
-	panic("Subpage allocator cannot handle allocation of size %zu\n",
-	      clientsz);
-
-	// keep compiler happy
-	return 0;
+	if (clientsz > LARGEST_SUBPAGE_SIZE) {
+		panic("Subpage allocator cannot handle allocation "
+		      "of size %zu\n", clientsz);
+	}
+	return sizeclass[(clientsz - 1) >> SIZECLASS_SHIFT];
 }
 
 /*
@@ -1013,6 +1194,11 @@ subpage_kmalloc(size_t sz
 	pr->next_all = allbase;
 	allbase = pr;
 
+	if (heappage_blktype != NULL) {
+		KASSERT(HEAPPAGE_INDEX(prpage) < heappage_npages);
+		heappage_blktype[HEAPPAGE_INDEX(prpage)] = blktype + 1;
+	}
+
 	/* This is kind of cheesy, but avoids duplicating the alloc code. */
 	goto doalloc;
 }
@@ -1092,7 +1278,8 @@ subpage_kfree(void *ptr)
 	offset = ptraddr - prpage;
 
 	/* Check for proper positioning and alignment */
-	if (offset >= PAGE_SIZE || offset % sizes[blktype] != 0) {
+	if (offset >= PAGE_SIZE || offset % sizes[blktype] != 0 ||
+	    offset / sizes[blktype] >= PAGE_SIZE / sizes[blktype]) {
 		panic("kfree: subpage free of invalid addr %p\n", ptr);
 	}
 
@@ -1142,6 +1329,9 @@ subpage_kfree(void *ptr)
 		/* Whole page is free. */
 		remove_lists(pr, blktype);
 		freepageref(pr);
+		if (heappage_blktype != NULL) {
+			heappage_blktype[HEAPPAGE_INDEX(prpage)] = 0;
+		}
 		/* Call free_kpages without kmalloc_spinlock. */
 		spinlock_release(&kmalloc_spinlock);
 		free_kpages(prpage);
@@ -1159,6 +1349,335 @@ subpage_kfree(void *ptr)
 	return 0;
 }
 
+////////////////////////////////////////
+//
+// Per-CPU magazine layer.
+//
+// This sits in front of subpage_kmalloc and subpage_kfree and is
+// adapted from Bonwick and Adams' magazine allocator (USENIX 2001).
+// Each CPU has, for each block size, two magazines: small stacks of
+// free blocks. kmalloc pops a block off the loaded magazine and kfree
+// pushes one back, with interrupts off but without taking any global
+// lock. When the loaded magazine runs out (or fills up) we swap it
+// with the previous one; only when both are unusable do we go to the
+// per-size depot, which trades a full magazine for an empty one (or
+// vice versa) under its own spinlock. If the depot can't help, the
+// allocation or free falls through to the pageref code underneath.
+//
+// Blocks sitting in magazines are free as far as clients are
+// concerned but allocated as far as the pageref lists (and kh) are
+// concerned, so a page with cached blocks on it can't be released.
+// To bound this the depot only keeps DEPOT_MAXFULL full magazines
+// per size; beyond that, full magazines are emptied back into the
+// pageref lists. Bigger blocks get smaller magazines for the same
+// reason.
+//
+// Magazines are disabled with GUARDS and LABELS (see above).
+//
+
+#ifdef MAGAZINES
+
+#define MAG_MAXROUNDS 15	/* makes struct magazine 68 bytes */
+#define DEPOT_MAXFULL 4		/* full magazines kept per size */
+static const unsigned magrounds[NSIZES] = {
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 7, 7, 3, 3
+};
+
+struct magazine {
+	struct magazine *mag_next;	/* depot list link */
+	unsigned mag_rounds;		/* number of blocks in mag_objs */
+	void *mag_objs[MAG_MAXROUNDS];
+};
+
+struct magcpu {
+	struct magazine *mc_loaded[NSIZES];
+	struct magazine *mc_previous[NSIZES];
+	unsigned mc_hits[NSIZES];	/* served from a magazine */
+	unsigned mc_misses[NSIZES];	/* went to the pageref lists */
+};
+
+struct depot {
+	struct spinlock d_lock;
+	struct magazine *d_full;
+	struct magazine *d_empty;
+	unsigned d_nfull;
+	unsigned d_nmags;		/* magazines ever made */
+};
+
+static struct magcpu magcpus[KMALLOC_MAXCPUS];
+static struct depot depots[NSIZES];
+static bool magazines_ready;
+
+/*
+ * Get this cpu's magazines, or NULL if we can't use them (too early
+ * in boot, or too many cpus). Call with interrupts off, so we stay
+ * on the same cpu while using the result.
+ */
+static
+struct magcpu *
+mag_getcpu(void)
+{
+	if (!magazines_ready || !CURCPU_EXISTS() ||
+	    curcpu->c_number >= KMALLOC_MAXCPUS) {
+		return NULL;
+	}
+	return &magcpus[curcpu->c_number];
+}
+
+/*
+ * Try to allocate a block of type BLKTYPE from this cpu's magazines,
+ * refilling from the depot if necessary. Returns NULL on a miss.
+ */
+static
+void *
+mag_alloc(unsigned blktype)
+{
+	struct magcpu *mc;
+	struct magazine *mag, *full;
+	struct depot *d;
+	void *ret;
+	int spl;
+
+	spl = splhigh();
+	mc = mag_getcpu();
+	if (mc == NULL) {
+		splx(spl);
+		return NULL;
+	}
+
+	mag = mc->mc_loaded[blktype];
+	if (mag == NULL || mag->mag_rounds == 0) {
+		if (mc->mc_previous[blktype] != NULL &&
+		    mc->mc_previous[blktype]->mag_rounds > 0) {
+			mc->mc_loaded[blktype] = mc->mc_previous[blktype];
+			mc->mc_previous[blktype] = mag;
+		}
+		else {
+			d = &depots[blktype];
+			spinlock_acquire(&d->d_lock);
+			full = d->d_full;
+			if (full != NULL) {
+				d->d_full = full->mag_next;
+				d->d_nfull--;
+				if (mc->mc_previous[blktype] != NULL) {
+					mag = mc->mc_previous[blktype];
+					mag->mag_next = d->d_empty;
+					d->d_empty = mag;
+				}
+				mc->mc_previous[blktype] =
+					mc->mc_loaded[blktype];
+				mc->mc_loaded[blktype] = full;
+			}
+			spinlock_release(&d->d_lock);
+			if (full == NULL) {
+				mc->mc_misses[blktype]++;
+				splx(spl);
+				return NULL;
+			}
+		}
+		mag = mc->mc_loaded[blktype];
+	}
+
+	KASSERT(mag->mag_rounds > 0);
+	ret = mag->mag_objs[--mag->mag_rounds];
+	mc->mc_hits[blktype]++;
+	splx(spl);
+	return ret;
+}
+
+/*
+ * Return every block in a full magazine to the pageref lists, then
+ * file the now-empty magazine in the depot.
+ */
+static
+void
+mag_flush(struct magazine *mag, unsigned blktype)
+{
+	struct depot *d = &depots[blktype];
+	int result;
+
+	while (mag->mag_rounds > 0) {
+		result = subpage_kfree(mag->mag_objs[--mag->mag_rounds]);
+		KASSERT(result == 0);
+	}
+
+	spinlock_acquire(&d->d_lock);
+	mag->mag_next = d->d_empty;
+	d->d_empty = mag;
+	spinlock_release(&d->d_lock);
+}
+
+/*
+ * Try to put PTR, a block of type BLKTYPE, into this cpu's
+ * magazines. Returns 0 on success, 1 if no magazine had room and the
+ * depot had no empty one to give us, or -1 if the magazines can't be
+ * used at all.
+ */
+static
+int
+mag_free(void *ptr, unsigned blktype)
+{
+	struct magcpu *mc;
+	struct magazine *mag, *prev, *empty, *flush;
+	struct depot *d;
+	int spl;
+
+	spl = splhigh();
+	mc = mag_getcpu();
+	if (mc == NULL) {
+		splx(spl);
+		return -1;
+	}
+
+	flush = NULL;
+	mag = mc->mc_loaded[blktype];
+	if (mag == NULL || mag->mag_rounds == magrounds[blktype]) {
+		prev = mc->mc_previous[blktype];
+		if (prev != NULL && prev->mag_rounds == 0) {
+			mc->mc_loaded[blktype] = prev;
+			mc->mc_previous[blktype] = mag;
+		}
+		else {
+			d = &depots[blktype];
+			spinlock_acquire(&d->d_lock);
+			empty = d->d_empty;
+			if (empty != NULL) {
+				d->d_empty = empty->mag_next;
+				if (prev == NULL) {
+					/* nothing to hand back */
+				}
+				else if (d->d_nfull < DEPOT_MAXFULL) {
+					prev->mag_next = d->d_full;
+					d->d_full = prev;
+					d->d_nfull++;
+				}
+				else {
+					flush = prev;
+				}
+				mc->mc_previous[blktype] = mag;
+				mc->mc_loaded[blktype] = empty;
+			}
+			spinlock_release(&d->d_lock);
+			if (empty == NULL) {
+				mc->mc_misses[blktype]++;
+				splx(spl);
+				return 1;
+			}
+		}
+		mag = mc->mc_loaded[blktype];
+	}
+
+	KASSERT(mag->mag_rounds < magrounds[blktype]);
+	mag->mag_objs[mag->mag_rounds++] = ptr;
+	splx(spl);
+
+	/* Do the slow part with interrupts back on. */
+	if (flush != NULL) {
+		mag_flush(flush, blktype);
+	}
+	return 0;
+}
+
+/*
+ * Make a new empty magazine for the depot of size BLKTYPE. This comes
+ * straight from the pageref code, never from the magazines, and
+ * magazines are never freed. The number of magazines per size stays
+ * small: we only get here when the depot has no empty ones, and it
+ * holds at most DEPOT_MAXFULL full ones, so there are never many
+ * more than two per cpu plus DEPOT_MAXFULL.
+ */
+static
+void
+mag_grow(unsigned blktype)
+{
+	struct depot *d = &depots[blktype];
+	struct magazine *mag;
+
+	mag = subpage_kmalloc(sizeof(*mag));
+	if (mag == NULL) {
+		return;
+	}
+	mag->mag_rounds = 0;
+
+	spinlock_acquire(&d->d_lock);
+	mag->mag_next = d->d_empty;
+	d->d_empty = mag;
+	d->d_nmags++;
+	spinlock_release(&d->d_lock);
+}
+
+/*
+ * Print the magazine counters for kh.
+ */
+static
+void
+mag_printstats(void)
+{
+	unsigned i, j, hits, misses;
+
+	kprintf("Magazine layer status:\n");
+	for (i=0; i<NSIZES; i++) {
+		hits = misses = 0;
+		for (j=0; j<KMALLOC_MAXCPUS; j++) {
+			hits += magcpus[j].mc_hits[i];
+			misses += magcpus[j].mc_misses[i];
+		}
+		spinlock_acquire(&depots[i].d_lock);
+		kprintf("size %-4lu  %2u rounds  %2u magazines (%u full "
+			"in depot)  %u hits  %u misses\n",
+			(unsigned long) sizes[i], magrounds[i],
+			depots[i].d_nmags, depots[i].d_nfull, hits, misses);
+		spinlock_release(&depots[i].d_lock);
+	}
+}
+
+#endif /* MAGAZINES */
+
+/*
+ * Set up the heap page table and turn on the magazine layer. This
+ * has to wait until curcpu works. Pages the heap already got from
+ * alloc_kpages are entered in the table from allbase.
+ */
+void
+kheap_bootstrap(void)
+{
+	struct pageref *pr;
+	uint8_t *table;
+	unsigned npages;
+	unsigned i;
+
+	/* Make sure sizeclass[] matches sizes[]. */
+	for (i=0; i<NSIZECLASSES; i++) {
+		KASSERT(sizes[sizeclass[i]] >= (i + 1) << SIZECLASS_SHIFT);
+		KASSERT(sizeclass[i] == 0 ||
+			sizes[sizeclass[i] - 1] < (i + 1) << SIZECLASS_SHIFT);
+	}
+
+	npages = ram_getsize() / PAGE_SIZE;
+	table = kmalloc(npages);
+	if (table == NULL) {
+		panic("kheap_bootstrap: Out of memory\n");
+	}
+	bzero(table, npages);
+
+	spinlock_acquire(&kmalloc_spinlock);
+	for (pr = allbase; pr != NULL; pr = pr->next_all) {
+		KASSERT(HEAPPAGE_INDEX(PR_PAGEADDR(pr)) < npages);
+		table[HEAPPAGE_INDEX(PR_PAGEADDR(pr))] = PR_BLOCKTYPE(pr) + 1;
+	}
+	heappage_npages = npages;
+	heappage_blktype = table;
+	spinlock_release(&kmalloc_spinlock);
+
+#ifdef MAGAZINES
+	for (i=0; i<NSIZES; i++) {
+		KASSERT(magrounds[i] <= MAG_MAXROUNDS);
+		spinlock_init(&depots[i].d_lock);
+	}
+	magazines_ready = true;
+#endif
+}
+
 //
 ////////////////////////////////////////////////////////////
 
@@ -1170,6 +1689,8 @@ void *
 kmalloc(size_t sz)
 {
 	size_t checksz;
+	unsigned blktype;
+	void *ptr;
 #ifdef LABELS
 	vaddr_t label;
 #endif
@@ -1195,16 +1716,71 @@ kmalloc(size_t sz)
 		}
 		KASSERT(address % PAGE_SIZE == 0);
 
+		kmstats_add(sz, NSIZES, npages * PAGE_SIZE);
 		return (void *)address;
 	}
 
+	blktype = blocktype(checksz);
+	ptr = NULL;
+#ifdef MAGAZINES
+	ptr = mag_alloc(blktype);
+#endif
+	if (ptr == NULL) {
 #ifdef LABELS
-	return subpage_kmalloc(sz, label);
+		ptr = subpage_kmalloc(sz, label);
 #else
-	return subpage_kmalloc(sz);
+		ptr = subpage_kmalloc(sz);
 #endif
+	}
+	if (ptr != NULL) {
+		kmstats_add(sz, blktype, sizes[blktype]);
+	}
+	return ptr;
 }
 
+#ifdef MAGAZINES
+/*
+ * Free a block into the magazine layer, if it's a subpage block and
+ * the magazines have room for it (making another magazine if the
+ * depot is out). Returns -1 if the caller should free it the slow
+ * way.
+ */
+static
+int
+kfree_magazine(void *ptr)
+{
+	vaddr_t ptraddr = (vaddr_t)ptr;
+	unsigned index, blktype;
+	int result;
+
+#ifdef __mips__
+	if (ptraddr < MIPS_KSEG0 || ptraddr >= MIPS_KSEG1) {
+		return -1;
+	}
+#endif
+	if (heappage_blktype == NULL) {
+		return -1;
+	}
+	index = HEAPPAGE_INDEX(ptraddr);
+	KASSERT(index < heappage_npages);
+	if (heappage_blktype[index] == 0) {
+		return -1;
+	}
+	blktype = heappage_blktype[index] - 1;
+	KASSERT(blktype < NSIZES);
+	KASSERT((ptraddr & ~PAGE_FRAME) % sizes[blktype] == 0);
+
+	fill_deadbeef(ptr, sizes[blktype]);
+
+	result = mag_free(ptr, blktype);
+	if (result == 1) {
+		mag_grow(blktype);
+		result = mag_free(ptr, blktype);
+	}
+	return result == 0 ? 0 : -1;
+}
+#endif
+
 /*
  * Free a block previously returned from kmalloc.
  */
@@ -1216,7 +1792,13 @@ kfree(void *ptr)
 	 */
 	if (ptr == NULL) {
 		return;
-	} else if (subpage_kfree(ptr)) {
+	}
+#ifdef MAGAZINES
+	if (kfree_magazine(ptr) == 0) {
+		return;
+	}
+#endif
+	if (subpage_kfree(ptr)) {
 		KASSERT((vaddr_t)ptr%PAGE_SIZE==0);
 		free_kpages((vaddr_t)ptr);
 	}
@@ -0,0 +1,396 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Object caches. See kmem.h.
+ *
+ * Each slab is one page, with its struct kmem_slab at the end; that
+ * way kmem_cache_free can find the slab an object belongs to just by
+ * rounding its address down. Free objects on a slab are chained
+ * through a link word: the first word of the object if the cache has
+ * no constructor, otherwise an extra word after the object so the
+ * constructed state isn't disturbed.
+ *
+ * A cache keeps its slabs on three lists according to how many free
+ * objects they have. Allocation prefers partly used slabs, so that
+ * the others can drain and be released. At most KMEM_MAXEMPTY empty
+ * slabs are kept around per cache; any more are destructed and their
+ * pages given back.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <vm.h>
+#include <kmem.h>
+
+#define KMEM_ALIGN	8	/* same alignment kmalloc gives */
+#define KMEM_MAXEMPTY	1	/* empty slabs kept per cache */
+
+struct kmem_slab {
+	struct kmem_slab *ks_next;	/* list links */
+	struct kmem_slab *ks_prev;
+	struct kmem_cache *ks_cache;	/* cache we belong to */
+	void *ks_free;			/* first free object */
+	unsigned ks_nfree;		/* number of free objects */
+};
+
+struct kmem_cache {
+	char *kc_name;
+	size_t kc_size;			/* object size */
+	size_t kc_slotsize;		/* object plus link, aligned */
+	size_t kc_linkoffset;		/* where the free link goes */
+	unsigned kc_perslab;		/* objects per slab */
+	int (*kc_ctor)(void *obj);
+	void (*kc_dtor)(void *obj);
+
+	struct spinlock kc_lock;	/* protects the rest */
+	struct kmem_slab *kc_partial;	/* slabs with some objects free */
+	struct kmem_slab *kc_full;	/* slabs with none free */
+	struct kmem_slab *kc_empty;	/* slabs with all free */
+	unsigned kc_nslabs;
+	unsigned kc_nempty;
+	unsigned kc_inuse;		/* objects handed out */
+
+	struct kmem_cache *kc_next;	/* list of all caches */
+};
+
+static struct spinlock kmem_caches_lock = SPINLOCK_INITIALIZER("kmem_caches_lock");
+static struct kmem_cache *kmem_caches;
+
+////////////////////////////////////////////////////////////
+// slabs
+
+#define KMEM_LINK(kc, obj) \
+	((void **)((char *)(obj) + (kc)->kc_linkoffset))
+#define KMEM_SLAB(obj) \
+	((struct kmem_slab *)(((vaddr_t)(obj) & PAGE_FRAME) + \
+			      PAGE_SIZE - sizeof(struct kmem_slab)))
+
+/*
+ * Get the list a slab belongs on, based on its free count.
+ */
+static
+struct kmem_slab **
+kmem_slab_list(struct kmem_cache *kc, struct kmem_slab *ks)
+{
+	if (ks->ks_nfree == 0) {
+		return &kc->kc_full;
+	}
+	if (ks->ks_nfree == kc->kc_perslab) {
+		return &kc->kc_empty;
+	}
+	return &kc->kc_partial;
+}
+
+static
+void
+kmem_slab_insert(struct kmem_cache *kc, struct kmem_slab *ks)
+{
+	struct kmem_slab **head;
+
+	head = kmem_slab_list(kc, ks);
+	ks->ks_prev = NULL;
+	ks->ks_next = *head;
+	if (*head != NULL) {
+		(*head)->ks_prev = ks;
+	}
+	*head = ks;
+	if (head == &kc->kc_empty) {
+		kc->kc_nempty++;
+	}
+}
+
+static
+void
+kmem_slab_remove(struct kmem_cache *kc, struct kmem_slab *ks)
+{
+	struct kmem_slab **head;
+
+	head = kmem_slab_list(kc, ks);
+	if (ks->ks_prev != NULL) {
+		ks->ks_prev->ks_next = ks->ks_next;
+	}
+	else {
+		KASSERT(*head == ks);
+		*head = ks->ks_next;
+	}
+	if (ks->ks_next != NULL) {
+		ks->ks_next->ks_prev = ks->ks_prev;
+	}
+	ks->ks_next = ks->ks_prev = NULL;
+	if (head == &kc->kc_empty) {
+		KASSERT(kc->kc_nempty > 0);
+		kc->kc_nempty--;
+	}
+}
+
+/*
+ * Get a page and set it up as a slab, constructing every object on
+ * it. Called without the cache lock, since constructors may well
+ * allocate memory.
+ */
+static
+struct kmem_slab *
+kmem_slab_create(struct kmem_cache *kc)
+{
+	struct kmem_slab *ks;
+	vaddr_t page;
+	char *obj;
+	unsigned i, j;
+	int result;
+
+	page = alloc_kpages(1);
+	if (page == 0) {
+		return NULL;
+	}
+
+	if (kc->kc_ctor != NULL) {
+		for (i=0; i<kc->kc_perslab; i++) {
+			result = kc->kc_ctor((char *)page + i*kc->kc_slotsize);
+			if (result) {
+				for (j=0; j<i; j++) {
+					kc->kc_dtor((char *)page +
+						    j*kc->kc_slotsize);
+				}
+				free_kpages(page);
+				return NULL;
+			}
+		}
+	}
+
+	/* Chain the objects together in address order. */
+	for (i=0; i<kc->kc_perslab; i++) {
+		obj = (char *)page + i*kc->kc_slotsize;
+		*KMEM_LINK(kc, obj) = (i+1 < kc->kc_perslab) ?
+			obj + kc->kc_slotsize : NULL;
+	}
+
+	ks = KMEM_SLAB(page);
+	ks->ks_next = ks->ks_prev = NULL;
+	ks->ks_cache = kc;
+	ks->ks_free = (void *)page;
+	ks->ks_nfree = kc->kc_perslab;
+	return ks;
+}
+
+/*
+ * Destruct everything on a slab and give the page back. The slab
+ * must be empty and already off the cache's lists.
+ */
+static
+void
+kmem_slab_destroy(struct kmem_cache *kc, struct kmem_slab *ks)
+{
+	vaddr_t page;
+	unsigned i;
+
+	KASSERT(ks->ks_nfree == kc->kc_perslab);
+	page = (vaddr_t)ks & PAGE_FRAME;
+	if (kc->kc_dtor != NULL) {
+		for (i=0; i<kc->kc_perslab; i++) {
+			kc->kc_dtor((char *)page + i*kc->kc_slotsize);
+		}
+	}
+	free_kpages(page);
+}
+
+////////////////////////////////////////////////////////////
+// caches
+
+struct kmem_cache *
+kmem_cache_create(const char *name, size_t size,
+		  int (*ctor)(void *obj), void (*dtor)(void *obj))
+{
+	struct kmem_cache *kc;
+
+	KASSERT(size > 0);
+	KASSERT((ctor == NULL) == (dtor == NULL));
+
+	kc = kmalloc(sizeof(*kc));
+	if (kc == NULL) {
+		return NULL;
+	}
+	kc->kc_name = kstrdup(name);
+	if (kc->kc_name == NULL) {
+		kfree(kc);
+		return NULL;
+	}
+
+	kc->kc_size = size;
+	if (ctor == NULL) {
+		kc->kc_linkoffset = 0;
+		kc->kc_slotsize = ROUNDUP(size < sizeof(void *) ?
+					  sizeof(void *) : size, KMEM_ALIGN);
+	}
+	else {
+		kc->kc_linkoffset = ROUNDUP(size, sizeof(void *));
+		kc->kc_slotsize = ROUNDUP(kc->kc_linkoffset + sizeof(void *),
+					  KMEM_ALIGN);
+	}
+	kc->kc_perslab = (PAGE_SIZE - sizeof(struct kmem_slab)) /
+		kc->kc_slotsize;
+	/* Anything this big should just use kmalloc. */
+	KASSERT(kc->kc_perslab >= 2);
+
+	kc->kc_ctor = ctor;
+	kc->kc_dtor = dtor;
+
+	spinlock_init(&kc->kc_lock);
+	kc->kc_partial = kc->kc_full = kc->kc_empty = NULL;
+	kc->kc_nslabs = 0;
+	kc->kc_nempty = 0;
+	kc->kc_inuse = 0;
+
+	spinlock_acquire(&kmem_caches_lock);
+	kc->kc_next = kmem_caches;
+	kmem_caches = kc;
+	spinlock_release(&kmem_caches_lock);
+
+	return kc;
+}
+
+void
+kmem_cache_destroy(struct kmem_cache *kc)
+{
+	struct kmem_cache **p;
+	struct kmem_slab *ks;
+
+	KASSERT(kc->kc_inuse == 0);
+	KASSERT(kc->kc_partial == NULL);
+	KASSERT(kc->kc_full == NULL);
+
+	spinlock_acquire(&kmem_caches_lock);
+	for (p = &kmem_caches; *p != kc; p = &(*p)->kc_next) {
+		KASSERT(*p != NULL);
+	}
+	*p = kc->kc_next;
+	spinlock_release(&kmem_caches_lock);
+
+	while (kc->kc_empty != NULL) {
+		ks = kc->kc_empty;
+		kmem_slab_remove(kc, ks);
+		kmem_slab_destroy(kc, ks);
+	}
+
+	spinlock_cleanup(&kc->kc_lock);
+	kfree(kc->kc_name);
+	kfree(kc);
+}
+
+void *
+kmem_cache_alloc(struct kmem_cache *kc)
+{
+	struct kmem_slab *ks;
+	void *obj;
+
+	spinlock_acquire(&kc->kc_lock);
+	ks = kc->kc_partial != NULL ? kc->kc_partial : kc->kc_empty;
+	if (ks == NULL) {
+		spinlock_release(&kc->kc_lock);
+		ks = kmem_slab_create(kc);
+		if (ks == NULL) {
+			return NULL;
+		}
+		spinlock_acquire(&kc->kc_lock);
+		kmem_slab_insert(kc, ks);
+		kc->kc_nslabs++;
+	}
+
+	kmem_slab_remove(kc, ks);
+	obj = ks->ks_free;
+	KASSERT(obj != NULL);
+	ks->ks_free = *KMEM_LINK(kc, obj);
+	ks->ks_nfree--;
+	kmem_slab_insert(kc, ks);
+	kc->kc_inuse++;
+
+	spinlock_release(&kc->kc_lock);
+	return obj;
+}
+
+void
+kmem_cache_free(struct kmem_cache *kc, void *obj)
+{
+	struct kmem_slab *ks;
+
+	ks = KMEM_SLAB(obj);
+	KASSERT(ks->ks_cache == kc);
+	KASSERT(((vaddr_t)obj & ~PAGE_FRAME) % kc->kc_slotsize == 0);
+
+	spinlock_acquire(&kc->kc_lock);
+	KASSERT(ks->ks_nfree < kc->kc_perslab);
+	kmem_slab_remove(kc, ks);
+	*KMEM_LINK(kc, obj) = ks->ks_free;
+	ks->ks_free = obj;
+	ks->ks_nfree++;
+	kmem_slab_insert(kc, ks);
+	kc->kc_inuse--;
+
+	if (ks->ks_nfree == kc->kc_perslab && kc->kc_nempty > KMEM_MAXEMPTY) {
+		kmem_slab_remove(kc, ks);
+		kc->kc_nslabs--;
+		spinlock_release(&kc->kc_lock);
+		kmem_slab_destroy(kc, ks);
+		return;
+	}
+	spinlock_release(&kc->kc_lock);
+}
+
+/*
+ * Print each cache's usage. "Waste" is space on its slabs not taken
+ * up by objects in use: the fixed overhead (slab header, link words,
+ * alignment padding, and the leftover at the end of each page) plus
+ * the objects sitting free in the cache.
+ */
+void
+kmem_cache_printstats(void)
+{
+	struct kmem_cache *kc;
+	unsigned long overhead, idle;
+
+	spinlock_acquire(&kmem_caches_lock);
+	kprintf("Object caches:\n");
+	kprintf("%-12s %5s %5s %5s %5s %6s %8s %8s\n", "name", "size",
+		"slot", "/slab", "slabs", "inuse", "overhead", "idle");
+	for (kc = kmem_caches; kc != NULL; kc = kc->kc_next) {
+		spinlock_acquire(&kc->kc_lock);
+		overhead = (unsigned long)kc->kc_nslabs *
+			(PAGE_SIZE - kc->kc_perslab * kc->kc_size);
+		idle = ((unsigned long)kc->kc_nslabs * kc->kc_perslab -
+			kc->kc_inuse) * kc->kc_size;
+		kprintf("%-12s %5lu %5lu %5u %5u %6u %8lu %8lu\n",
+			kc->kc_name, (unsigned long)kc->kc_size,
+			(unsigned long)kc->kc_slotsize, kc->kc_perslab,
+			kc->kc_nslabs, kc->kc_inuse, overhead, idle);
+		spinlock_release(&kc->kc_lock);
+	}
+	spinlock_release(&kmem_caches_lock);
+}
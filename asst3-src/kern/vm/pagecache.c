@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Per-vnode cache of read-only file pages. See pagecache.h.
+ *
+ * Executables only have a handful of pages each, so each cache is
+ * just a list.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <vm.h>
+#include <vnode.h>
+#include <pagecache.h>
+
+struct pcpage {
+	off_t pp_offset;		/* file offset of the page */
+	size_t pp_len;			/* bytes of file data in it */
+	vaddr_t pp_page;		/* kernel address of the page */
+	struct pcpage *pp_next;
+};
+
+/*
+ * Drop a list of pages.
+ */
+static
+void
+pagecache_freelist(struct pcpage *pp)
+{
+	struct pcpage *next;
+
+	for (; pp != NULL; pp = next) {
+		next = pp->pp_next;
+		free_kpages(pp->pp_page);
+		kfree(pp);
+	}
+}
+
+/*
+ * Look for a page. Call with the lock held.
+ */
+static
+struct pcpage *
+pagecache_find(struct pagecache *pc, off_t offset, size_t len)
+{
+	struct pcpage *pp;
+
+	for (pp = pc->pc_pages; pp != NULL; pp = pp->pp_next) {
+		if (pp->pp_offset == offset && pp->pp_len == len) {
+			return pp;
+		}
+	}
+	return NULL;
+}
+
+void
+pagecache_init(struct pagecache *pc)
+{
+	spinlock_init(&pc->pc_lock);
+	pc->pc_pages = NULL;
+	pc->pc_writers = 0;
+	pc->pc_generation = 0;
+}
+
+void
+pagecache_cleanup(struct pagecache *pc)
+{
+	KASSERT(pc->pc_writers == 0);
+	pagecache_freelist(pc->pc_pages);
+	pc->pc_pages = NULL;
+	spinlock_cleanup(&pc->pc_lock);
+}
+
+/*
+ * Get a page holding LEN bytes of VN's contents from OFFSET, followed
+ * by zeros. The caller gets one reference to the page.
+ */
+int
+pagecache_get(struct vnode *vn, off_t offset, size_t len, vaddr_t *ret)
+{
+	struct pagecache *pc = &vn->vn_pagecache;
+	struct pcpage *pp, *newpp;
+	struct iovec iov;
+	struct uio ku;
+	vaddr_t page;
+	unsigned generation;
+	int result;
+
+	KASSERT(offset % PAGE_SIZE == 0);
+	KASSERT(len > 0 && len <= PAGE_SIZE);
+
+	spinlock_acquire(&pc->pc_lock);
+	pp = pagecache_find(pc, offset, len);
+	if (pp != NULL) {
+		ref_kpage(pp->pp_page);
+		*ret = pp->pp_page;
+		spinlock_release(&pc->pc_lock);
+		return 0;
+	}
+	generation = pc->pc_generation;
+	spinlock_release(&pc->pc_lock);
+
+	/* Not there; read it in. */
+	page = alloc_kpages(1);
+	if (page == 0) {
+		return ENOMEM;
+	}
+	uio_kinit(&iov, &ku, (void *)page, len, offset, UIO_READ);
+	result = VOP_READ(vn, &ku);
+	if (result == 0 && ku.uio_resid != 0) {
+		/* the file is shorter than the caller thought */
+		result = EIO;
+	}
+	if (result) {
+		free_kpages(page);
+		return result;
+	}
+	bzero((char *)page + len, PAGE_SIZE - len);
+
+	/* If we can't cache it, the caller can still use it. */
+	newpp = kmalloc(sizeof(*newpp));
+	if (newpp == NULL) {
+		*ret = page;
+		return 0;
+	}
+
+	spinlock_acquire(&pc->pc_lock);
+	if (pc->pc_writers > 0 || pc->pc_generation != generation) {
+		/* The file may have changed under us; don't keep it. */
+		spinlock_release(&pc->pc_lock);
+		kfree(newpp);
+		*ret = page;
+		return 0;
+	}
+	pp = pagecache_find(pc, offset, len);
+	if (pp != NULL) {
+		/* Someone else read it in meanwhile; use theirs. */
+		ref_kpage(pp->pp_page);
+		*ret = pp->pp_page;
+		spinlock_release(&pc->pc_lock);
+		kfree(newpp);
+		free_kpages(page);
+		return 0;
+	}
+	newpp->pp_offset = offset;
+	newpp->pp_len = len;
+	newpp->pp_page = page;
+	newpp->pp_next = pc->pc_pages;
+	pc->pc_pages = newpp;
+	/* one reference for the cache and one for the caller */
+	ref_kpage(page);
+	spinlock_release(&pc->pc_lock);
+
+	*ret = page;
+	return 0;
+}
+
+void
+pagecache_startwrite(struct vnode *vn)
+{
+	struct pagecache *pc = &vn->vn_pagecache;
+	struct pcpage *pages;
+
+	spinlock_acquire(&pc->pc_lock);
+	pc->pc_writers++;
+	pc->pc_generation++;
+	pages = pc->pc_pages;
+	pc->pc_pages = NULL;
+	spinlock_release(&pc->pc_lock);
+
+	pagecache_freelist(pages);
+}
+
+void
+pagecache_endwrite(struct vnode *vn)
+{
+	struct pagecache *pc = &vn->vn_pagecache;
+
+	spinlock_acquire(&pc->pc_lock);
+	KASSERT(pc->pc_writers > 0);
+	pc->pc_writers--;
+	spinlock_release(&pc->pc_lock);
+}
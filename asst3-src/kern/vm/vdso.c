@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * The vdso pages: a read-only view of the time and our pid that user
+ * code can read without a system call. See <kern/vdso.h>.
+ *
+ * Neither page goes in the address space's page table or region
+ * list; vm_fault sends misses in the vdso range here and we load the
+ * TLB directly. That keeps the shared time page out of as_copy and
+ * as_destroy, which assume they own every frame in the page table.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <membar.h>
+#include <clock.h>
+#include <current.h>
+#include <mips/tlb.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <vdso.h>
+
+/* The time page, shared by everyone. 0 until vdso_bootstrap. */
+static paddr_t vdso_timepage;
+
+/*
+ * Set up the time page.
+ */
+void
+vdso_bootstrap(void)
+{
+	vaddr_t page;
+
+	page = alloc_kpages(1);
+	if (page == 0) {
+		panic("vdso: Out of memory for the time page\n");
+	}
+	bzero((void *)page, PAGE_SIZE);
+
+	/* the clock interrupt may look at it as soon as it's set */
+	membar_store_store();
+	vdso_timepage = KVADDR_TO_PADDR(page);
+}
+
+/*
+ * Update the time page. Only CPU 0 does this, so there is only ever
+ * one writer.
+ */
+void
+vdso_tick(void)
+{
+	struct vdso_time *vt;
+	struct timespec ts;
+
+	if (vdso_timepage == 0 || curcpu->c_number != 0) {
+		return;
+	}
+	vt = (struct vdso_time *)PADDR_TO_KVADDR(vdso_timepage);
+
+	gettime(&ts);
+
+	vt->vt_seq++;
+	membar_store_store();
+	vt->vt_sec = ts.tv_sec;
+	vt->vt_nsec = ts.tv_nsec;
+	membar_store_store();
+	vt->vt_seq++;
+}
+
+/*
+ * Give a new address space its process page.
+ */
+int
+vdso_as_init(struct addrspace *as)
+{
+	vaddr_t page;
+
+	page = alloc_zeroed_kpage();
+	if (page == 0) {
+		return ENOMEM;
+	}
+	as->as_vdso = KVADDR_TO_PADDR(page);
+	return 0;
+}
+
+void
+vdso_as_cleanup(struct addrspace *as)
+{
+	if (as->as_vdso != 0) {
+		free_kpages(PADDR_TO_KVADDR(as->as_vdso));
+		as->as_vdso = 0;
+	}
+}
+
+/*
+ * Record the pid of the process that owns AS. This happens before
+ * the process runs any user code in AS, so no barrier is needed.
+ */
+void
+vdso_setpid(struct addrspace *as, pid_t pid)
+{
+	struct vdso_proc *vp;
+
+	vp = (struct vdso_proc *)PADDR_TO_KVADDR(as->as_vdso);
+	vp->vp_pid = pid;
+}
+
+/*
+ * TLB miss on a vdso page. Both pages are read-only, so writes fail.
+ */
+int
+vdso_fault(struct addrspace *as, int faulttype, vaddr_t faultaddress)
+{
+	paddr_t paddr;
+	int spl;
+
+	KASSERT(VDSO_CONTAINS(faultaddress));
+
+	if (faulttype != VM_FAULT_READ) {
+		return EFAULT;
+	}
+
+	faultaddress &= PAGE_FRAME;
+	paddr = faultaddress == VDSO_TIME ? vdso_timepage : as->as_vdso;
+	if (paddr == 0) {
+		return EFAULT;
+	}
+
+	spl = splhigh();
+	tlb_random(faultaddress, paddr | TLBLO_VALID);
+	splx(spl);
+	return 0;
+}
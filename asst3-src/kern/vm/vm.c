@@ -1,14 +1,24 @@
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/mman.h>
+#include <kern/stat.h>
 #include <lib.h>
+#include <spinlock.h>
+#include <uio.h>
 #include <thread.h>
 #include <addrspace.h>
 #include <vm.h>
 #include <machine/tlb.h>
+#include <mips/trapframe.h>
 #include <proc.h>
 #include <current.h>
 #include <elf.h>
 #include <spl.h>
+#include <synch.h>
+#include <vdso.h>
+#include <vnode.h>
+#include <cpu.h>
+#include <trace.h>
 
 /* Place your page table functions here */
 
@@ -19,21 +29,109 @@ void vm_bootstrap(void)
      * You may or may not need to add anything here depending what's
      * provided or required by the assignment spec.
      */
+    as_bootstrap();
 }
 
 /* Design of vm_fault:
  *      1. check the fault type and if the faultaddress is valid
  *      2. check if the entry in the pagetable
  *      3. add to TLB
+ *
+ * Write faults on a page that's mapped read-only (no TLBLO_DIRTY) in
+ * a writeable region come from mmap: shared file pages start out
+ * read-only so we can tell which ones need writing back, and private
+ * file pages start out as the page cache's copy and get their own on
+ * the first write.
  */
 
+// fill in the page at VADDR of a file mapping (see as_map); hands back the pte
+static int
+vm_mapfault(struct region *r, vaddr_t vaddr, int faulttype, paddr_t *ret)
+{
+    off_t offset = r->mapoffset + (vaddr - r->base);
+    bool private = (r->mapflags & MAP_PRIVATE) != 0;
+    struct stat st;
+    struct iovec iov;
+    struct uio ku;
+    size_t len;
+    vaddr_t vpage;
+    int result;
+
+    result = VOP_STAT(r->mapvn, &st);
+    if (result) return result;
+    len = 0;
+    if (offset < st.st_size) {
+        len = st.st_size - offset < PAGE_SIZE ? st.st_size - offset : PAGE_SIZE;
+    }
+
+    // just reading a private mapping: share the page cache's copy until it's written
+    if (private && len > 0 && (faulttype != VM_FAULT_WRITE || r->writeable == 0)) {
+        result = pagecache_get(r->mapvn, offset, len, &vpage);
+        if (result) return result;
+        *ret = (kvaddr_to_paddr(vpage) & PAGE_FRAME) | TLBLO_VALID;
+        return 0;
+    }
+
+    vpage = alloc_kpages(1);
+    if (vpage == 0) return ENOMEM;
+
+    if (len > 0) {
+        uio_kinit(&iov, &ku, (void *)vpage, len, offset, UIO_READ);
+        result = VOP_READ(r->mapvn, &ku);
+        if (result) {
+            free_kpages(vpage);
+            return result;
+        }
+        // the file may have shrunk since we looked
+        len -= ku.uio_resid;
+    }
+    bzero((char *)vpage + len, PAGE_SIZE - len);
+
+    *ret = (kvaddr_to_paddr(vpage) & PAGE_FRAME) | TLBLO_VALID;
+    // a shared page stays clean until it's actually written
+    if (r->writeable && (private || faulttype == VM_FAULT_WRITE)) {
+        *ret |= TLBLO_DIRTY;
+    }
+    return 0;
+}
+
+// a write to a page mapped without TLBLO_DIRTY; updates *PTEP
+static int
+vm_writefault(struct region *r, vaddr_t vaddr, paddr_t *ptep)
+{
+    paddr_t pte = *ptep;
+    vaddr_t vpage;
+
+    if (r == NULL || r->writeable == 0 || (pte & TLBLO_VALID) == 0) return EFAULT;
+
+    // another thread got here first and our tlb just hadn't caught up
+    if (pte & TLBLO_DIRTY) return 0;
+
+    // a shared mapping just notes that the page needs writing back
+    if (r->mapflags & MAP_SHARED) {
+        *ptep = pte | TLBLO_DIRTY;
+        return 0;
+    }
+
+    // otherwise someone else (the page cache, or the other side of a fork) has this frame too
+    vpage = alloc_kpages(1);
+    if (vpage == 0) return ENOMEM;
+    memmove((void *)vpage, (const void *)paddr_to_kvaddr(pte & PAGE_FRAME), PAGE_SIZE);
+    *ptep = (kvaddr_to_paddr(vpage) & PAGE_FRAME) | TLBLO_DIRTY | TLBLO_VALID;
+
+    // other threads may still be reading the old frame through their TLBs
+    vm_tlbinvalidate(vaddr & PAGE_FRAME, (vaddr & PAGE_FRAME) + PAGE_SIZE);
+    free_kpages(paddr_to_kvaddr(pte & PAGE_FRAME));
+    return 0;
+}
 
 int
 vm_fault(int faulttype, vaddr_t faultaddress)
 {
+    TRACE(TRACE_VMFAULT, faulttype, faultaddress);
+
     switch (faulttype){
         case VM_FAULT_READONLY:
-        return EFAULT;
 	    case VM_FAULT_READ:
 	    case VM_FAULT_WRITE:
 		break;
@@ -48,6 +146,12 @@ vm_fault(int faulttype, vaddr_t faultaddress)
     if (as == NULL) return EFAULT;
 
     if (faultaddress == 0) return EFAULT;
+
+    // the vdso pages aren't in the page table
+    if (VDSO_CONTAINS(faultaddress)) {
+        if (faulttype == VM_FAULT_READONLY) return EFAULT;
+        return vdso_fault(as, faulttype, faultaddress);
+    }
     
     // change the vaddr to paddr, and take out the index ? 
     // but i don't think we need to use paddr to get page entry, actually, we need vaddr bits to get the entry
@@ -55,48 +159,89 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 
     uint32_t fbits = faultaddress >> 22;
     uint32_t mbits = (faultaddress << 10) >> 22;
+    paddr_t pte;
+    int result;
 
-    // if it is not in the page table, we need to add entry to page table
-
-    // first case: no the whole level 2 pagetable
+    // other threads in this process may be faulting on the same table
+    lock_acquire(as->as_lock);
 
-    if (as->pt[fbits] == NULL){
-        as->pt[fbits] = (paddr_t *) alloc_kpages(1);
-        if (as->pt[fbits] == 0) return ENOMEM;
-        for (int i = 0; i < PTE_NUMBER; i++){
-            as->pt[fbits][i] = 0;
+    if (faulttype == VM_FAULT_READONLY) {
+        // writing a page we handed out read-only; it must be there already
+        if (as->pt == NULL || as->pt[fbits] == NULL) {
+            lock_release(as->as_lock);
+            return EFAULT;
+        }
+        result = vm_writefault(as_find_region(as, faultaddress), faultaddress,
+                               &as->pt[fbits][mbits]);
+        if (result) {
+            lock_release(as->as_lock);
+            return result;
         }
     }
-    
-    // second case: no entry in the page table. if meet case 1, must meet case 2
 
-    if (as->pt[fbits][mbits] == 0){
+    // if it is not in the page table, we need to add entry to page table
+
+    if (as->pt == NULL || as->pt[fbits] == NULL || as->pt[fbits][mbits] == 0){
         // first, check if the addr is valid or not, and get what region it is
-        struct region *tregion = as->regions;
-        while (tregion != NULL) {
-            if (faultaddress >= tregion->base && faultaddress < (tregion->base + tregion->memsize)){
-                break;
-            }
-            tregion = tregion->next;
-        }
-        
+        // (before making a level 2 table, so a bad address doesn't leave an empty one)
+        struct region *tregion = as_find_region(as, faultaddress);
+
         if (tregion == NULL){
-            // kfree(as->pt[fbits]);
+            lock_release(as->as_lock);
             return EFAULT;
         }
 
-        // allocate one page for frame (page fault -> no this page at phys memo )
-        vaddr_t vpage =(vaddr_t) alloc_kpages(1);
-        if (vpage == 0) return ENOMEM;
-        // paddr_t pframe = kvaddr_to_paddr(vpage);
-        bzero((void *)vpage, PAGE_SIZE);
+        if (tregion->mapvn != NULL) {
+            // mmap'd file: read it in (or share it) without the lock, since the file
+            // system may be holding its own locks while it waits on one of our faults
+            struct region map = *tregion;
+
+            VOP_INCREF(map.mapvn);
+            lock_release(as->as_lock);
+            result = vm_mapfault(&map, faultaddress & PAGE_FRAME, faulttype, &pte);
+            VOP_DECREF(map.mapvn);
+            if (result) return result;
+            lock_acquire(as->as_lock);
 
-        paddr_t pframe = kvaddr_to_paddr(vpage) & PAGE_FRAME;
+            // if the mapping changed meanwhile, forget it and let the access fault again
+            tregion = as_find_region(as, faultaddress);
+            if (tregion == NULL || tregion->mapvn != map.mapvn || tregion->base != map.base ||
+                tregion->mapoffset != map.mapoffset) {
+                lock_release(as->as_lock);
+                free_kpages(paddr_to_kvaddr(pte & PAGE_FRAME));
+                return 0;
+            }
+        } else {
+            // allocate one page for frame (page fault -> no this page at phys memo )
+            // idle cpus have usually zeroed one for us already
+            vaddr_t vpage =(vaddr_t) alloc_zeroed_kpage();
+            if (vpage == 0) {
+                lock_release(as->as_lock);
+                return ENOMEM;
+            }
 
-        if (tregion->writeable != 0) pframe = pframe | TLBLO_DIRTY;
+            pte = kvaddr_to_paddr(vpage) & PAGE_FRAME;
 
-        as->pt[fbits][mbits] = pframe | TLBLO_VALID;
+            if (tregion->writeable != 0) pte = pte | TLBLO_DIRTY;
 
+            pte |= TLBLO_VALID;
+        }
+
+        // then make sure there's a level 2 table (and a directory) to put it in
+        result = as_ptalloc(as, faultaddress);
+        if (result) {
+            lock_release(as->as_lock);
+            free_kpages(paddr_to_kvaddr(pte & PAGE_FRAME));
+            return result;
+        }
+
+        if (as->pt[fbits][mbits] == 0) {
+            as->pt[fbits][mbits] = pte;
+            as->as_ptcount[fbits]++;
+        } else {
+            // another thread beat us to it while we were reading
+            free_kpages(paddr_to_kvaddr(pte & PAGE_FRAME));
+        }
     }
 
     // store this entry: p_addr, dirty bit, valid bit
@@ -104,22 +249,94 @@ vm_fault(int faulttype, vaddr_t faultaddress)
         // if it is in pagetable, but not in the TLB, we only need to load it to the tlb
     //}   
     
-    // disable the cpu interrupts and randomly add this to tlb by tlb_random(entryhi, entrylo)
+    // entries can be changed or taken away (mmap), so load the tlb before letting go:
+    // whoever does that waits for every cpu to drop the old entry after they have the lock
+    pte = as->pt[fbits][mbits];
+
+    // disable the cpu interrupts and add this to tlb, replacing the read-only entry if there is one
     int spl = splhigh();
-    tlb_random(faultaddress & PAGE_FRAME, as->pt[fbits][mbits]);
+    int index = tlb_probe(faultaddress & PAGE_FRAME, 0);
+    if (index < 0) {
+        tlb_random(faultaddress & PAGE_FRAME, pte);
+    } else {
+        tlb_write(faultaddress & PAGE_FRAME, pte, index);
+    }
+    // the directory may have been made after this cpu activated us (by another thread)
+    cpupagedirs[curcpu->c_number] = (vaddr_t)as->pt;
     splx(spl);
+
+    lock_release(as->as_lock);
     return 0;
     // return EFAULT;
 }
 
+// drop any entries for the pages from START to END from this cpu's TLB; interrupts off
+static void
+vm_tlbdrop(vaddr_t start, vaddr_t end)
+{
+	vaddr_t va;
+	int i;
+
+	if ((end - start) / PAGE_SIZE > NUM_TLB) {
+		// cheaper to throw the lot away
+		for (i = 0; i < NUM_TLB; i++) {
+			tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+		}
+		return;
+	}
+	for (va = start; va < end; va += PAGE_SIZE) {
+		i = tlb_probe(va, 0);
+		if (i >= 0) {
+			tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+		}
+	}
+}
+
+void
+vm_tlbinvalidate(vaddr_t start, vaddr_t end)
+{
+	struct tlbshootdown ts;
+	struct spinlock lock;
+	unsigned sent, done;
+	int spl;
+
+	spinlock_init(&lock);
+	done = 0;
+	ts.ts_start = start & PAGE_FRAME;
+	ts.ts_end = end;
+	ts.ts_lock = &lock;
+	ts.ts_done = &done;
+
+	// stay on this cpu until we've dropped our own entries too
+	spl = splhigh();
+	sent = ipi_tlbshootdown_broadcast(&ts);
+	vm_tlbdrop(ts.ts_start, ts.ts_end);
+	splx(spl);
+
+	// ts is on our stack, so wait until nobody's looking at it
+	spinlock_acquire(&lock);
+	while (done < sent) {
+		spinlock_release(&lock);
+		spinlock_acquire(&lock);
+	}
+	spinlock_release(&lock);
+	spinlock_cleanup(&lock);
+}
+
 /*
- * SMP-specific functions.  Unused in our UNSW configuration.
+ * SMP-specific functions.
  */
 
 void
 vm_tlbshootdown(const struct tlbshootdown *ts)
 {
-	(void)ts;
-	panic("vm tried to do tlb shootdown?!\n");
-}
+	int spl;
+
+	spl = splhigh();
+	vm_tlbdrop(ts->ts_start, ts->ts_end);
+	splx(spl);
 
+	spinlock_acquire(ts->ts_lock);
+	(*ts->ts_done)++;
+	spinlock_release(ts->ts_lock);
+}
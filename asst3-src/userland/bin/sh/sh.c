@@ -45,6 +45,7 @@
 #include <limits.h>
 #include <errno.h>
 #include <err.h>
+#include <spawn.h>
 
 #ifdef HOST
 #include "hostcompat.h"
@@ -58,6 +59,9 @@
 /* avoid making this unreasonably large; causes problems under dumbvm */
 #define CMDLINE_MAX 4096
 
+/* most commands in one pipeline */
+#define PIPELINE_MAX 16
+
 /* struct to (portably) hold exit info */
 struct exitinfo {
 	unsigned val:8,
@@ -355,19 +359,40 @@ static struct {
 	{ NULL, NULL }
 };
 
+/*
+ * addaction
+ * appends a file action for spawnvp.
+ */
+static
+void
+addaction(struct spawn_action *acts, int *nacts, int op, int fd, int newfd)
+{
+	acts[*nacts].sa_op = op;
+	acts[*nacts].sa_fd = fd;
+	acts[*nacts].sa_newfd = newfd;
+	(*nacts)++;
+}
+
 /*
  * docommand
  * tokenizes the command line using strtok.  if there aren't any commands,
  * simply returns.  checks to see if it's a builtin, running it if it is.
  * otherwise, it's a standard command.  check for the '&', try to background
- * the job if possible, otherwise just run it and wait on it.
+ * the job if possible, otherwise just run it and wait on it.  a command
+ * split up with '|' is run as a pipeline; only the last command's exit
+ * status counts.
  */
 static
 void
 docommand(char *buf, struct exitinfo *ei)
 {
 	char *args[NARG_MAX + 1];
-	int nargs, i;
+	char **stages[PIPELINE_MAX];
+	pid_t pids[PIPELINE_MAX];
+	int nargs, nstages, i, j;
+	int infd, pfds[2];
+	struct spawn_action acts[5];
+	int nacts, failcode;
 	char *s;
 	pid_t pid;
 	int status;
@@ -417,31 +442,96 @@ docommand(char *buf, struct exitinfo *ei)
 		bg = 1;
 	}
 
+	/* split into pipeline stages at each '|' */
+	nstages = 0;
+	stages[nstages++] = args;
+	for (i=0; i<nargs; i++) {
+		if (strcmp(args[i], "|") != 0) {
+			continue;
+		}
+		if (nstages >= PIPELINE_MAX) {
+			printf("%s: Too many commands in pipeline\n", args[0]);
+			exitinfo_exit(ei, 1);
+			return;
+		}
+		args[i] = NULL;
+		stages[nstages++] = &args[i+1];
+	}
+	for (i=0; i<nstages; i++) {
+		if (stages[i][0] == NULL) {
+			printf("Missing command in pipeline\n");
+			exitinfo_exit(ei, 1);
+			return;
+		}
+	}
+	if (bg && nstages > 1) {
+		printf("%s: Cannot background a pipeline\n", args[0]);
+		exitinfo_exit(ei, 1);
+		return;
+	}
+
 	if (timing) {
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			exitinfo_exit(ei, 255);
-			return;
-		case 0:
-			/* child */
-			execvp(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
+	/*
+	 * Start each command with spawnvp, hooking it up to the pipes
+	 * on either side with file actions. This avoids copying the
+	 * whole shell into a child only to throw it away with execv.
+	 */
+	infd = STDIN_FILENO;
+	failcode = 0;
+	for (i=0; i<nstages; i++) {
+		nacts = 0;
+		if (infd != STDIN_FILENO) {
+			addaction(acts, &nacts, SPAWN_DUP2, infd, STDIN_FILENO);
+			addaction(acts, &nacts, SPAWN_CLOSE, infd, 0);
+		}
+		if (i < nstages-1) {
+			if (pipe(pfds) < 0) {
+				warn("pipe");
+				failcode = 255;
+				break;
+			}
+			addaction(acts, &nacts, SPAWN_CLOSE, pfds[0], 0);
+			addaction(acts, &nacts, SPAWN_DUP2, pfds[1],
+				  STDOUT_FILENO);
+			addaction(acts, &nacts, SPAWN_CLOSE, pfds[1], 0);
+		}
+
+		pid = spawnvp(stages[i][0], stages[i], acts, nacts);
+		if (pid < 0) {
+			warn("%s", stages[i][0]);
+			if (i < nstages-1) {
+				close(pfds[0]);
+				close(pfds[1]);
+			}
+			failcode = 1;
 			break;
+		}
+		pids[i] = pid;
+
+		/* pass the read end on to the next command */
+		if (infd != STDIN_FILENO) {
+			close(infd);
+		}
+		if (i < nstages-1) {
+			close(pfds[1]);
+			infd = pfds[0];
+		}
+	}
+	if (infd != STDIN_FILENO) {
+		close(infd);
+	}
+
+	/* collect everything but the last command */
+	for (j=0; j<i && j<nstages-1; j++) {
+		waitpid(pids[j], &status, 0);
+	}
+	if (failcode) {
+		/* couldn't start the whole pipeline */
+		exitinfo_exit(ei, failcode);
+		return;
 	}
 
 	/* parent */
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _SYSRING_H_
+#define _SYSRING_H_
+
+/*
+ * Batched system calls. Get struct sysring and struct sysring_entry
+ * from the kernel, and the SYS_* call numbers to put in them.
+ */
+#include <sys/types.h>
+#include <kern/syscall.h>
+#include <kern/sysring.h>
+
+/*
+ * The system call: run every entry queued in RING. Returns the
+ * number of entries run, or -1 if the ring itself is bad. Results
+ * for the individual calls are left in the entries.
+ */
+int sysring_enter(struct sysring *ring);
+
+/*
+ * Library helpers.
+ *
+ * sysring_create allocates a ring with room for NENTRIES requests
+ * (rounded up to a power of 2); free it with free().
+ *
+ * sysring_queue fills in the next free entry and returns it, or
+ * returns NULL if the ring is full. Pointers and sizes are passed
+ * as ints, the way they would go in registers.
+ */
+struct sysring *sysring_create(unsigned nentries);
+struct sysring_entry *sysring_queue(struct sysring *ring, int flags,
+				    int callno, int a0, int a1, int a2);
+
+
+#endif /* _SYSRING_H_ */
@@ -40,6 +40,7 @@
  */
 #include <kern/fcntl.h>
 #include <kern/ioctl.h>
+#include <kern/mman.h>
 #include <kern/reboot.h>
 #include <kern/seek.h>
 #include <kern/time.h>
@@ -145,9 +146,19 @@ ssize_t getdirentry(int filehandle, char *buf, size_t buflen);
 int symlink(const char *target, const char *linkname);
 ssize_t readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+ssize_t copy_file_range(int infile, off_t *inpos, int outfile, off_t *outpos,
+                        size_t size, unsigned flags);
 int pipe(int filehandles[2]);
 int __time(time_t *seconds, unsigned long *nanoseconds);
 ssize_t __getcwd(char *buf, size_t buflen);
+int futex_wait(volatile int *addr, int val);
+int futex_wake(volatile int *addr, int n);
+pid_t __thread_create(void *entry, void *arg0, void *arg1);
+__DEAD void thread_exit(int code);
+int thread_join(pid_t tid, int *status);
+pid_t gettid(void);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -157,17 +168,31 @@ ssize_t __getcwd(char *buf, size_t buflen);
 
 int execvp(const char *prog, char *const *args); /* calls execv */
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
-time_t time(time_t *seconds);			/* calls __time */
+time_t time(time_t *seconds);			/* reads the vdso */
+pid_t thread_create(int (*func)(void *), void *arg); /* calls __thread_create */
+
+/*
+ * The $PATH search behind execvp and spawnvp
+ * (for libc internal use only)
+ */
+int __pathsearch(const char *prog,
+		 int (*tryfunc)(void *clientdata, const char *path),
+		 void *clientdata);
 
 /* UNSW versions of mmap() and munmap()
  * This are simplified compared to the standard version on UNIX
  * You should implement this version as this is what we expect to test.
+ *
+ * PROT_READ, PROT_WRITE, MAP_SHARED and MAP_PRIVATE all go in PROT;
+ * see <kern/mman.h>. Pass fd -1 for anonymous memory. munmap and
+ * msync take the address mmap returned and act on the whole mapping;
+ * msync writes a shared mapping's modified pages back to the file.
  */
 
-#define PROT_READ 1
-#define PROT_WRITE 2
+#define MAP_FAILED ((void *)-1)		/* mmap's error return */
 
 void *mmap(size_t length, int prot, int fd, off_t offset);
 int munmap(void *addr);
+int msync(void *addr);
 
 #endif /* _UNISTD_H_ */
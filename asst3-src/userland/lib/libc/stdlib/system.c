@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <spawn.h>
 
 /*
  * system(): ANSI C
@@ -74,18 +75,25 @@ system(const char *cmd)
 
 	argv[nargs] = NULL;
 
-	pid = fork();
-	switch (pid) {
-	    case -1:
-		return -1;
-	    case 0:
-		/* child */
-		execv(argv[0], argv);
-		/* exec only returns if it fails */
-		_exit(255);
-	    default:
-		/* parent */
-		waitpid(pid, &status, 0);
-		return status;
+	/*
+	 * spawnv saves copying our whole address space into a child
+	 * that's just going to exec. If the program can't be run we
+	 * find out here, with no child to wait for; report that the
+	 * way a forked child that failed in execv would have, by
+	 * exiting with 255. Failing to make the process at all is
+	 * still an error, as it was from fork.
+	 */
+	pid = spawnv(argv[0], argv, NULL, 0);
+	if (pid < 0) {
+		switch (errno) {
+		    case ENPROC:
+		    case EMPROC:
+		    case ENOMEM:
+			return -1;
+		    default:
+			return _MKWAIT_EXIT(255);
+		}
 	}
+	waitpid(pid, &status, 0);
+	return status;
 }
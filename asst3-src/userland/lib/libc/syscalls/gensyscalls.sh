@@ -13,6 +13,9 @@ awk '
     /^\/\*CALLBEGIN\*\// { look=1; }
     /^\/\*CALLEND\*\// { look=0; }
 
+    # getpid is answered from the vdso process page (unix/vdso.c).
+    /^#define SYS_getpid / { next; }
+
     # And, do not read lines that do not match the approximate right pattern.
     look && /^#define SYS_/ && NF==3 {
 	sub("^SYS_", "", $2);
@@ -28,15 +28,30 @@
  */
 
 #include <unistd.h>
+#include <kern/vdso.h>
 
 /*
  * POSIX C function: retrieve time in seconds since the epoch.
- * Uses the OS/161 system call __time, which does the same thing
- * but also returns nanoseconds.
+ *
+ * Rather than calling __time (the OS/161 system call, which does the
+ * same thing but also returns nanoseconds), read the vdso time page,
+ * which is as of the last clock tick. See <kern/vdso.h>.
  */
 
 time_t
 time(time_t *t)
 {
-	return __time(t, NULL);
+	const struct vdso_time *vt = (const struct vdso_time *)VDSO_TIME;
+	unsigned seq;
+	time_t s;
+
+	do {
+		seq = vt->vt_seq;
+		s = vt->vt_sec;
+	} while ((seq & 1) || vt->vt_seq != seq);
+
+	if (t != NULL) {
+		*t = s;
+	}
+	return s;
 }
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <unistd.h>
+#include <mutex.h>
+
+/*
+ * User-level mutex; see mutex.h. This is the usual three-state futex
+ * mutex: 0 = unlocked, 1 = locked, 2 = locked with (possible) waiters.
+ */
+
+/*
+ * Atomically: if *p == old, set it to new. Returns the previous value
+ * of *p either way.
+ */
+static
+int
+cas(volatile int *p, int old, int new)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set noreorder;"	/* we do our own delay slots */
+		"1: ll %0, 0(%2);"	/* prev = *p */
+		"bne %0, %3, 2f;"	/* if prev != old, give up */
+		" move %1, %4;"		/*   (delay slot) tmp = new */
+		"sc %1, 0(%2);"		/* *p = tmp, if still reserved */
+		"beqz %1, 1b;"		/* lost the reservation: retry */
+		" nop;"			/*   (delay slot) */
+		"2: .set pop"		/* restore assembler mode */
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (old), "r" (new)
+		: "memory");
+	return prev;
+}
+
+/*
+ * Atomically set *p to new and return what was there before.
+ */
+static
+int
+xchg(volatile int *p, int new)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set noreorder;"	/* we do our own delay slots */
+		"1: ll %0, 0(%2);"	/* prev = *p */
+		"move %1, %3;"		/* tmp = new */
+		"sc %1, 0(%2);"		/* *p = tmp, if still reserved */
+		"beqz %1, 1b;"		/* lost the reservation: retry */
+		" nop;"			/*   (delay slot) */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (new)
+		: "memory");
+	return prev;
+}
+
+void
+mutex_init(struct mutex *m)
+{
+	m->m_state = 0;
+}
+
+int
+mutex_trylock(struct mutex *m)
+{
+	return cas(&m->m_state, 0, 1) == 0 ? 0 : -1;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+	int c;
+
+	/* Fast path: unlocked to locked, no system call. */
+	c = cas(&m->m_state, 0, 1);
+	if (c == 0) {
+		return;
+	}
+
+	/*
+	 * Slow path. Mark the mutex contended and sleep until we are
+	 * the one who moves it off 0. We always leave it at 2 when we
+	 * get it this way, since we can't tell whether anyone else is
+	 * still waiting; that costs at most one extra futex_wake.
+	 */
+	if (c != 2) {
+		c = xchg(&m->m_state, 2);
+	}
+	while (c != 0) {
+		/* EAGAIN just means it changed under us; look again. */
+		futex_wait(&m->m_state, 2);
+		c = xchg(&m->m_state, 2);
+	}
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+	/* If nobody was waiting, we're done without entering the kernel. */
+	if (xchg(&m->m_state, 0) == 2) {
+		futex_wake(&m->m_state, 1);
+	}
+}
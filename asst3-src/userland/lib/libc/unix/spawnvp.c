@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <unistd.h>
+#include <spawn.h>
+
+struct spawnvp_args {
+	char *const *args;
+	const struct spawn_action *actions;
+	int nactions;
+	pid_t pid;
+};
+
+static
+int
+spawnvp_try(void *clientdata, const char *path)
+{
+	struct spawnvp_args *sa = clientdata;
+
+	sa->pid = spawnv(path, sa->args, sa->actions, sa->nactions);
+	return sa->pid < 0 ? -1 : 0;
+}
+
+/*
+ * Spawn a program on the search path. Tries spawnv() repeatedly
+ * until one of the choices works, like execvp.
+ */
+pid_t
+spawnvp(const char *prog, char *const *args,
+	const struct spawn_action *actions, int nactions)
+{
+	struct spawnvp_args sa;
+
+	sa.args = args;
+	sa.actions = actions;
+	sa.nactions = nactions;
+	sa.pid = -1;
+	if (__pathsearch(prog, spawnvp_try, &sa) < 0) {
+		return -1;
+	}
+	return sa.pid;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+
+#include <stdlib.h>
+#include <errno.h>
+#include <sysring.h>
+
+/*
+ * Helpers for setting up batched system calls; see <sysring.h>.
+ */
+
+struct sysring *
+sysring_create(unsigned nentries)
+{
+	struct sysring *ring;
+	unsigned size;
+
+	if (nentries == 0 || nentries > SYSRING_MAXSIZE) {
+		errno = EINVAL;
+		return NULL;
+	}
+	for (size = 1; size < nentries; size *= 2) {
+		/* nothing */
+	}
+
+	ring = malloc(sizeof(*ring) + size * sizeof(struct sysring_entry));
+	if (ring == NULL) {
+		return NULL;
+	}
+	ring->sr_head = 0;
+	ring->sr_tail = 0;
+	ring->sr_size = size;
+	ring->sr_pad = 0;
+	return ring;
+}
+
+struct sysring_entry *
+sysring_queue(struct sysring *ring, int flags,
+	      int callno, int a0, int a1, int a2)
+{
+	struct sysring_entry *sre;
+
+	if (ring->sr_tail - ring->sr_head >= ring->sr_size) {
+		return NULL;
+	}
+	sre = SYSRING_ENTRY(ring, ring->sr_tail);
+	sre->sre_callno = callno;
+	sre->sre_flags = flags;
+	sre->sre_args[0] = a0;
+	sre->sre_args[1] = a1;
+	sre->sre_args[2] = a2;
+	sre->sre_retval = 0;
+	sre->sre_errno = 0;
+	ring->sr_tail++;
+	return sre;
+}
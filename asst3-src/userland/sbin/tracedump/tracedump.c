@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * tracedump - decode kernel trace records.
+ *
+ * Usage: tracedump [file]
+ *
+ * Reads the records written by the kernel's "trace file" menu command
+ * (or, on OS/161, read straight from trace:, the default) and prints
+ * them in time order, with times relative to the first record.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#include "kern/trace.h"
+
+#ifdef HOST
+/*
+ * OS/161 runs natively on a big-endian platform, so we can
+ * conveniently use the byteswapping functions for network byte order.
+ */
+#include <netinet/in.h> // for arpa/inet.h
+#include <arpa/inet.h>  // for ntohl
+#define SWAP32(x) ntohl(x)
+#define SWAP16(x) ntohs(x)
+#else
+#define SWAP32(x) (x)
+#define SWAP16(x) (x)
+#endif
+
+/* Records read per read() call. */
+#define CHUNK 64
+
+#define ARRAYCOUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+/* Names for the events in kern/trace.h. */
+static const char *const eventnames[TRACE_NEVENTS] = {
+	"lost",
+	"switch",
+	"syscall",
+	"vmfault",
+	"sfsread",
+	"sfswrite",
+};
+
+/* Names for the fault types in the kernel's vm.h. */
+static const char *const faultnames[] = {
+	"read",
+	"write",
+	"readonly",
+};
+
+/* Names for the thread states in the kernel's thread.h. */
+static const char *const statenames[] = {
+	"run",
+	"ready",
+	"sleep",
+	"zombie",
+};
+
+static struct trace_record *recs;
+static unsigned nrecs, maxrecs;
+
+/*
+ * Make room for CHUNK more records. There's no realloc in our libc.
+ */
+static
+void
+grow(void)
+{
+	struct trace_record *n;
+
+	if (nrecs + CHUNK <= maxrecs) {
+		return;
+	}
+	maxrecs = maxrecs ? maxrecs * 2 : 1024;
+	n = malloc(maxrecs * sizeof(*n));
+	if (n == NULL) {
+		errx(1, "Out of memory");
+	}
+	if (recs != NULL) {
+		memcpy(n, recs, nrecs * sizeof(*n));
+		free(recs);
+	}
+	recs = n;
+}
+
+static
+void
+readrecs(const char *path)
+{
+	struct trace_record *r;
+	ssize_t len;
+	unsigned i, n;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", path);
+	}
+	while (1) {
+		grow();
+		len = read(fd, &recs[nrecs], CHUNK * sizeof(*recs));
+		if (len < 0) {
+			err(1, "%s: read", path);
+		}
+		if (len == 0) {
+			break;
+		}
+		if (len % sizeof(*recs) != 0) {
+			errx(1, "%s: partial record", path);
+		}
+		n = len / sizeof(*recs);
+		for (i=0; i<n; i++) {
+			r = &recs[nrecs + i];
+			r->tr_sec = SWAP32(r->tr_sec);
+			r->tr_nsec = SWAP32(r->tr_nsec);
+			r->tr_event = SWAP16(r->tr_event);
+			r->tr_thread = SWAP32(r->tr_thread);
+			r->tr_args[0] = SWAP32(r->tr_args[0]);
+			r->tr_args[1] = SWAP32(r->tr_args[1]);
+		}
+		nrecs += n;
+	}
+	close(fd);
+}
+
+static
+int
+reccmp(const void *av, const void *bv)
+{
+	const struct trace_record *a = av, *b = bv;
+
+	if (a->tr_sec != b->tr_sec) {
+		return a->tr_sec < b->tr_sec ? -1 : 1;
+	}
+	if (a->tr_nsec != b->tr_nsec) {
+		return a->tr_nsec < b->tr_nsec ? -1 : 1;
+	}
+	return (int)a->tr_cpu - (int)b->tr_cpu;
+}
+
+static
+const char *
+name(const char *const *names, unsigned num, uint32_t val)
+{
+	return val < num ? names[val] : "?";
+}
+
+static
+void
+printrec(const struct trace_record *r, const struct trace_record *first)
+{
+	uint32_t sec, nsec;
+
+	sec = r->tr_sec - first->tr_sec;
+	if (r->tr_nsec >= first->tr_nsec) {
+		nsec = r->tr_nsec - first->tr_nsec;
+	}
+	else {
+		sec--;
+		nsec = r->tr_nsec + 1000000000 - first->tr_nsec;
+	}
+	printf("%5u.%09u cpu%-2u 0x%08x %-8s ", sec, nsec, r->tr_cpu,
+	       r->tr_thread, name(eventnames, ARRAYCOUNT(eventnames), r->tr_event));
+
+	switch (r->tr_event) {
+	    case TRACE_LOST:
+		printf("%u records dropped\n", r->tr_args[0]);
+		break;
+	    case TRACE_SWITCH:
+		printf("to 0x%08x, %s\n", r->tr_args[0],
+		       name(statenames, ARRAYCOUNT(statenames), r->tr_args[1]));
+		break;
+	    case TRACE_SYSCALL:
+		printf("%u\n", r->tr_args[0]);
+		break;
+	    case TRACE_VMFAULT:
+		printf("%s 0x%08x\n", name(faultnames, ARRAYCOUNT(faultnames), r->tr_args[0]),
+		       r->tr_args[1]);
+		break;
+	    case TRACE_SFSREAD:
+	    case TRACE_SFSWRITE:
+		printf("block %u\n", r->tr_args[0]);
+		break;
+	    default:
+		printf("%u %u\n", r->tr_args[0], r->tr_args[1]);
+		break;
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *path;
+	unsigned i;
+
+#ifdef HOST
+	if (argc != 2) {
+		errx(1, "Usage: tracedump file");
+	}
+	path = argv[1];
+#else
+	if (argc > 2) {
+		errx(1, "Usage: tracedump [file]");
+	}
+	path = argc == 2 ? argv[1] : "trace:";
+#endif
+
+	readrecs(path);
+	if (nrecs == 0) {
+		printf("No trace records\n");
+		return 0;
+	}
+
+	qsort(recs, nrecs, sizeof(*recs), reccmp);
+	for (i=0; i<nrecs; i++) {
+		printrec(&recs[i], &recs[0]);
+	}
+	return 0;
+}
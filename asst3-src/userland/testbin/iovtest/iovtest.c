@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * iovtest.c
+ *
+ * Tests readv and writev, and shows what they save over plain read
+ * and write when a record is made up of several separate buffers.
+ *
+ * First it writes a few records with writev and reads them back with
+ * readv, split up differently, to check that the data comes out in
+ * the right order. Then it writes the same log-style records (a
+ * header, a message, and a newline) once with one write() per
+ * fragment and once with one writev() per record, and prints the
+ * number of system calls and the time each way took.
+ *
+ * Usage: iovtest [file]
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define NRECORDS	2000
+#define NFRAGS		3
+
+static const char header[] = "[iovtest] ";
+static const char message[] = "something happened, here are the details";
+static const char newline[] = "\n";
+
+/* total bytes in one record */
+#define RECSIZE (sizeof(header)-1 + sizeof(message)-1 + sizeof(newline)-1)
+
+static
+void
+setupiov(struct iovec *iov)
+{
+	iov[0].iov_base = (void *)header;
+	iov[0].iov_len = sizeof(header)-1;
+	iov[1].iov_base = (void *)message;
+	iov[1].iov_len = sizeof(message)-1;
+	iov[2].iov_base = (void *)newline;
+	iov[2].iov_len = sizeof(newline)-1;
+}
+
+/*
+ * Write a few records with writev, then read them back with readv
+ * into buffers cut at different places, and check them.
+ */
+static
+void
+checkdata(const char *file)
+{
+	struct iovec iov[NFRAGS];
+	char expect[RECSIZE * 4];
+	char buf1[7], buf2[RECSIZE * 4 - 7 - 3], buf3[3];
+	char got[RECSIZE * 4];
+	ssize_t r;
+	int fd, i;
+
+	fd = open(file, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: open for write", file);
+	}
+	setupiov(iov);
+	for (i=0; i<4; i++) {
+		r = writev(fd, iov, NFRAGS);
+		if (r < 0) {
+			err(1, "%s: writev", file);
+		}
+		if ((size_t)r != RECSIZE) {
+			errx(1, "%s: writev: short count %d", file, (int)r);
+		}
+		memcpy(expect + i * RECSIZE, header, sizeof(header)-1);
+		memcpy(expect + i * RECSIZE + sizeof(header)-1,
+		       message, sizeof(message)-1);
+		memcpy(expect + (i+1) * RECSIZE - 1, newline, 1);
+	}
+	close(fd);
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open for read", file);
+	}
+	iov[0].iov_base = buf1;
+	iov[0].iov_len = sizeof(buf1);
+	iov[1].iov_base = buf2;
+	iov[1].iov_len = sizeof(buf2);
+	iov[2].iov_base = buf3;
+	iov[2].iov_len = sizeof(buf3);
+	r = readv(fd, iov, NFRAGS);
+	if (r < 0) {
+		err(1, "%s: readv", file);
+	}
+	if ((size_t)r != sizeof(got)) {
+		errx(1, "%s: readv: short count %d", file, (int)r);
+	}
+	close(fd);
+
+	memcpy(got, buf1, sizeof(buf1));
+	memcpy(got + sizeof(buf1), buf2, sizeof(buf2));
+	memcpy(got + sizeof(buf1) + sizeof(buf2), buf3, sizeof(buf3));
+	if (memcmp(got, expect, sizeof(got)) != 0) {
+		errx(1, "%s: data read back with readv is wrong", file);
+	}
+
+	printf("readv/writev data check passed\n");
+}
+
+/*
+ * Return the time since (s0, ns0) in microseconds.
+ */
+static
+unsigned long
+elapsed(time_t s0, unsigned long ns0)
+{
+	time_t s1;
+	unsigned long ns1;
+
+	__time(&s1, &ns1);
+	if (ns1 < ns0) {
+		ns1 += 1000000000;
+		s1--;
+	}
+	return (s1 - s0) * 1000000 + (ns1 - ns0) / 1000;
+}
+
+/*
+ * Write NRECORDS records, either with one write per fragment or with
+ * one writev per record.
+ */
+static
+void
+writerecords(const char *file, int usev)
+{
+	struct iovec iov[NFRAGS];
+	time_t s0;
+	unsigned long ns0, usecs;
+	unsigned calls;
+	int fd, i, j;
+
+	fd = open(file, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: open", file);
+	}
+	setupiov(iov);
+
+	calls = 0;
+	__time(&s0, &ns0);
+	for (i=0; i<NRECORDS; i++) {
+		if (usev) {
+			if (writev(fd, iov, NFRAGS) != (ssize_t)RECSIZE) {
+				err(1, "%s: writev", file);
+			}
+			calls++;
+			continue;
+		}
+		for (j=0; j<NFRAGS; j++) {
+			if (write(fd, iov[j].iov_base, iov[j].iov_len)
+			    != (ssize_t)iov[j].iov_len) {
+				err(1, "%s: write", file);
+			}
+			calls++;
+		}
+	}
+	usecs = elapsed(s0, ns0);
+	close(fd);
+
+	printf("%-7s %u records, %u syscalls, %lu.%03lu ms\n",
+	       usev ? "writev:" : "write:", NRECORDS, calls,
+	       usecs / 1000, usecs % 1000);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *file;
+
+	if (argc == 0 || argc == 1) {
+		file = "iovtest.dat";
+	}
+	else if (argc == 2) {
+		file = argv[1];
+	}
+	else {
+		errx(1, "Usage: iovtest [file]");
+	}
+
+	checkdata(file);
+	writerecords(file, 0);
+	writerecords(file, 1);
+
+	remove(file);
+	return 0;
+}
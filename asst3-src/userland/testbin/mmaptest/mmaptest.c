@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * mmaptest.c
+ *
+ * Tests mmap, munmap, and msync.
+ *
+ * Makes a small file and then checks that an anonymous mapping
+ * starts out zeroed, that a private mapping of the file shows its
+ * contents but keeps writes to itself, that writes through a shared
+ * mapping reach the file after msync and after munmap, that a
+ * shared mapping stays shared across fork, and that a few bad
+ * calls fail.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define FILENAME "mmaptest.tmp"
+#define PAGE 4096
+#define FILESIZE (3 * PAGE + 100)	/* not a whole number of pages */
+
+static
+char
+pattern(unsigned i)
+{
+	return 'a' + (i * 7) % 26;
+}
+
+/*
+ * Make the test file, with pattern() in it.
+ */
+static
+void
+makefile(void)
+{
+	char buf[100];
+	unsigned i, j;
+	int fd;
+
+	fd = open(FILENAME, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: open", FILENAME);
+	}
+	for (i = 0; i < FILESIZE; i += sizeof(buf)) {
+		for (j = 0; j < sizeof(buf); j++) {
+			buf[j] = pattern(i + j);
+		}
+		if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+			err(1, "%s: write", FILENAME);
+		}
+	}
+	close(fd);
+}
+
+/*
+ * Check that the file has pattern() in it except for CHANGED at
+ * offset POS (if POS isn't -1).
+ */
+static
+void
+checkfile(const char *what, int pos, char changed)
+{
+	char buf[100];
+	unsigned i, j;
+	int fd;
+
+	fd = open(FILENAME, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open", FILENAME);
+	}
+	for (i = 0; i < FILESIZE; i += sizeof(buf)) {
+		if (read(fd, buf, sizeof(buf)) != sizeof(buf)) {
+			err(1, "%s: read", what);
+		}
+		for (j = 0; j < sizeof(buf); j++) {
+			char expect = (int)(i + j) == pos ? changed
+				: pattern(i + j);
+			if (buf[j] != expect) {
+				errx(1, "%s: file offset %u is %c, expected %c",
+				     what, i + j, buf[j], expect);
+			}
+		}
+	}
+	if (read(fd, buf, 1) != 0) {
+		errx(1, "%s: file has grown", what);
+	}
+	close(fd);
+	printf("%s: ok\n", what);
+}
+
+static
+void
+anon(void)
+{
+	char *p;
+	unsigned i;
+
+	p = mmap(5 * PAGE, PROT_READ|PROT_WRITE, -1, 0);
+	if (p == MAP_FAILED) {
+		err(1, "anonymous mmap");
+	}
+	for (i = 0; i < 5 * PAGE; i++) {
+		if (p[i] != 0) {
+			errx(1, "anonymous mapping not zeroed at %u", i);
+		}
+		p[i] = pattern(i);
+	}
+	for (i = 0; i < 5 * PAGE; i++) {
+		if (p[i] != pattern(i)) {
+			errx(1, "anonymous mapping lost a write at %u", i);
+		}
+	}
+	if (munmap(p) < 0) {
+		err(1, "anonymous munmap");
+	}
+	printf("anonymous mapping: ok\n");
+}
+
+static
+void
+private(void)
+{
+	char *p;
+	unsigned i;
+	int fd;
+
+	fd = open(FILENAME, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open", FILENAME);
+	}
+	p = mmap(FILESIZE, PROT_READ|PROT_WRITE|MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED) {
+		err(1, "private mmap");
+	}
+	/* the mapping keeps the file */
+	close(fd);
+
+	for (i = 0; i < FILESIZE; i++) {
+		if (p[i] != pattern(i)) {
+			errx(1, "private mapping: offset %u is %c, expected %c",
+			     i, p[i], pattern(i));
+		}
+	}
+	for (; i < 4 * PAGE; i++) {
+		if (p[i] != 0) {
+			errx(1, "private mapping: nonzero past end of file");
+		}
+	}
+	p[PAGE + 1] = '!';
+	if (p[PAGE + 1] != '!') {
+		errx(1, "private mapping lost a write");
+	}
+	if (munmap(p) < 0) {
+		err(1, "private munmap");
+	}
+	checkfile("private mapping", -1, 0);
+}
+
+static
+void
+shared(void)
+{
+	char *p;
+	int fd;
+
+	fd = open(FILENAME, O_RDWR);
+	if (fd < 0) {
+		err(1, "%s: open", FILENAME);
+	}
+	p = mmap(FILESIZE, PROT_READ|PROT_WRITE|MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		err(1, "shared mmap");
+	}
+	close(fd);
+
+	p[2 * PAGE + 5] = '#';
+	/* past the end of the file; must not be written back */
+	p[FILESIZE + 10] = '#';
+	if (msync(p) < 0) {
+		err(1, "msync");
+	}
+	checkfile("shared mapping after msync", 2 * PAGE + 5, '#');
+
+	p[2 * PAGE + 5] = '@';
+	if (munmap(p) < 0) {
+		err(1, "shared munmap");
+	}
+	checkfile("shared mapping after munmap", 2 * PAGE + 5, '@');
+}
+
+static
+void
+forked(void)
+{
+	volatile char *p;
+	pid_t pid;
+	int status;
+
+	p = mmap(PAGE, PROT_READ|PROT_WRITE|MAP_SHARED, -1, 0);
+	if (p == MAP_FAILED) {
+		err(1, "shared anonymous mmap");
+	}
+	p[0] = 'x';
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		p[0] = 'y';
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (p[0] != 'y') {
+		errx(1, "shared mapping not shared with child");
+	}
+	munmap((void *)p);
+	printf("shared mapping across fork: ok\n");
+}
+
+static
+void
+bad(void)
+{
+	char *p;
+	int fd;
+
+	fd = open(FILENAME, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open", FILENAME);
+	}
+	p = mmap(PAGE, PROT_READ|PROT_WRITE|MAP_SHARED, fd, 0);
+	if (p != MAP_FAILED || errno != EACCES) {
+		errx(1, "writable shared mapping of read-only file: "
+		     "expected EACCES");
+	}
+	p = mmap(PAGE, PROT_READ, fd, 100);
+	if (p != MAP_FAILED || errno != EINVAL) {
+		errx(1, "unaligned offset: expected EINVAL");
+	}
+	close(fd);
+
+	if (munmap((void *)0x10000000) == 0 || errno != EINVAL) {
+		errx(1, "munmap of nothing: expected EINVAL");
+	}
+	printf("bad calls: ok\n");
+}
+
+int
+main(void)
+{
+	makefile();
+	anon();
+	private();
+	shared();
+	forked();
+	bad();
+	remove(FILENAME);
+	printf("mmaptest: passed\n");
+	return 0;
+}
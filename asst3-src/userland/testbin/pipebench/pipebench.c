@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * pipebench.c
+ *
+ * Measures pipe throughput. A child process reads everything the
+ * parent writes and checks it came through in order. This is done
+ * with a few different write sizes:
+ *
+ *    - small writes, which go through the pipe's ring buffer;
+ *    - page-sized writes from a misaligned buffer, which also go
+ *      through the ring buffer;
+ *    - multi-page writes from a page-aligned buffer, which the kernel
+ *      can hand straight to the reader a page at a time.
+ *
+ * First, though, it checks that a page-aligned write from a buffer
+ * that has never been touched (so its pages don't exist yet) reaches
+ * the reader intact instead of looking like EOF.
+ *
+ * Usage: pipebench [kilobytes]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define PAGESIZE	4096
+#define BUFSIZE		(PAGESIZE * 4)
+#define DEFAULT_KB	1024
+
+/* one extra page so we can line things up however we like */
+static char writespace[BUFSIZE + PAGESIZE];
+static char readspace[BUFSIZE + PAGESIZE];
+/* never written, so never faulted in */
+static char untouched[BUFSIZE + PAGESIZE];
+
+/*
+ * Return a pointer into SPACE that's page-aligned, plus OFFSET.
+ */
+static
+char *
+aligned(char *space, unsigned offset)
+{
+	unsigned long p;
+
+	p = ((unsigned long)space + PAGESIZE - 1) & ~(unsigned long)(PAGESIZE - 1);
+	return (char *)p + offset;
+}
+
+/*
+ * The byte at position POS in the stream.
+ */
+static
+char
+streambyte(unsigned long pos)
+{
+	return (char)(pos % 251);
+}
+
+/*
+ * Return the time since (s0, ns0) in microseconds.
+ */
+static
+unsigned long
+elapsed(time_t s0, unsigned long ns0)
+{
+	time_t s1;
+	unsigned long ns1;
+
+	__time(&s1, &ns1);
+	if (ns1 < ns0) {
+		ns1 += 1000000000;
+		s1--;
+	}
+	return (s1 - s0) * 1000000 + (ns1 - ns0) / 1000;
+}
+
+/*
+ * Child side: read TOTAL bytes in chunks of CHUNK and check them.
+ * Only the ends of each read are checked, so that the checking
+ * doesn't swamp the thing we're measuring.
+ */
+static
+void
+reader(int fd, unsigned long total, size_t chunk, unsigned offset)
+{
+	char *buf = aligned(readspace, offset);
+	unsigned long pos;
+	ssize_t r;
+
+	pos = 0;
+	while (pos < total) {
+		r = read(fd, buf, chunk);
+		if (r < 0) {
+			err(1, "reader: read");
+		}
+		if (r == 0) {
+			errx(1, "reader: unexpected EOF at %lu of %lu",
+			     pos, total);
+		}
+		if (buf[0] != streambyte(pos) ||
+		    buf[r-1] != streambyte(pos + r - 1)) {
+			errx(1, "reader: wrong data at %lu", pos);
+		}
+		pos += r;
+	}
+
+	r = read(fd, buf, chunk);
+	if (r != 0) {
+		errx(1, "reader: expected EOF, got %d", (int)r);
+	}
+}
+
+/*
+ * Parent side: write TOTAL bytes in chunks of CHUNK from a buffer
+ * OFFSET bytes past a page boundary.
+ */
+static
+void
+writer(int fd, unsigned long total, size_t chunk, unsigned offset)
+{
+	char *buf = aligned(writespace, offset);
+	unsigned long pos;
+	size_t len, i;
+	ssize_t r;
+
+	pos = 0;
+	while (pos < total) {
+		len = chunk;
+		if (len > total - pos) {
+			len = total - pos;
+		}
+		for (i=0; i<len; i++) {
+			buf[i] = streambyte(pos + i);
+		}
+		r = write(fd, buf, len);
+		if (r < 0) {
+			err(1, "writer: write");
+		}
+		if ((size_t)r != len) {
+			errx(1, "writer: short write %d of %u",
+			     (int)r, (unsigned)len);
+		}
+		pos += len;
+	}
+}
+
+/*
+ * Write BUFSIZE bytes of the untouched buffer through a pipe and check
+ * the reader gets them all (as zeros) before EOF.
+ */
+static
+void
+untouchedpass(void)
+{
+	char *buf;
+	int fds[2];
+	pid_t pid;
+	int status;
+	unsigned long pos;
+	ssize_t r, i;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[1]);
+		buf = aligned(readspace, 0);
+		pos = 0;
+		while (pos < BUFSIZE) {
+			r = read(fds[0], buf, BUFSIZE);
+			if (r < 0) {
+				err(1, "untouched: read");
+			}
+			if (r == 0) {
+				errx(1, "untouched: unexpected EOF at %lu of %d",
+				     pos, BUFSIZE);
+			}
+			for (i=0; i<r; i++) {
+				if (buf[i] != 0) {
+					errx(1, "untouched: wrong data at %lu",
+					     pos + i);
+				}
+			}
+			pos += r;
+		}
+		r = read(fds[0], buf, BUFSIZE);
+		if (r != 0) {
+			errx(1, "untouched: expected EOF, got %d", (int)r);
+		}
+		_exit(0);
+	}
+
+	close(fds[0]);
+	r = write(fds[1], aligned(untouched, 0), BUFSIZE);
+	if (r < 0) {
+		err(1, "untouched: write");
+	}
+	if (r != BUFSIZE) {
+		errx(1, "untouched: short write %d of %d", (int)r, BUFSIZE);
+	}
+	close(fds[1]);
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "untouched: reader failed");
+	}
+	printf("untouched buffer:      ok\n");
+}
+
+/*
+ * Run one pass and print the throughput.
+ */
+static
+void
+runpass(const char *name, unsigned long total, size_t chunk,
+	unsigned offset)
+{
+	int fds[2];
+	pid_t pid;
+	int status;
+	time_t s0;
+	unsigned long ns0, usecs, msecs;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	__time(&s0, &ns0);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[1]);
+		reader(fds[0], total, chunk, offset);
+		_exit(0);
+	}
+
+	close(fds[0]);
+	writer(fds[1], total, chunk, offset);
+	close(fds[1]);
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	usecs = elapsed(s0, ns0);
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "%s: reader failed", name);
+	}
+
+	msecs = usecs / 1000;
+	if (msecs == 0) {
+		msecs = 1;
+	}
+	printf("%-22s %6lu KB in %lu.%03lu ms: %lu KB/s\n", name,
+	       total / 1024, usecs / 1000, usecs % 1000,
+	       total / 1024 * 1000 / msecs);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long total;
+
+	if (argc == 0 || argc == 1) {
+		total = DEFAULT_KB * 1024UL;
+	}
+	else if (argc == 2) {
+		total = atoi(argv[1]) * 1024UL;
+	}
+	else {
+		errx(1, "Usage: pipebench [kilobytes]");
+	}
+
+	untouchedpass();
+
+	runpass("100-byte writes:", total, 100, 0);
+	runpass("unaligned page writes:", total, PAGESIZE, 1);
+	runpass("aligned 4-page writes:", total, BUFSIZE, 0);
+
+	printf("pipebench done\n");
+	return 0;
+}
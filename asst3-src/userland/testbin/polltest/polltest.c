@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * polltest.c
+ *
+ * Tests poll on pipes, plain files, and the console.
+ *
+ * First some checks that don't need anyone at the keyboard: a timeout
+ * with nothing ready, a file (always ready), an empty pipe, a pipe
+ * with data in it, a pipe whose other end has gone away, and a bad
+ * file handle. Then a child process writes into a pipe every so often
+ * while the parent waits on both the pipe and the console, echoing
+ * whichever is ready, until you type a line saying "q".
+ *
+ * Usage: polltest [-n]
+ *    -n    skip the interactive part
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <err.h>
+
+#define NMESSAGES 5
+
+/*
+ * Poll one file handle for EVENTS with TIMEOUT and check we get
+ * EXPECT back.
+ */
+static
+void
+check1(const char *what, int fd, int events, int timeout, int expect)
+{
+	struct pollfd pfd;
+	int r;
+
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = 0;
+	r = poll(&pfd, 1, timeout);
+	if (r < 0) {
+		err(1, "%s: poll", what);
+	}
+	if (r != (expect != 0) || pfd.revents != expect) {
+		errx(1, "%s: poll returned %d with revents 0x%x, "
+		     "expected 0x%x", what, r, pfd.revents, expect);
+	}
+	printf("%s: ok\n", what);
+}
+
+static
+void
+basics(void)
+{
+	int fds[2], fd;
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	__time(&s0, &ns0);
+	check1("empty pipe, 500 ms", fds[0], POLLIN, 500, 0);
+	__time(&s1, &ns1);
+	if ((s1 - s0) * 1000 + (long)(ns1 / 1000000) - (long)(ns0 / 1000000)
+	    < 450) {
+		errx(1, "poll came back too soon");
+	}
+
+	check1("empty pipe, no wait", fds[0], POLLIN, 0, 0);
+	check1("pipe write end", fds[1], POLLOUT, 0, POLLOUT);
+	if (write(fds[1], "x", 1) != 1) {
+		err(1, "write");
+	}
+	check1("pipe with data", fds[0], POLLIN, -1, POLLIN);
+	close(fds[1]);
+	check1("pipe with no writer", fds[0], POLLIN, -1, POLLIN|POLLHUP);
+	close(fds[0]);
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	close(fds[0]);
+	check1("pipe with no reader", fds[1], POLLOUT, -1, POLLERR);
+	close(fds[1]);
+
+	fd = open("polltest.tmp", O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "polltest.tmp");
+	}
+	check1("regular file", fd, POLLIN|POLLOUT, -1, POLLIN|POLLOUT);
+	close(fd);
+	remove("polltest.tmp");
+
+	check1("closed file handle", fd, POLLIN, 0, POLLNVAL);
+}
+
+static
+void
+interactive(void)
+{
+	struct pollfd pfds[2];
+	char buf[128];
+	int fds[2], status, r, i;
+	pid_t pid;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		for (i=0; i<NMESSAGES; i++) {
+			/* poll on nothing makes a handy sleep */
+			poll(NULL, 0, 2000);
+			snprintf(buf, sizeof(buf), "message %d from child", i);
+			write(fds[1], buf, strlen(buf));
+		}
+		_exit(0);
+	}
+	close(fds[1]);
+
+	printf("Type lines; \"q\" quits. Messages from the child "
+	       "arrive every 2 seconds.\n");
+	pfds[0].fd = STDIN_FILENO;
+	pfds[0].events = POLLIN;
+	pfds[1].fd = fds[0];
+	pfds[1].events = POLLIN;
+	while (1) {
+		r = poll(pfds, 2, -1);
+		if (r < 0) {
+			err(1, "poll");
+		}
+		if (pfds[0].revents & POLLIN) {
+			r = read(STDIN_FILENO, buf, sizeof(buf) - 1);
+			if (r <= 0) {
+				break;
+			}
+			buf[r] = 0;
+			printf("console: %s", buf);
+			if (!strcmp(buf, "q\n")) {
+				break;
+			}
+		}
+		if (pfds[1].revents & POLLIN) {
+			r = read(fds[0], buf, sizeof(buf) - 1);
+			if (r < 0) {
+				err(1, "read");
+			}
+			buf[r] = 0;
+			printf("pipe: %s\n", r > 0 ? buf : "(EOF)");
+		}
+		if (pfds[1].revents & POLLHUP) {
+			/* child's done; stop watching the pipe */
+			pfds[1].fd = -1;
+		}
+	}
+	close(fds[0]);
+	waitpid(pid, &status, 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	basics();
+	if (argc < 2 || strcmp(argv[1], "-n") != 0) {
+		interactive();
+	}
+	printf("polltest done\n");
+	return 0;
+}
@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ringbench.c
+ *
+ * Compares plain system calls with batched ones (sysring_enter) on a
+ * small-file workload. A set of small files is created, and then
+ * each pass opens, fstats, reads, and closes every one of them:
+ *
+ *    - once with a trap per call;
+ *    - once with each file's four calls queued in a ring and run
+ *      with one trap per batch of files.
+ *
+ * Both ways check the file contents and sizes.
+ *
+ * Usage: ringbench [passes]
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sysring.h>
+#include <errno.h>
+#include <err.h>
+
+#define NFILES		32
+#define FILESIZE	100
+#define PERBATCH	8	/* files per sysring_enter */
+#define DEFAULT_PASSES	20
+
+static char names[NFILES][32];
+static char bufs[NFILES][FILESIZE + 1];
+static struct stat stats[NFILES];
+
+/*
+ * The byte at POS in file NUM.
+ */
+static
+char
+filebyte(int num, unsigned pos)
+{
+	return (char)('a' + (num + pos) % 26);
+}
+
+/*
+ * Return the time since (s0, ns0) in microseconds.
+ */
+static
+unsigned long
+elapsed(time_t s0, unsigned long ns0)
+{
+	time_t s1;
+	unsigned long ns1;
+
+	__time(&s1, &ns1);
+	if (ns1 < ns0) {
+		ns1 += 1000000000;
+		s1--;
+	}
+	return (s1 - s0) * 1000000 + (ns1 - ns0) / 1000;
+}
+
+static
+void
+makefiles(void)
+{
+	char buf[FILESIZE];
+	unsigned j;
+	int i, fd;
+
+	for (i=0; i<NFILES; i++) {
+		snprintf(names[i], sizeof(names[i]), "ringbench.%d", i);
+		for (j=0; j<FILESIZE; j++) {
+			buf[j] = filebyte(i, j);
+		}
+		fd = open(names[i], O_WRONLY|O_CREAT|O_TRUNC, 0664);
+		if (fd < 0) {
+			err(1, "%s", names[i]);
+		}
+		if (write(fd, buf, FILESIZE) != FILESIZE) {
+			err(1, "%s: write", names[i]);
+		}
+		close(fd);
+	}
+}
+
+static
+void
+removefiles(void)
+{
+	int i;
+
+	for (i=0; i<NFILES; i++) {
+		remove(names[i]);
+	}
+}
+
+/*
+ * Check what a pass read in for file NUM.
+ */
+static
+void
+check(int num, int len)
+{
+	unsigned j;
+
+	if (len != FILESIZE) {
+		errx(1, "%s: read %d bytes, expected %d",
+		     names[num], len, FILESIZE);
+	}
+	if (stats[num].st_size != FILESIZE) {
+		errx(1, "%s: fstat gave size %d, expected %d",
+		     names[num], (int)stats[num].st_size, FILESIZE);
+	}
+	for (j=0; j<FILESIZE; j++) {
+		if (bufs[num][j] != filebyte(num, j)) {
+			errx(1, "%s: wrong data at %u", names[num], j);
+		}
+	}
+}
+
+static
+void
+plainpass(void)
+{
+	int i, fd, len;
+
+	for (i=0; i<NFILES; i++) {
+		fd = open(names[i], O_RDONLY);
+		if (fd < 0) {
+			err(1, "%s", names[i]);
+		}
+		if (fstat(fd, &stats[i]) < 0) {
+			err(1, "%s: fstat", names[i]);
+		}
+		/* ask for one extra byte to see EOF */
+		len = read(fd, bufs[i], FILESIZE + 1);
+		if (len < 0) {
+			err(1, "%s: read", names[i]);
+		}
+		if (close(fd) < 0) {
+			err(1, "%s: close", names[i]);
+		}
+		check(i, len);
+	}
+}
+
+static
+void
+ringpass(struct sysring *ring)
+{
+	struct sysring_entry *sre;
+	unsigned k, m;
+	int i, j, n;
+
+	for (i=0; i<NFILES; i += PERBATCH) {
+		n = NFILES - i;
+		if (n > PERBATCH) {
+			n = PERBATCH;
+		}
+		for (j=i; j<i+n; j++) {
+			sysring_queue(ring, 0, SYS_open,
+				      (int)names[j], O_RDONLY, 0);
+			sysring_queue(ring, SYSRING_LASTFD, SYS_fstat,
+				      0, (int)&stats[j], 0);
+			sysring_queue(ring, SYSRING_LASTFD, SYS_read,
+				      0, (int)bufs[j], FILESIZE + 1);
+			sysring_queue(ring, SYSRING_LASTFD, SYS_close,
+				      0, 0, 0);
+		}
+		k = ring->sr_head;
+		if (sysring_enter(ring) != n * 4) {
+			err(1, "sysring_enter");
+		}
+		for (j=i; j<i+n; j++, k += 4) {
+			for (m=0; m<4; m++) {
+				sre = SYSRING_ENTRY(ring, k + m);
+				if (sre->sre_errno) {
+					errno = sre->sre_errno;
+					err(1, "%s: call %d", names[j],
+					    sre->sre_callno);
+				}
+			}
+			check(j, SYSRING_ENTRY(ring, k + 2)->sre_retval);
+		}
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct sysring *ring;
+	unsigned long plainus, ringus;
+	time_t s0;
+	unsigned long ns0;
+	int passes, i;
+
+	passes = DEFAULT_PASSES;
+	if (argc > 1) {
+		passes = atoi(argv[1]);
+		if (passes <= 0) {
+			errx(1, "Usage: ringbench [passes]");
+		}
+	}
+
+	ring = sysring_create(PERBATCH * 4);
+	if (ring == NULL) {
+		err(1, "sysring_create");
+	}
+	makefiles();
+
+	__time(&s0, &ns0);
+	for (i=0; i<passes; i++) {
+		plainpass();
+	}
+	plainus = elapsed(s0, ns0);
+
+	__time(&s0, &ns0);
+	for (i=0; i<passes; i++) {
+		ringpass(ring);
+	}
+	ringus = elapsed(s0, ns0);
+
+	removefiles();
+	free(ring);
+
+	printf("%d passes of %d files (%d calls each way)\n",
+	       passes, NFILES, passes * NFILES * 4);
+	printf("plain:    %lu ms\n", plainus / 1000);
+	printf("sysring:  %lu ms\n", ringus / 1000);
+	return 0;
+}
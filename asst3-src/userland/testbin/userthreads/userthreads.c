@@ -37,7 +37,7 @@
  *
  * It also makes various assumptions about the thread API. In
  * particular, it believes (1) that you create a thread by calling
- * "threadfork()" and passing the address for execution of the new
+ * "thread_create()" and passing the address for execution of the new
  * thread to begin at, (2) that if the parent thread exits any child
  * threads will keep running, and (3) child threads will exit if they
  * return from the function they started in. If any or all of these
@@ -61,8 +61,8 @@
 volatile int count = 0;
 
 /* the 2 threads : */
-void ThreadRunner(void);
-void BladeRunner(void);
+int ThreadRunner(void *);
+int BladeRunner(void *);
 
 int
 main(int argc, char *argv[])
@@ -74,9 +74,9 @@ main(int argc, char *argv[])
 
     for (i=0; i<NTHREADS; i++) {
 	if (i)
-	    threadfork(ThreadRunner);
+	    thread_create(ThreadRunner, NULL);
         else
-	    threadfork(BladeRunner);
+	    thread_create(BladeRunner, NULL);
     }
 
     printf("Parent has left.\n");
@@ -88,22 +88,28 @@ main(int argc, char *argv[])
    random results.
 */
 
-void
-BladeRunner()
+int
+BladeRunner(void *junk)
 {
+    (void)junk;
+
     while (count < MAX) {
 	if (count % 500 == 0)
 	    printf("Blade ");
 	count++;
     }
+    return 0;
 }
 
-void
-ThreadRunner()
+int
+ThreadRunner(void *junk)
 {
+    (void)junk;
+
     while (count < MAX) {
 	if (count % 513 == 0)
 	    printf(" Runner\n");
 	count++;
     }
+    return 0;
 }